@@ -0,0 +1,547 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define OS_MEMORY_TAG OS_MEMTAG_MIXER
+
+#include <string.h>
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MIXER_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define MIXER_SSE2
+#endif
+
+#include "msgutils/cutils/os_thread.h"
+#include "cutils/os_alloc.h"
+#include "cutils/log_gate.h"
+#include "cutils/spsc_ring.h"
+#include "cutils/os_sched.h"
+#include "cutils/os_trace.h"
+#include "adapter/mixer_wrapper.h"
+
+#define TAG "mixer_wrapper"
+
+#define DEFAULT_PERIOD_MS        10
+#define DEFAULT_SOURCE_BUFFER_MS 100
+#define CLOSE_TIMEOUT_MS         100
+
+#define GAIN_SHIFT   12
+#define GAIN_UNITY   (1 << GAIN_SHIFT)
+
+#define PHASE_SHIFT  16
+#define PHASE_ONE    (1ULL << PHASE_SHIFT)
+
+enum mixer_source_state {
+    SOURCE_FREE = 0,
+    SOURCE_OPENING,
+    SOURCE_ACTIVE,
+    SOURCE_CLOSING,           // set by close, mixer thread stops reading it
+    SOURCE_CLOSED,            // acknowledged by mixer thread, close releases it
+    SOURCE_ORPHANED,          // close gave up waiting, mixer thread releases it
+};
+
+struct mixer_source {
+    struct mixer *mixer;
+    int state;                // enum mixer_source_state, accessed atomically
+    int gain;                 // Q12, accessed atomically
+    int samplerate;
+    int channels;
+    spsc_ring_t rb;
+    int filled;               // bytes in rb, kept by writer and mixer for stats queries, accessed atomically
+    int byterate;             // of the opened source, 0 if closed, accessed atomically
+    bool passthrough;         // already in output format, mixed straight from rb
+    short *stage;             // input frames waiting for resampling
+    int stage_frames;         // frames in stage
+    int stage_capacity;       // max frames of stage
+    unsigned long long phase; // Q16 read position in stage
+    unsigned long long step;  // Q16 input frames per output frame
+};
+
+struct mixer {
+    struct sink_wrapper output;
+    sink_handle_t output_handle;
+    int samplerate;
+    int channels;
+    int period_ms;
+    int period_frames;
+    int source_buffer_ms;
+    struct mixer_source sources[MIXER_MAX_SOURCES];
+    int active_count;         // opened sources, accessed atomically
+    short *resample_buf;
+    int *mix_buf;
+    short *out_buf;
+    os_thread_t tid;
+    os_mutex_t lock;
+    os_cond_t cond;
+    bool exit;
+};
+
+static void mix_accumulate(int *acc, const short *in, int gain, int samples)
+{
+    int i = 0;
+#if defined(MIXER_NEON)
+    int16x4_t g = vdup_n_s16((short)gain);
+    for (; i + 8 <= samples; i += 8) {
+        int16x8_t x = vld1q_s16(in + i);
+        int32x4_t lo = vmull_s16(vget_low_s16(x), g);
+        int32x4_t hi = vmull_s16(vget_high_s16(x), g);
+        vst1q_s32(acc + i, vsraq_n_s32(vld1q_s32(acc + i), lo, GAIN_SHIFT));
+        vst1q_s32(acc + i + 4, vsraq_n_s32(vld1q_s32(acc + i + 4), hi, GAIN_SHIFT));
+    }
+#elif defined(MIXER_SSE2)
+    __m128i g = _mm_set1_epi16((short)gain);
+    for (; i + 8 <= samples; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i plo = _mm_mullo_epi16(x, g);
+        __m128i phi = _mm_mulhi_epi16(x, g);
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(plo, phi), GAIN_SHIFT);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(plo, phi), GAIN_SHIFT);
+        __m128i *a = (__m128i *)(acc + i);
+        _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), lo));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), hi));
+    }
+#endif
+    for (; i < samples; i++)
+        acc[i] += (in[i] * gain) >> GAIN_SHIFT;
+}
+
+static void mix_saturate(short *out, const int *acc, int samples)
+{
+    int i = 0;
+#if defined(MIXER_NEON)
+    for (; i + 8 <= samples; i += 8) {
+        int16x8_t v = vcombine_s16(vqmovn_s32(vld1q_s32(acc + i)), vqmovn_s32(vld1q_s32(acc + i + 4)));
+        vst1q_s16(out + i, v);
+    }
+#elif defined(MIXER_SSE2)
+    for (; i + 8 <= samples; i += 8) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(acc + i));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(acc + i + 4));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(lo, hi));
+    }
+#endif
+    for (; i < samples; i++) {
+        int v = acc[i];
+        out[i] = v > 32767 ? 32767 : (v < -32768 ? -32768 : (short)v);
+    }
+}
+
+// Linear resample and channel convert the source to output format,
+// return the number of frames produced, less than out_frames if underrun
+static int source_resample(struct mixer *mixer, struct mixer_source *src, short *out, int out_frames)
+{
+    int in_ch = src->channels;
+    int out_ch = mixer->channels;
+    int frame_bytes = in_ch * sizeof(short);
+
+    // The last output frame interpolates between stage[n] and stage[n+1]
+    int wanted = (int)((src->phase + src->step * (out_frames - 1)) >> PHASE_SHIFT) + 2;
+    if (wanted > src->stage_capacity)
+        wanted = src->stage_capacity;
+    if (wanted > src->stage_frames) {
+        int count = wanted - src->stage_frames;
+        int filled = spsc_ring_bytes_filled(src->rb) / frame_bytes;
+        if (count > filled)
+            count = filled;
+        if (count > 0) {
+            int ret = spsc_ring_read(src->rb, (char *)(src->stage + src->stage_frames * in_ch), count * frame_bytes, 0);
+            if (ret > 0) {
+                src->stage_frames += ret / frame_bytes;
+                __atomic_sub_fetch(&src->filled, ret, __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    int produced = 0;
+    unsigned long long pos = src->phase;
+    while (produced < out_frames) {
+        int idx = (int)(pos >> PHASE_SHIFT);
+        if (idx + 1 >= src->stage_frames)
+            break;
+        int frac = (int)((pos & (PHASE_ONE - 1)) >> 1); // Q15 to avoid overflow
+        short *s0 = src->stage + idx * in_ch;
+        short *s1 = s0 + in_ch;
+        int l = s0[0] + (((s1[0] - s0[0]) * frac) >> 15);
+        int r = in_ch == 2 ? s0[1] + (((s1[1] - s0[1]) * frac) >> 15) : l;
+        if (out_ch == 2) {
+            out[0] = (short)l;
+            out[1] = (short)r;
+        } else {
+            out[0] = (short)((l + r) >> 1);
+        }
+        out += out_ch;
+        pos += src->step;
+        produced++;
+    }
+
+    // Drop consumed frames, keep the frame at read position for next period
+    int consumed = (int)(pos >> PHASE_SHIFT);
+    if (consumed > src->stage_frames)
+        consumed = src->stage_frames;
+    if (consumed > 0) {
+        memmove(src->stage, src->stage + consumed * in_ch, (src->stage_frames - consumed) * frame_bytes);
+        src->stage_frames -= consumed;
+        pos -= (unsigned long long)consumed << PHASE_SHIFT;
+    }
+    src->phase = pos;
+    return produced;
+}
+
+// Mix the source without resampling, reading its frames in place from the ring,
+// return the number of frames mixed
+static int source_mix_direct(struct mixer *mixer, struct mixer_source *src, int gain)
+{
+    int frame_bytes = src->channels * sizeof(short);
+    int mixed = 0;
+    // Regions end on frame boundary, the ring size is a power of two
+    while (mixed < mixer->period_frames && spsc_ring_bytes_filled(src->rb) >= frame_bytes) {
+        char *ptr = NULL;
+        int len = 0;
+        if (spsc_ring_acquire_read(src->rb, &ptr, &len, 0) != RB_OK)
+            break;
+        int frames = len / frame_bytes;
+        if (frames > mixer->period_frames - mixed)
+            frames = mixer->period_frames - mixed;
+        mix_accumulate(mixer->mix_buf + mixed * mixer->channels, (const short *)ptr, gain, frames * src->channels);
+        spsc_ring_commit_read(src->rb, frames * frame_bytes);
+        __atomic_sub_fetch(&src->filled, frames * frame_bytes, __ATOMIC_RELAXED);
+        mixed += frames;
+    }
+    return mixed;
+}
+
+// Free buffers of a source no longer read by the mixer thread and free its slot
+static void source_release(struct mixer *mixer, struct mixer_source *src)
+{
+    __atomic_store_n(&src->byterate, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&src->filled, 0, __ATOMIC_RELAXED);
+    spsc_ring_destroy(src->rb);
+    src->rb = NULL;
+    OS_FREE(src->stage);
+    src->stage = NULL;
+    __atomic_sub_fetch(&mixer->active_count, 1, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&src->state, SOURCE_FREE, __ATOMIC_RELEASE);
+}
+
+static void *mixer_thread(void *arg)
+{
+    struct mixer *mixer = (struct mixer *)arg;
+    int samples = mixer->period_frames * mixer->channels;
+    int i;
+
+    // OS_THREAD_CREATE ignores priority on Linux/Android, apply it here
+    struct os_schedattr sched_attr;
+    OS_SCHED_FROM_PRIO(OS_THREAD_PRIO_SOFT_REALTIME, &sched_attr);
+    OS_SCHED_APPLY(&sched_attr);
+
+    while (!__atomic_load_n(&mixer->exit, __ATOMIC_ACQUIRE)) {
+        if (__atomic_load_n(&mixer->active_count, __ATOMIC_ACQUIRE) == 0) {
+            if (mixer->output_handle != NULL) {
+                mixer->output.close(mixer->output_handle);
+                mixer->output_handle = NULL;
+            }
+            OS_THREAD_MUTEX_LOCK(mixer->lock);
+            while (!mixer->exit && __atomic_load_n(&mixer->active_count, __ATOMIC_ACQUIRE) == 0)
+                OS_THREAD_COND_WAIT(mixer->cond, mixer->lock);
+            OS_THREAD_MUTEX_UNLOCK(mixer->lock);
+            continue;
+        }
+
+        if (mixer->output_handle == NULL) {
+            mixer->output_handle = mixer->output.open(mixer->samplerate, mixer->channels, mixer->output.sink_priv);
+            if (mixer->output_handle == NULL)
+                OS_LOGE(TAG, "Failed to open output sink");
+        }
+
+        OS_TRACE_BEGIN("mixer_mix");
+        memset(mixer->mix_buf, 0, samples * sizeof(int));
+        for (i = 0; i < MIXER_MAX_SOURCES; i++) {
+            struct mixer_source *src = &mixer->sources[i];
+            int state = __atomic_load_n(&src->state, __ATOMIC_ACQUIRE);
+            if (state == SOURCE_CLOSING) {
+                // Queued audio of a closed source is dropped, not played out
+                int expected = SOURCE_CLOSING;
+                __atomic_compare_exchange_n(&src->state, &expected, SOURCE_CLOSED,
+                                            false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+                if (expected == SOURCE_ORPHANED)
+                    source_release(mixer, src);
+                continue;
+            }
+            if (state == SOURCE_ORPHANED) {
+                source_release(mixer, src);
+                continue;
+            }
+            if (state != SOURCE_ACTIVE)
+                continue;
+            int gain = __atomic_load_n(&src->gain, __ATOMIC_RELAXED);
+            int frames;
+            if (src->passthrough) {
+                frames = source_mix_direct(mixer, src, gain);
+            } else {
+                frames = source_resample(mixer, src, mixer->resample_buf, mixer->period_frames);
+                if (frames > 0)
+                    mix_accumulate(mixer->mix_buf, mixer->resample_buf, gain, frames * mixer->channels);
+            }
+        }
+        mix_saturate(mixer->out_buf, mixer->mix_buf, samples);
+        OS_TRACE_END("mixer_mix");
+
+        if (mixer->output_handle != NULL) {
+            // Blocking write of output sink paces the mixer
+            OS_TRACE_BEGIN("mixer_write");
+            int ret = mixer->output.write(mixer->output_handle, (char *)mixer->out_buf, samples * sizeof(short));
+            OS_TRACE_END("mixer_write");
+            if (ret < 0) {
+                OS_LOGE(TAG, "Failed to write output sink, ret=%d", ret);
+                mixer->output.close(mixer->output_handle);
+                mixer->output_handle = NULL;
+            }
+        } else {
+            // Keep draining sources even if output is unavailable
+            OS_THREAD_SLEEP_MSEC(mixer->period_ms);
+        }
+    }
+
+    if (mixer->output_handle != NULL) {
+        mixer->output.close(mixer->output_handle);
+        mixer->output_handle = NULL;
+    }
+    return NULL;
+}
+
+mixer_handle_t mixer_create(struct mixer_attr *attr, struct sink_wrapper *output)
+{
+    if (attr == NULL || output == NULL || output->open == NULL ||
+        output->write == NULL || output->close == NULL) {
+        OS_LOGE(TAG, "Invalid mixer attr or output sink");
+        return NULL;
+    }
+    if (attr->samplerate <= 0 || (attr->channels != 1 && attr->channels != 2)) {
+        OS_LOGE(TAG, "Invalid output format: samplerate=%d, channels=%d", attr->samplerate, attr->channels);
+        return NULL;
+    }
+
+    struct mixer *mixer = OS_CALLOC(1, sizeof(struct mixer));
+    if (mixer == NULL)
+        return NULL;
+
+    int i;
+    for (i = 0; i < MIXER_MAX_SOURCES; i++)
+        mixer->sources[i].mixer = mixer;
+    mixer->output = *output;
+    mixer->samplerate = attr->samplerate;
+    mixer->channels = attr->channels;
+    mixer->period_ms = attr->period_ms > 0 ? attr->period_ms : DEFAULT_PERIOD_MS;
+    mixer->period_frames = mixer->samplerate * mixer->period_ms / 1000;
+    mixer->source_buffer_ms = attr->source_buffer_ms > 0 ? attr->source_buffer_ms : DEFAULT_SOURCE_BUFFER_MS;
+
+    int samples = mixer->period_frames * mixer->channels;
+    mixer->resample_buf = OS_MALLOC(samples * sizeof(short));
+    mixer->mix_buf = OS_MALLOC(samples * sizeof(int));
+    mixer->out_buf = OS_MALLOC(samples * sizeof(short));
+    mixer->lock = OS_THREAD_MUTEX_CREATE();
+    mixer->cond = OS_THREAD_COND_CREATE();
+    if (mixer->resample_buf == NULL || mixer->mix_buf == NULL || mixer->out_buf == NULL ||
+        mixer->lock == NULL || mixer->cond == NULL)
+        goto fail;
+
+    struct os_threadattr thread_attr = {
+        .name = "liteplayer_mixer",
+        .priority = OS_THREAD_PRIO_SOFT_REALTIME,
+        .stacksize = 16 * 1024,
+        .joinable = true,
+    };
+    mixer->tid = OS_THREAD_CREATE(&thread_attr, mixer_thread, mixer);
+    if (mixer->tid == NULL) {
+        OS_LOGE(TAG, "Failed to create mixer thread");
+        goto fail;
+    }
+    return mixer;
+
+fail:
+    if (mixer->lock != NULL)
+        OS_THREAD_MUTEX_DESTROY(mixer->lock);
+    if (mixer->cond != NULL)
+        OS_THREAD_COND_DESTROY(mixer->cond);
+    OS_FREE(mixer->resample_buf);
+    OS_FREE(mixer->mix_buf);
+    OS_FREE(mixer->out_buf);
+    OS_FREE(mixer);
+    return NULL;
+}
+
+void mixer_destroy(mixer_handle_t mixer)
+{
+    if (mixer == NULL)
+        return;
+    // Sources hold pointers to the mixer, leak it rather than leave them dangling
+    if (__atomic_load_n(&mixer->active_count, __ATOMIC_ACQUIRE) != 0) {
+        OS_LOGE(TAG, "Refuse to destroy mixer with opened sources");
+        return;
+    }
+
+    OS_THREAD_MUTEX_LOCK(mixer->lock);
+    __atomic_store_n(&mixer->exit, true, __ATOMIC_RELEASE);
+    OS_THREAD_COND_SIGNAL(mixer->cond);
+    OS_THREAD_MUTEX_UNLOCK(mixer->lock);
+    OS_THREAD_JOIN(mixer->tid, NULL);
+
+    OS_THREAD_MUTEX_DESTROY(mixer->lock);
+    OS_THREAD_COND_DESTROY(mixer->cond);
+    OS_FREE(mixer->resample_buf);
+    OS_FREE(mixer->mix_buf);
+    OS_FREE(mixer->out_buf);
+    OS_FREE(mixer);
+}
+
+int mixer_set_gain(sink_handle_t source, float gain)
+{
+    struct mixer_source *src = (struct mixer_source *)source;
+    if (src == NULL)
+        return -1;
+    if (gain < 0.0f)
+        gain = 0.0f;
+    else if (gain > MIXER_GAIN_MAX)
+        gain = MIXER_GAIN_MAX;
+    __atomic_store_n(&src->gain, (int)(gain * GAIN_UNITY + 0.5f), __ATOMIC_RELAXED);
+    return 0;
+}
+
+int mixer_wrapper_get_filled(sink_handle_t handle)
+{
+    struct mixer_source *src = (struct mixer_source *)handle;
+    if (src == NULL)
+        return 0;
+    // Never touch rb here, it is destroyed by close on the player thread.
+    // Mixer may consume bytes before the writer counts them, clamp at zero
+    int filled = __atomic_load_n(&src->filled, __ATOMIC_RELAXED);
+    return filled > 0 ? filled : 0;
+}
+
+int mixer_wrapper_get_latency(sink_handle_t handle)
+{
+    struct mixer_source *src = (struct mixer_source *)handle;
+    if (src == NULL)
+        return 0;
+    // Same as get_filled, format fields may already belong to the next source of the slot
+    int byterate = __atomic_load_n(&src->byterate, __ATOMIC_RELAXED);
+    if (byterate <= 0)
+        return 0;
+    int filled = mixer_wrapper_get_filled(handle);
+    // Plus the period being mixed, its frames have left the ring
+    return (int)((long long)filled * 1000 / byterate) + src->mixer->period_ms;
+}
+
+sink_handle_t mixer_wrapper_open(int samplerate, int channels, void *sink_priv)
+{
+    OS_LOGD(TAG, "Opening mixer source: samplerate=%d, channels=%d", samplerate, channels);
+    struct mixer *mixer = (struct mixer *)sink_priv;
+    if (mixer == NULL || samplerate <= 0 || (channels != 1 && channels != 2)) {
+        OS_LOGE(TAG, "Invalid mixer or source format");
+        return NULL;
+    }
+
+    // Claim a free slot without stopping the mixer thread
+    struct mixer_source *src = NULL;
+    int i;
+    for (i = 0; i < MIXER_MAX_SOURCES; i++) {
+        int expected = SOURCE_FREE;
+        if (__atomic_compare_exchange_n(&mixer->sources[i].state, &expected, SOURCE_OPENING,
+                                        false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            src = &mixer->sources[i];
+            break;
+        }
+    }
+    if (src == NULL) {
+        OS_LOGE(TAG, "No free mixer source, max sources: %d", MIXER_MAX_SOURCES);
+        return NULL;
+    }
+
+    src->samplerate = samplerate;
+    src->channels = channels;
+    src->passthrough = samplerate == mixer->samplerate && channels == mixer->channels;
+    src->step = ((unsigned long long)samplerate << PHASE_SHIFT) / mixer->samplerate;
+    src->phase = 0;
+    src->stage_frames = 0;
+    src->stage_capacity = (int)((src->step * mixer->period_frames) >> PHASE_SHIFT) + 4;
+    src->stage = OS_MALLOC(src->stage_capacity * channels * sizeof(short));
+    // Mirrored ring lets passthrough sources be mixed in one pass across the wrap
+    int rb_size = samplerate * channels * sizeof(short) * mixer->source_buffer_ms / 1000;
+    src->rb = spsc_ring_create_mirrored(rb_size);
+    if (src->rb == NULL)
+        src->rb = spsc_ring_create(rb_size);
+    // Wake a player blocked on the full ring every few periods instead of each
+    if (src->rb != NULL)
+        spsc_ring_set_watermarks(src->rb, 1, spsc_ring_get_size(src->rb) / 4);
+    if (src->stage == NULL || src->rb == NULL) {
+        OS_LOGE(TAG, "Failed to allocate mixer source buffer");
+        OS_FREE(src->stage);
+        if (src->rb != NULL) {
+            spsc_ring_destroy(src->rb);
+            src->rb = NULL;
+        }
+        __atomic_store_n(&src->state, SOURCE_FREE, __ATOMIC_RELEASE);
+        return NULL;
+    }
+    __atomic_store_n(&src->gain, GAIN_UNITY, __ATOMIC_RELAXED);
+    __atomic_store_n(&src->filled, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&src->byterate, samplerate * channels * (int)sizeof(short), __ATOMIC_RELAXED);
+    __atomic_store_n(&src->state, SOURCE_ACTIVE, __ATOMIC_RELEASE);
+
+    if (__atomic_add_fetch(&mixer->active_count, 1, __ATOMIC_ACQ_REL) == 1) {
+        OS_THREAD_MUTEX_LOCK(mixer->lock);
+        OS_THREAD_COND_SIGNAL(mixer->cond);
+        OS_THREAD_MUTEX_UNLOCK(mixer->lock);
+    }
+    return (sink_handle_t)src;
+}
+
+int mixer_wrapper_write(sink_handle_t handle, char *buffer, int size)
+{
+    struct mixer_source *src = (struct mixer_source *)handle;
+    // Wait for free space, mixer thread consumes data at output rate
+    int ret = spsc_ring_write(src->rb, buffer, size, 0);
+    if (ret > 0)
+        __atomic_add_fetch(&src->filled, ret, __ATOMIC_RELAXED);
+    return ret;
+}
+
+void mixer_wrapper_close(sink_handle_t handle)
+{
+    OS_LOGD(TAG, "Closing mixer source");
+    struct mixer_source *src = (struct mixer_source *)handle;
+    struct mixer *mixer = src->mixer;
+
+    // Mixer thread acknowledges within a period, then never touches the source
+    __atomic_store_n(&src->state, SOURCE_CLOSING, __ATOMIC_RELEASE);
+    int waited_ms = 0;
+    while (__atomic_load_n(&src->state, __ATOMIC_ACQUIRE) != SOURCE_CLOSED) {
+        if (waited_ms >= CLOSE_TIMEOUT_MS) {
+            // Mixer thread is stuck in output write, let it release the slot later
+            int expected = SOURCE_CLOSING;
+            if (__atomic_compare_exchange_n(&src->state, &expected, SOURCE_ORPHANED,
+                                            false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                OS_LOGW(TAG, "Mixer thread didn't release source in %dms", CLOSE_TIMEOUT_MS);
+                return;
+            }
+            break;
+        }
+        OS_THREAD_SLEEP_MSEC(1);
+        waited_ms++;
+    }
+    source_release(mixer, src);
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _MIXER_WRAPPER_H_
+#define _MIXER_WRAPPER_H_
+
+#include "liteplayer_adapter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MIXER_MAX_SOURCES 8
+#define MIXER_GAIN_MAX    4.0f
+
+typedef struct mixer *mixer_handle_t;
+
+struct mixer_attr {
+    int samplerate;       // output samplerate
+    int channels;         // output channels, 1 or 2
+    int period_ms;        // mixing period, 0 to use default (10ms)
+    int source_buffer_ms; // buffer length of each source, 0 to use default (100ms)
+};
+
+/**
+ * Software mixer that merges all players registered against it onto one
+ * shared output sink. Each source is resampled to the output format and mixed
+ * with its own gain on the mixer thread, sources can be opened and closed at
+ * any time without stopping the mix.
+ *
+ * Usage:
+ *   mixer_handle_t mixer = mixer_create(&attr, &output_ops);
+ *   struct sink_wrapper sink_ops = {
+ *       .sink_priv = mixer,
+ *       .open = mixer_wrapper_open,
+ *       .write = mixer_wrapper_write,
+ *       .close = mixer_wrapper_close,
+ *   };
+ *   liteplayer_register_sink_wrapper(player1, &sink_ops);
+ *   liteplayer_register_sink_wrapper(player2, &sink_ops);
+ */
+mixer_handle_t mixer_create(struct mixer_attr *attr, struct sink_wrapper *output);
+
+// Refused and logged if any source is still open
+void mixer_destroy(mixer_handle_t mixer);
+
+/**
+ * Set gain of the source, ranges from 0.0 to 4.0, default is 1.0
+ */
+int mixer_set_gain(sink_handle_t source, float gain);
+
+/**
+ * Get bytes of the source waiting to be mixed. Only reads counters of the
+ * source slot, so it may race with close from another thread as long as the
+ * mixer exists, a closed source reports 0
+ */
+int mixer_wrapper_get_filled(sink_handle_t handle);
+
+/**
+ * Get milliseconds of the source queued in mixer, latency of the output sink
+ * isn't included. Like mixer_wrapper_get_filled, safe against a concurrent close
+ */
+int mixer_wrapper_get_latency(sink_handle_t handle);
+
+sink_handle_t mixer_wrapper_open(int samplerate, int channels, void *sink_priv);
+
+int mixer_wrapper_write(sink_handle_t handle, char *buffer, int size);
+
+// Audio still queued in the source is dropped, waits a mixer period at most
+void mixer_wrapper_close(sink_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _MIXER_WRAPPER_H_ */
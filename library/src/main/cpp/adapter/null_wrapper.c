@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define OS_MEMORY_TAG OS_MEMTAG_SINK
+
+#include <string.h>
+
+#include "msgutils/cutils/os_thread.h"
+#include "msgutils/cutils/os_time.h"
+#include "cutils/os_alloc.h"
+#include "cutils/log_gate.h"
+#include "liteplayer_stats.h"
+#include "adapter/null_wrapper.h"
+
+#define TAG "null_wrapper"
+
+#define DEFAULT_BUFFER_MS 40
+
+#define LOAD(x)      __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define STORE(x, v)  __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#define ADD(x, v)    __atomic_add_fetch(&(x), (v), __ATOMIC_RELAXED)
+
+struct null_sink {
+    struct null_sink_attr attr;
+    int byterate;
+    unsigned long long clock_start_us;  // device clock, shifted by underruns, accessed atomically
+    unsigned long long written_bytes;   // since open, accessed atomically
+    unsigned long long next_stall_bytes;
+    unsigned long long last_write_us;
+
+    unsigned int reset_epoch;           // bumped by null_sink_reset_stats
+    unsigned int applied_epoch;         // reset_epoch the stats were last cleared at
+
+    // Written by the player thread, read atomically by null_sink_get_stats
+    unsigned long long writes;
+    unsigned long long bytes;
+    unsigned int stalls;
+    unsigned int underruns;
+    unsigned long long write_size_max;
+    unsigned long long interval_us_max;
+    struct stats_histogram write_size;
+    struct stats_histogram interval_us;
+};
+
+null_sink_t null_sink_create(struct null_sink_attr *attr)
+{
+    struct null_sink *sink = OS_CALLOC(1, sizeof(struct null_sink));
+    if (sink == NULL)
+        return NULL;
+    if (attr != NULL)
+        sink->attr = *attr;
+    if (sink->attr.buffer_ms <= 0)
+        sink->attr.buffer_ms = DEFAULT_BUFFER_MS;
+    if (sink->attr.stall_ms <= 0)
+        sink->attr.stall_every_ms = 0;
+    return sink;
+}
+
+void null_sink_destroy(null_sink_t sink)
+{
+    OS_FREE(sink);
+}
+
+void null_sink_get_stats(null_sink_t sink, struct null_sink_stats *stats)
+{
+    if (__atomic_load_n(&sink->applied_epoch, __ATOMIC_ACQUIRE) != LOAD(sink->reset_epoch)) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    stats->writes = LOAD(sink->writes);
+    stats->bytes = LOAD(sink->bytes);
+    stats->stalls = LOAD(sink->stalls);
+    stats->underruns = LOAD(sink->underruns);
+    stats->write_size_p50 = stats_histogram_percentile(&sink->write_size, 50);
+    stats->write_size_max = (int)LOAD(sink->write_size_max);
+    stats->interval_us_p50 = stats_histogram_percentile(&sink->interval_us, 50);
+    stats->interval_us_p99 = stats_histogram_percentile(&sink->interval_us, 99);
+    stats->interval_us_max = (int)LOAD(sink->interval_us_max);
+}
+
+void null_sink_reset_stats(null_sink_t sink)
+{
+    __atomic_add_fetch(&sink->reset_epoch, 1, __ATOMIC_RELEASE);
+}
+
+// Called by the writer, which owns the stats
+static void null_sink_apply_reset(struct null_sink *sink)
+{
+    unsigned int epoch = __atomic_load_n(&sink->reset_epoch, __ATOMIC_ACQUIRE);
+    if (epoch == LOAD(sink->applied_epoch))
+        return;
+    int i;
+    STORE(sink->writes, 0ULL);
+    STORE(sink->bytes, 0ULL);
+    STORE(sink->stalls, 0U);
+    STORE(sink->underruns, 0U);
+    STORE(sink->write_size_max, 0ULL);
+    STORE(sink->interval_us_max, 0ULL);
+    for (i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+        STORE(sink->write_size.counts[i], 0U);
+        STORE(sink->interval_us.counts[i], 0U);
+    }
+    __atomic_store_n(&sink->applied_epoch, epoch, __ATOMIC_RELEASE);
+}
+
+static unsigned long long bytes_to_us(struct null_sink *sink, unsigned long long bytes)
+{
+    return bytes * 1000000 / sink->byterate;
+}
+
+sink_handle_t null_wrapper_open(int samplerate, int channels, void *sink_priv)
+{
+    struct null_sink *sink = (struct null_sink *)sink_priv;
+    OS_LOGD(TAG, "Opening null sink: samplerate=%d, channels=%d", samplerate, channels);
+    if (sink == NULL || samplerate <= 0 || channels <= 0)
+        return NULL;
+    sink->byterate = samplerate * channels * sizeof(short);
+    STORE(sink->clock_start_us, OS_MONOTONIC_USEC());
+    STORE(sink->written_bytes, 0ULL);
+    sink->next_stall_bytes = (unsigned long long)sink->attr.stall_every_ms * sink->byterate / 1000;
+    sink->last_write_us = 0;
+    return sink;
+}
+
+int null_wrapper_write(sink_handle_t handle, char *buffer, int size)
+{
+    struct null_sink *sink = (struct null_sink *)handle;
+    unsigned long long now = OS_MONOTONIC_USEC();
+
+    null_sink_apply_reset(sink);
+    if (sink->last_write_us != 0) {
+        unsigned long long interval = now - sink->last_write_us;
+        stats_histogram_add(&sink->interval_us, interval);
+        if (interval > LOAD(sink->interval_us_max))
+            STORE(sink->interval_us_max, interval);
+    }
+    stats_histogram_add(&sink->write_size, (unsigned long long)size);
+    if ((unsigned long long)size > LOAD(sink->write_size_max))
+        STORE(sink->write_size_max, (unsigned long long)size);
+    ADD(sink->writes, 1ULL);
+    ADD(sink->bytes, (unsigned long long)size);
+    unsigned long long written_bytes = sink->written_bytes + size;
+    STORE(sink->written_bytes, written_bytes);
+
+    if (sink->next_stall_bytes != 0 && written_bytes >= sink->next_stall_bytes) {
+        // Write is stuck like a blocked HAL while the device keeps playing,
+        // a stall longer than the queued data shows up as underrun below
+        OS_THREAD_SLEEP_MSEC(sink->attr.stall_ms);
+        sink->next_stall_bytes += (unsigned long long)sink->attr.stall_every_ms * sink->byterate / 1000;
+        ADD(sink->stalls, 1U);
+    }
+
+    if (sink->attr.paced) {
+        // Block until the written data fits into the simulated device buffer
+        unsigned long long played_us = OS_MONOTONIC_USEC() - sink->clock_start_us;
+        unsigned long long queued_us = bytes_to_us(sink, written_bytes);
+        unsigned long long buffer_us = (unsigned long long)sink->attr.buffer_ms * 1000;
+        if (queued_us > played_us + buffer_us) {
+            OS_THREAD_SLEEP_USEC((unsigned long)(queued_us - played_us - buffer_us));
+        } else if (queued_us < played_us) {
+            // Underrun, the device clock restarts from the new data
+            STORE(sink->clock_start_us, sink->clock_start_us + played_us - queued_us);
+            ADD(sink->underruns, 1U);
+        }
+    }
+
+    sink->last_write_us = OS_MONOTONIC_USEC();
+    return size;
+}
+
+int null_wrapper_get_latency(sink_handle_t handle)
+{
+    struct null_sink *sink = (struct null_sink *)handle;
+    if (sink == NULL || !sink->attr.paced || sink->byterate == 0)
+        return 0;
+    unsigned long long played_us = OS_MONOTONIC_USEC() - LOAD(sink->clock_start_us);
+    unsigned long long queued_us = bytes_to_us(sink, LOAD(sink->written_bytes));
+    return queued_us > played_us ? (int)((queued_us - played_us) / 1000) : 0;
+}
+
+void null_wrapper_close(sink_handle_t handle)
+{
+    struct null_sink *sink = (struct null_sink *)handle;
+    OS_LOGD(TAG, "Closing null sink: writes=%llu, bytes=%llu, stalls=%u, underruns=%u",
+            LOAD(sink->writes), LOAD(sink->bytes), LOAD(sink->stalls), LOAD(sink->underruns));
+}
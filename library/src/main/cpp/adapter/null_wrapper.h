@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _NULL_WRAPPER_H_
+#define _NULL_WRAPPER_H_
+
+#include <stdbool.h>
+#include "liteplayer_adapter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct null_sink *null_sink_t;
+
+struct null_sink_attr {
+    bool paced;         // block writes at the rate of a simulated device clock
+    int buffer_ms;      // simulated device buffer when paced, 0 to use default (40ms)
+    int stall_every_ms; // inject a write stall after every period of audio, 0 to disable
+    int stall_ms;       // length of each injected stall
+};
+
+struct null_sink_stats {
+    unsigned long long writes;
+    unsigned long long bytes;
+    unsigned int stalls;
+    unsigned int underruns; // paced only, the device buffer ran empty before a write
+    int write_size_p50;
+    int write_size_max;
+    int interval_us_p50;    // from previous write returned to next write called
+    int interval_us_p99;
+    int interval_us_max;
+};
+
+/**
+ * Sink that discards pcm without any device, for measuring decoder and
+ * pipeline cost on hosts without audio hardware. Optionally paces writes
+ * like a device and injects stalls to provoke underruns, write sizes and
+ * inter-arrival times are recorded into histograms.
+ *
+ * Usage:
+ *   null_sink_t null_sink = null_sink_create(&attr);
+ *   struct sink_wrapper sink_ops = {
+ *       .sink_priv = null_sink,
+ *       .open = null_wrapper_open,
+ *       .write = null_wrapper_write,
+ *       .close = null_wrapper_close,
+ *   };
+ *   liteplayer_register_sink_wrapper(player, &sink_ops);
+ */
+null_sink_t null_sink_create(struct null_sink_attr *attr);
+
+void null_sink_destroy(null_sink_t sink);
+
+void null_sink_get_stats(null_sink_t sink, struct null_sink_stats *stats);
+
+// May be called from any thread, stats read as zero until the next write clears them
+void null_sink_reset_stats(null_sink_t sink);
+
+/**
+ * Get milliseconds of pcm queued in the simulated device, 0 if not paced
+ */
+int null_wrapper_get_latency(sink_handle_t handle);
+
+sink_handle_t null_wrapper_open(int samplerate, int channels, void *sink_priv);
+
+int null_wrapper_write(sink_handle_t handle, char *buffer, int size);
+
+void null_wrapper_close(sink_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _NULL_WRAPPER_H_ */
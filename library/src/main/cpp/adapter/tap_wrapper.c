@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define OS_MEMORY_TAG OS_MEMTAG_SINK
+
+#include "cutils/os_alloc.h"
+#include "cutils/log_gate.h"
+#include "adapter/tap_wrapper.h"
+
+#define TAG "tap_wrapper"
+
+struct tap {
+    struct sink_wrapper downstream;
+    sink_handle_t downstream_handle; // read by stats queries, accessed atomically
+    bcast_ring_t rb;
+    // Written on open, read atomically by tap_get_format
+    int samplerate;
+    int channels;
+    int generation;
+};
+
+tap_t tap_create(struct sink_wrapper *downstream, int buffer_bytes)
+{
+    if (downstream == NULL || downstream->open == NULL ||
+        downstream->write == NULL || downstream->close == NULL) {
+        OS_LOGE(TAG, "Invalid downstream sink");
+        return NULL;
+    }
+    struct tap *tap = OS_CALLOC(1, sizeof(struct tap));
+    if (tap == NULL)
+        return NULL;
+    tap->downstream = *downstream;
+    tap->rb = bcast_ring_create(buffer_bytes);
+    if (tap->rb == NULL) {
+        OS_FREE(tap);
+        return NULL;
+    }
+    return tap;
+}
+
+void tap_destroy(tap_t tap)
+{
+    if (tap == NULL)
+        return;
+    bcast_ring_destroy(tap->rb);
+    OS_FREE(tap);
+}
+
+bcast_reader_t tap_add_reader(tap_t tap, bool lossy)
+{
+    return bcast_ring_add_reader(tap->rb, lossy);
+}
+
+void tap_remove_reader(tap_t tap, bcast_reader_t reader)
+{
+    bcast_ring_remove_reader(tap->rb, reader);
+}
+
+int tap_get_format(tap_t tap, int *samplerate, int *channels)
+{
+    int generation = __atomic_load_n(&tap->generation, __ATOMIC_ACQUIRE);
+    if (samplerate != NULL)
+        *samplerate = __atomic_load_n(&tap->samplerate, __ATOMIC_RELAXED);
+    if (channels != NULL)
+        *channels = __atomic_load_n(&tap->channels, __ATOMIC_RELAXED);
+    return generation;
+}
+
+sink_handle_t tap_wrapper_get_downstream(sink_handle_t handle)
+{
+    struct tap *tap = (struct tap *)handle;
+    return tap != NULL ? __atomic_load_n(&tap->downstream_handle, __ATOMIC_ACQUIRE) : NULL;
+}
+
+sink_handle_t tap_wrapper_open(int samplerate, int channels, void *sink_priv)
+{
+    struct tap *tap = (struct tap *)sink_priv;
+    if (tap == NULL)
+        return NULL;
+    sink_handle_t downstream_handle = tap->downstream.open(samplerate, channels, tap->downstream.sink_priv);
+    if (downstream_handle == NULL)
+        return NULL;
+    __atomic_store_n(&tap->downstream_handle, downstream_handle, __ATOMIC_RELEASE);
+    __atomic_store_n(&tap->samplerate, samplerate, __ATOMIC_RELAXED);
+    __atomic_store_n(&tap->channels, channels, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&tap->generation, 1, __ATOMIC_RELEASE);
+    return (sink_handle_t)tap;
+}
+
+int tap_wrapper_write(sink_handle_t handle, char *buffer, int size)
+{
+    struct tap *tap = (struct tap *)handle;
+    int ret = tap->downstream.write(tap->downstream_handle, buffer, size);
+    // Publish what the sink accepted, returns at once if no reader attached.
+    // Never wait for readers forever, a visualizer must not stop playback
+    if (ret > 0) {
+        int published = bcast_ring_write(tap->rb, buffer, ret, TAP_WRITE_TIMEOUT_MS);
+        if (published != ret && published != RB_ABORT)
+            OS_LOGW(TAG, "Blocking tap reader stalled, dropped %d bytes", published > 0 ? ret - published : ret);
+    }
+    return ret;
+}
+
+void tap_wrapper_close(sink_handle_t handle)
+{
+    struct tap *tap = (struct tap *)handle;
+    // Unpublish before closing, see tap_wrapper_get_downstream
+    sink_handle_t downstream_handle = tap->downstream_handle;
+    __atomic_store_n(&tap->downstream_handle, NULL, __ATOMIC_RELEASE);
+    tap->downstream.close(downstream_handle);
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _TAP_WRAPPER_H_
+#define _TAP_WRAPPER_H_
+
+#include <stdbool.h>
+#include "liteplayer_adapter.h"
+#include "cutils/bcast_ring.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TAP_WRITE_TIMEOUT_MS 20
+
+typedef struct tap *tap_t;
+
+/**
+ * Sink that forwards pcm to a downstream sink and publishes what was written
+ * to a broadcast ring, so that meters and visualizers can read the decoded
+ * pcm alongside the audio path. Blocking readers see every byte and slow the
+ * player down like the sink does, but a write waits for them at most
+ * TAP_WRITE_TIMEOUT_MS, a reader stalled longer misses the rest of that
+ * write. Lossy readers skip what they miss.
+ *
+ * Usage:
+ *   tap_t tap = tap_create(&opensles_ops, 64*1024);
+ *   bcast_reader_t visualizer = tap_add_reader(tap, true);
+ *   struct sink_wrapper sink_ops = {
+ *       .sink_priv = tap,
+ *       .open = tap_wrapper_open,
+ *       .write = tap_wrapper_write,
+ *       .close = tap_wrapper_close,
+ *   };
+ *   liteplayer_register_sink_wrapper(player, &sink_ops);
+ *   ...
+ *   int filled = bcast_ring_bytes_filled(visualizer);
+ *   bcast_ring_read(visualizer, buffer, filled, 0);
+ */
+tap_t tap_create(struct sink_wrapper *downstream, int buffer_bytes);
+
+void tap_destroy(tap_t tap);
+
+bcast_reader_t tap_add_reader(tap_t tap, bool lossy);
+
+void tap_remove_reader(tap_t tap, bcast_reader_t reader);
+
+/**
+ * Format of the pcm published, 16-bit interleaved. Returns a generation
+ * that changes each time the sink is opened, 0 if never opened.
+ */
+int tap_get_format(tap_t tap, int *samplerate, int *channels);
+
+// Handle of the downstream sink, for backend specific queries
+sink_handle_t tap_wrapper_get_downstream(sink_handle_t handle);
+
+sink_handle_t tap_wrapper_open(int samplerate, int channels, void *sink_priv);
+
+int tap_wrapper_write(sink_handle_t handle, char *buffer, int size);
+
+void tap_wrapper_close(sink_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TAP_WRAPPER_H_ */
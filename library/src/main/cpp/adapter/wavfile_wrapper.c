@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define OS_MEMORY_TAG OS_MEMTAG_SINK
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cutils/os_alloc.h"
+#include "cutils/log_gate.h"
+#include "adapter/wavfile_wrapper.h"
+
+#define TAG "wavfile_wrapper"
+
+#define WAV_HEADER_SIZE 44
+
+struct wavfile_priv {
+    FILE *file;
+    int samplerate;
+    int channels;
+    unsigned int data_size;
+};
+
+static void wav_put_le16(unsigned char *p, unsigned int v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+}
+
+static void wav_put_le32(unsigned char *p, unsigned int v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+static int wav_write_header(struct wavfile_priv *priv)
+{
+    unsigned char header[WAV_HEADER_SIZE];
+    int block_align = priv->channels * 2;
+    memcpy(header, "RIFF", 4);
+    wav_put_le32(header + 4, 36 + priv->data_size);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    wav_put_le32(header + 16, 16);
+    wav_put_le16(header + 20, 1); // PCM
+    wav_put_le16(header + 22, priv->channels);
+    wav_put_le32(header + 24, priv->samplerate);
+    wav_put_le32(header + 28, priv->samplerate * block_align);
+    wav_put_le16(header + 32, block_align);
+    wav_put_le16(header + 34, 16);
+    memcpy(header + 36, "data", 4);
+    wav_put_le32(header + 40, priv->data_size);
+    if (fseek(priv->file, 0, SEEK_SET) != 0)
+        return -1;
+    return fwrite(header, 1, sizeof(header), priv->file) == sizeof(header) ? 0 : -1;
+}
+
+sink_handle_t wavfile_wrapper_open(int samplerate, int channels, void *sink_priv)
+{
+    const char *path = (const char *)sink_priv;
+    OS_LOGD(TAG, "Opening wavfile: path=%s, samplerate=%d, channels=%d", path, samplerate, channels);
+    if (path == NULL)
+        return NULL;
+    struct wavfile_priv *priv = OS_CALLOC(1, sizeof(struct wavfile_priv));
+    if (priv == NULL)
+        return NULL;
+    priv->samplerate = samplerate;
+    priv->channels = channels;
+    priv->file = fopen(path, "wb");
+    if (priv->file == NULL) {
+        OS_LOGE(TAG, "Failed to open wavfile: %s", path);
+        OS_FREE(priv);
+        return NULL;
+    }
+    // Reserve header, sizes are filled in when closing
+    if (wav_write_header(priv) != 0) {
+        fclose(priv->file);
+        OS_FREE(priv);
+        return NULL;
+    }
+    return priv;
+}
+
+int wavfile_wrapper_write(sink_handle_t handle, char *buffer, int size)
+{
+    struct wavfile_priv *priv = (struct wavfile_priv *)handle;
+    if (fwrite(buffer, 1, size, priv->file) != (size_t)size) {
+        OS_LOGE(TAG, "Failed to write wavfile");
+        return -1;
+    }
+    priv->data_size += size;
+    return size;
+}
+
+void wavfile_wrapper_close(sink_handle_t handle)
+{
+    struct wavfile_priv *priv = (struct wavfile_priv *)handle;
+    OS_LOGD(TAG, "Closing wavfile: data_size=%u", priv->data_size);
+    if (wav_write_header(priv) != 0)
+        OS_LOGE(TAG, "Failed to update wavfile header");
+    fclose(priv->file);
+    OS_FREE(priv);
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _WAVFILE_WRAPPER_H_
+#define _WAVFILE_WRAPPER_H_
+
+#include "liteplayer_adapter.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Sink that writes 16bit pcm into a wav file, sink_priv is the file path and
+ * must stay valid until the sink is closed. Writes never block on a device
+ * clock, so it suits offline decoding with liteplayer_decode_to().
+ * The wave_wrapper.h header is shipped with the prebuilt adapter library but
+ * its symbols aren't exported, so the wav header is written here instead.
+ */
+sink_handle_t wavfile_wrapper_open(int samplerate, int channels, void *sink_priv);
+
+int wavfile_wrapper_write(sink_handle_t handle, char *buffer, int size);
+
+void wavfile_wrapper_close(sink_handle_t handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WAVFILE_WRAPPER_H_ */
@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Decode throughput benchmark, build with -DLITEPLAYER_BUILD_BENCHMARK=ON and
+ * run on device, the prebuilt core libraries are Android only:
+ *   adb push liteplayer-bench libliteplayer_core.so libliteplayer_adapter.so libmsgutils.so /data/local/tmp
+ *   adb push example/src/main/assets/test.mp3 example/src/main/assets/test.m4a /data/local/tmp
+ *   adb shell "cd /data/local/tmp && LD_LIBRARY_PATH=. ./liteplayer-bench -o report.json test.mp3 test.m4a"
+ *
+ * Each file is decoded offline into an unpaced null sink, a long wav fixture is
+ * generated and decoded as well. The report is json, one result per file.
+ * With -l only the cost of disabled log calls is measured, with -r only the
+ * throughput and wake-up latency of ringbuf against spsc_ring, copying,
+ * zero-copy and mirrored, with -q the same of msgqueue against mpmc_queue
+ * with 1 to 8 producers, on one queue and on a queue set, with -t the cost of
+ * delayed messages in msglooper against looper with 10k of them pending and
+ * the wait of control messages behind bulk work, with -x the scalability of
+ * ThreadPool from 1 to N cores, with -m libc malloc against os_slab and
+ * os_arena on message churn, player create/destroy and the footprint left
+ * after 10k player cycles, with -u the underruns of realtime playback into a
+ * paced null sink next to busy-loop threads, for each scheduling setting of
+ * the decoder thread. -z is a check rather than a benchmark: it exits 1 if
+ * steady playback into the null sink allocates at all, or if a cycle of
+ * setDataSource, prepare and reset allocates more than the given limit.
+ *
+ * Each benchmark lives in liteplayer_bench_<name>, this file parses options
+ * and generates the wav fixtures.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "adapter/wavfile_wrapper.h"
+#include "liteplayer_bench.h"
+
+#define DEFAULT_RUNS          3
+#define DEFAULT_FIXTURE_SEC   600
+
+#define TAG "liteplayer_bench"
+
+unsigned long long bench_monotonic_nsec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int bench_generate_fixture(const char *path, int seconds)
+{
+    const int samplerate = 44100, channels = 2;
+    short buffer[1024 * 2];
+    sink_handle_t handle = wavfile_wrapper_open(samplerate, channels, (void *)path);
+    if (handle == NULL)
+        return -1;
+    long long total = (long long)samplerate * seconds, frame = 0;
+    while (frame < total) {
+        int i, frames = total - frame > 1024 ? 1024 : (int)(total - frame);
+        for (i = 0; i < frames; i++, frame++) {
+            short sample = (short)(8000 * sin(2 * M_PI * 440 * frame / samplerate));
+            buffer[2 * i] = sample;
+            buffer[2 * i + 1] = sample;
+        }
+        if (wavfile_wrapper_write(handle, (char *)buffer, frames * channels * sizeof(short)) < 0) {
+            wavfile_wrapper_close(handle);
+            return -1;
+        }
+    }
+    wavfile_wrapper_close(handle);
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-n runs] [-g fixture_sec] [-o report.json] [-l] [-r] [-q] [-t] [-x] [-m] [-u busy] [-z max] file...\n", prog);
+    fprintf(stderr, "  -n  decode runs per file, default %d\n", DEFAULT_RUNS);
+    fprintf(stderr, "  -g  length of generated wav fixture, 0 to disable, default %d\n", DEFAULT_FIXTURE_SEC);
+    fprintf(stderr, "  -o  write json report to file instead of stdout\n");
+    fprintf(stderr, "  -l  measure cost per disabled log call instead of decoding\n");
+    fprintf(stderr, "  -r  compare ringbuf and spsc_ring instead of decoding\n");
+    fprintf(stderr, "  -q  compare msgqueue and mpmc_queue instead of decoding\n");
+    fprintf(stderr, "  -t  compare delayed messages of msglooper and looper instead of decoding\n");
+    fprintf(stderr, "  -x  measure scalability of ThreadPool from 1 to N cores instead of decoding\n");
+    fprintf(stderr, "  -m  compare libc malloc, os_slab and os_arena instead of decoding\n");
+    fprintf(stderr, "  -u  count underruns of realtime playback next to busy threads, 0 for one per core\n");
+    fprintf(stderr, "  -z  fail unless steady playback doesn't allocate and a reset cycle allocates less than max\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int runs = DEFAULT_RUNS, fixture_sec = DEFAULT_FIXTURE_SEC;
+    const char *report_path = NULL;
+    const char *fixture_path = "liteplayer_bench_fixture.wav";
+    bool log_only = false, ring_only = false, queue_only = false, looper_only = false, pool_only = false, alloc_only = false;
+    int underrun_busy = -1, zalloc_max = -1;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:g:o:lrqtxmu:z:h")) != -1) {
+        switch (opt) {
+        case 'n': runs = atoi(optarg); break;
+        case 'g': fixture_sec = atoi(optarg); break;
+        case 'o': report_path = optarg; break;
+        case 'l': log_only = true; break;
+        case 'r': ring_only = true; break;
+        case 'q': queue_only = true; break;
+        case 't': looper_only = true; break;
+        case 'x': pool_only = true; break;
+        case 'm': alloc_only = true; break;
+        case 'u': underrun_busy = atoi(optarg); break;
+        case 'z': zalloc_max = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (log_only) {
+        bench_log(stdout);
+        return 0;
+    }
+    if (ring_only) {
+        bench_ring(stdout);
+        return 0;
+    }
+    if (queue_only) {
+        bench_queue(stdout);
+        return 0;
+    }
+    if (looper_only) {
+        bench_looper(stdout);
+        return 0;
+    }
+    if (pool_only) {
+        bench_pool(stdout);
+        return 0;
+    }
+    if (alloc_only) {
+        bench_alloc(stdout);
+        return 0;
+    }
+    if (underrun_busy >= 0)
+        return bench_underrun(stdout, underrun_busy) == 0 ? 0 : 1;
+    if (zalloc_max >= 0)
+        return bench_zalloc(stdout, zalloc_max) == 0 ? 0 : 1;
+    if (runs < 1 || runs > BENCH_MAX_RUNS || fixture_sec < 0 || (optind >= argc && fixture_sec == 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (fixture_sec > 0 && bench_generate_fixture(fixture_path, fixture_sec) != 0) {
+        fprintf(stderr, "Failed to generate fixture: %s\n", fixture_path);
+        return 1;
+    }
+
+    FILE *report = report_path != NULL ? fopen(report_path, "w") : stdout;
+    if (report == NULL) {
+        fprintf(stderr, "Failed to open report: %s\n", report_path);
+        return 1;
+    }
+
+    const char *urls[argc - optind + 1];
+    int i, count = 0;
+    for (i = optind; i < argc; i++)
+        urls[count++] = argv[i];
+    if (fixture_sec > 0)
+        urls[count++] = fixture_path;
+    int failed = bench_decode(report, urls, count, runs);
+
+    if (report != stdout)
+        fclose(report);
+    if (fixture_sec > 0)
+        unlink(fixture_path);
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LITEPLAYER_BENCH_H_
+#define _LITEPLAYER_BENCH_H_
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BENCH_MAX_RUNS 32
+
+// liteplayer_bench.c
+unsigned long long bench_monotonic_nsec();
+int bench_generate_fixture(const char *path, int seconds);
+
+// liteplayer_bench_alloc.c, allocations of the whole process since start
+unsigned long long bench_alloc_count();
+
+// One report line per measurement, each bench lives in liteplayer_bench_<name>
+int bench_decode(FILE *report, const char **urls, int count, int runs);
+void bench_log(FILE *report);
+void bench_ring(FILE *report);
+void bench_queue(FILE *report);
+void bench_looper(FILE *report);
+void bench_pool(FILE *report);
+void bench_alloc(FILE *report);
+int bench_underrun(FILE *report, int busy);
+int bench_zalloc(FILE *report, int max_per_cycle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _LITEPLAYER_BENCH_H_ */
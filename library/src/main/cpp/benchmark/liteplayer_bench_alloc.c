@@ -0,0 +1,468 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include "msgutils/cutils/os_thread.h"
+#include "liteplayer/liteplayer_main.h"
+#include "liteplayer/adapter/fatfs_wrapper.h"
+#include "adapter/null_wrapper.h"
+#include "cutils/mpmc_queue.h"
+#include "cutils/os_slab.h"
+#include "cutils/os_arena.h"
+#include "liteplayer_decoder.h"
+#include "liteplayer_bench.h"
+
+#define ALLOC_BENCH_MSGS      (1 << 20)
+#define ALLOC_BENCH_WINDOW    64          // messages pending in a looper
+#define ALLOC_BENCH_QUEUE     256
+#define ALLOC_BENCH_PLAYERS   10000
+#define ALLOC_BENCH_SURVIVORS 1000        // allocations outliving the players, e.g. cache entries
+#define ZALLOC_CHECK_SEC      10
+#define ZALLOC_WARMUP_WRITES  50          // writes until decoder and sink are in steady state
+#define ZALLOC_CYCLES         20
+
+#define TAG "liteplayer_bench"
+
+// Allocation counting, the executable's malloc preempts the one libc exports
+// to the shared libraries, so allocations of the prebuilt core are counted too
+
+static void *(*sRealMalloc)(size_t) = NULL;
+static void *(*sRealCalloc)(size_t, size_t) = NULL;
+static void *(*sRealRealloc)(void *, size_t) = NULL;
+static void (*sRealFree)(void *) = NULL;
+static unsigned long long sAllocCount = 0; // accessed atomically
+static pthread_once_t sHooksOnce = PTHREAD_ONCE_INIT;
+// Set on the thread resolving the hooks, others wait in pthread_once
+static __thread int sHooksLoading = 0;
+// dlsym may allocate before the real allocator is resolved, blocks are
+// preceded by a header with their size so realloc knows what to copy
+#define BOOTSTRAP_HEADER 16
+static char sBootstrap[4096] __attribute__((aligned(16)));
+static size_t sBootstrapUsed = 0; // accessed atomically
+
+static void alloc_hooks_resolve()
+{
+    sHooksLoading = 1;
+    __atomic_store_n(&sRealMalloc, (void *(*)(size_t))dlsym(RTLD_NEXT, "malloc"), __ATOMIC_RELEASE);
+    __atomic_store_n(&sRealCalloc, (void *(*)(size_t, size_t))dlsym(RTLD_NEXT, "calloc"), __ATOMIC_RELEASE);
+    __atomic_store_n(&sRealRealloc, (void *(*)(void *, size_t))dlsym(RTLD_NEXT, "realloc"), __ATOMIC_RELEASE);
+    __atomic_store_n(&sRealFree, (void (*)(void *))dlsym(RTLD_NEXT, "free"), __ATOMIC_RELEASE);
+    sHooksLoading = 0;
+}
+
+// Returns 1 if the caller is resolving the hooks and must use bootstrap memory
+static int alloc_hooks_load()
+{
+    if (sHooksLoading)
+        return 1;
+    pthread_once(&sHooksOnce, alloc_hooks_resolve);
+    return 0;
+}
+
+static void *bootstrap_alloc(size_t size)
+{
+    size_t total = BOOTSTRAP_HEADER + ((size + 15) & ~(size_t)15);
+    if (total < size || total > sizeof(sBootstrap))
+        return NULL;
+    size_t used = __atomic_fetch_add(&sBootstrapUsed, total, __ATOMIC_RELAXED);
+    if (used + total > sizeof(sBootstrap))
+        return NULL;
+    char *block = sBootstrap + used;
+    *(size_t *)block = size;
+    return block + BOOTSTRAP_HEADER;
+}
+
+static int is_bootstrap(void *ptr)
+{
+    return (char *)ptr >= sBootstrap && (char *)ptr < sBootstrap + sizeof(sBootstrap);
+}
+
+static size_t bootstrap_size(void *ptr)
+{
+    return *(size_t *)((char *)ptr - BOOTSTRAP_HEADER);
+}
+
+void *malloc(size_t size)
+{
+    void *(*real)(size_t) = __atomic_load_n(&sRealMalloc, __ATOMIC_ACQUIRE);
+    if (real == NULL) {
+        if (alloc_hooks_load())
+            return bootstrap_alloc(size);
+        real = sRealMalloc;
+    }
+    __atomic_add_fetch(&sAllocCount, 1, __ATOMIC_RELAXED);
+    return real(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    void *(*real)(size_t, size_t) = __atomic_load_n(&sRealCalloc, __ATOMIC_ACQUIRE);
+    if (real == NULL) {
+        if (alloc_hooks_load()) {
+            if (size != 0 && n > (size_t)-1 / size)
+                return NULL;
+            return bootstrap_alloc(n * size); // static storage is zeroed
+        }
+        real = sRealCalloc;
+    }
+    __atomic_add_fetch(&sAllocCount, 1, __ATOMIC_RELAXED);
+    return real(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (is_bootstrap(ptr)) {
+        // Bootstrap blocks are never freed, move the content to the heap
+        size_t old_size = bootstrap_size(ptr);
+        void *copy = malloc(size);
+        if (copy != NULL)
+            memcpy(copy, ptr, old_size < size ? old_size : size);
+        return copy;
+    }
+    void *(*real)(void *, size_t) = __atomic_load_n(&sRealRealloc, __ATOMIC_ACQUIRE);
+    if (real == NULL) {
+        if (alloc_hooks_load())
+            return ptr == NULL ? bootstrap_alloc(size) : NULL;
+        real = sRealRealloc;
+    }
+    __atomic_add_fetch(&sAllocCount, 1, __ATOMIC_RELAXED);
+    return real(ptr, size);
+}
+
+void free(void *ptr)
+{
+    if (ptr == NULL || is_bootstrap(ptr))
+        return;
+    void (*real)(void *) = __atomic_load_n(&sRealFree, __ATOMIC_ACQUIRE);
+    if (real == NULL) {
+        // Heap blocks exist only once the hooks are resolved
+        if (alloc_hooks_load())
+            return;
+        real = sRealFree;
+    }
+    real(ptr);
+}
+
+unsigned long long bench_alloc_count()
+{
+    return __atomic_load_n(&sAllocCount, __ATOMIC_RELAXED);
+}
+
+// ---------------------------------------------------------------------------
+// Allocator cost on message churn, and footprint left by player cycles
+
+struct alloc_ops {
+    const char *name;
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    bool arena; // players allocate from an arena released at once
+};
+
+// Bypass the counting hooks, libc must not pay for an extra atomic
+static void *libc_malloc(size_t size) { return sRealMalloc(size); }
+static void libc_free(void *ptr) { sRealFree(ptr); }
+
+static struct alloc_ops sAllocOps[] = {
+    { "libc",  libc_malloc,    libc_free,    false },
+    { "slab",  os_slab_malloc, os_slab_free, false },
+    { "arena", libc_malloc,    libc_free,    true  },
+};
+
+// Allocations of one player: its context, small bookkeeping and strings,
+// and two stream buffers
+static const size_t sPlayerAllocs[] = {
+    1536, 16, 24, 40, 64, 100, 128, 200, 256, 512, 1024, 2048,
+    16, 24, 40, 64, 100, 128, 200, 256, 512, 1024, 2048, 16384, 65536,
+};
+#define ALLOC_BENCH_PLAYER_ALLOCS ((int)(sizeof(sPlayerAllocs) / sizeof(sPlayerAllocs[0])))
+
+struct alloc_bench {
+    struct alloc_ops *ops;
+    void *queue;
+    size_t sizes[256];
+};
+
+static void alloc_bench_sizes(struct alloc_bench *bench)
+{
+    unsigned int seed = 1, i;
+    for (i = 0; i < 256; i++) {
+        seed = seed * 1103515245U + 12345U;
+        bench->sizes[i] = 48 + ((seed >> 16) % 8) * 16; // message with a small payload
+    }
+}
+
+static void *alloc_bench_producer(void *arg)
+{
+    struct alloc_bench *bench = (struct alloc_bench *)arg;
+    int i;
+    for (i = 0; i < ALLOC_BENCH_MSGS; i++) {
+        char *msg = bench->ops->malloc(bench->sizes[i & 255]);
+        msg[0] = (char)i;
+        mpmc_queue_send(bench->queue, (char *)&msg, MPMC_QUEUE_WAIT_FOREVER);
+    }
+    return NULL;
+}
+
+static void bench_alloc_churn(FILE *report, struct alloc_ops *ops)
+{
+    struct alloc_bench bench;
+    void *window[ALLOC_BENCH_WINDOW];
+    int i;
+    bench.ops = ops;
+    alloc_bench_sizes(&bench);
+
+    // Same thread, like a looper obtaining and freeing its own messages
+    memset(window, 0, sizeof(window));
+    unsigned long long begin = bench_monotonic_nsec();
+    for (i = 0; i < ALLOC_BENCH_MSGS; i++) {
+        char *msg = ops->malloc(bench.sizes[i & 255]);
+        msg[0] = (char)i;
+        if (window[i % ALLOC_BENCH_WINDOW] != NULL)
+            ops->free(window[i % ALLOC_BENCH_WINDOW]);
+        window[i % ALLOC_BENCH_WINDOW] = msg;
+    }
+    unsigned long long local_ns = bench_monotonic_nsec() - begin;
+    for (i = 0; i < ALLOC_BENCH_WINDOW; i++)
+        ops->free(window[i]);
+
+    // Posted to another thread which frees them
+    bench.queue = mpmc_queue_create(sizeof(void *), ALLOC_BENCH_QUEUE);
+    if (bench.queue == NULL)
+        return;
+    struct os_threadattr attr = {
+        .name = "bench_alloc",
+        .priority = OS_THREAD_PRIO_NORMAL,
+        .stacksize = 16*1024,
+        .joinable = true,
+    };
+    begin = bench_monotonic_nsec();
+    os_thread_t producer = OS_THREAD_CREATE(&attr, alloc_bench_producer, &bench);
+    if (producer == NULL) {
+        mpmc_queue_destroy(bench.queue);
+        return;
+    }
+    for (i = 0; i < ALLOC_BENCH_MSGS; i++) {
+        char *msg;
+        mpmc_queue_receive(bench.queue, (char *)&msg, MPMC_QUEUE_WAIT_FOREVER);
+        ops->free(msg);
+    }
+    unsigned long long remote_ns = bench_monotonic_nsec() - begin;
+    OS_THREAD_JOIN(producer, NULL);
+    mpmc_queue_destroy(bench.queue);
+
+    fprintf(report, "{\"benchmark\":\"alloc_churn\",\"allocator\":\"%s\",\"msgs\":%d,"
+            "\"local_ns_per_msg\":%.1f,\"remote_ns_per_msg\":%.1f}\n",
+            ops->name, ALLOC_BENCH_MSGS,
+            (double)local_ns / ALLOC_BENCH_MSGS, (double)remote_ns / ALLOC_BENCH_MSGS);
+}
+
+static long rss_kb()
+{
+    long pages = 0, resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp == NULL)
+        return -1;
+    if (fscanf(fp, "%ld %ld", &pages, &resident) != 2)
+        resident = -1;
+    fclose(fp);
+    return resident < 0 ? -1 : resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// Runs in a child process so that each allocator starts from the same heap
+static void bench_alloc_players(FILE *report, struct alloc_ops *ops)
+{
+    static void *survivors[ALLOC_BENCH_SURVIVORS];
+    static size_t survivor_sizes[ALLOC_BENCH_SURVIVORS];
+    void *blocks[ALLOC_BENCH_PLAYER_ALLOCS];
+    // Survivors are allocated by the general allocator, even for arena players
+    void *(*survivor_malloc)(size_t) = ops->arena ? libc_malloc : ops->malloc;
+    void (*survivor_free)(void *) = ops->arena ? libc_free : ops->free;
+    unsigned int seed = 1;
+    size_t live = 0;
+    int i, j;
+
+    long rss_before = rss_kb();
+    unsigned long long begin = bench_monotonic_nsec();
+    for (i = 0; i < ALLOC_BENCH_PLAYERS; i++) {
+        os_arena_t arena = ops->arena ? os_arena_create("bench", 0) : NULL;
+        for (j = 0; j < ALLOC_BENCH_PLAYER_ALLOCS; j++) {
+            blocks[j] = arena != NULL ? os_arena_alloc(arena, sPlayerAllocs[j]) : ops->malloc(sPlayerAllocs[j]);
+            memset(blocks[j], 0, sPlayerAllocs[j] < 64 ? sPlayerAllocs[j] : 64);
+        }
+
+        // Something the player leaves behind replaces an old one
+        int k = i % ALLOC_BENCH_SURVIVORS;
+        if (survivors[k] != NULL) {
+            survivor_free(survivors[k]);
+            live -= survivor_sizes[k];
+        }
+        seed = seed * 1103515245U + 12345U;
+        survivor_sizes[k] = 16 + (seed >> 16) % 496;
+        survivors[k] = survivor_malloc(survivor_sizes[k]);
+        memset(survivors[k], 0, survivor_sizes[k]);
+        live += survivor_sizes[k];
+
+        if (arena != NULL) {
+            os_arena_destroy(arena);
+        } else {
+            for (j = 0; j < ALLOC_BENCH_PLAYER_ALLOCS; j++)
+                ops->free(blocks[j]);
+        }
+    }
+    unsigned long long cycle_ns = (bench_monotonic_nsec() - begin) / ALLOC_BENCH_PLAYERS;
+    long rss_after = rss_kb();
+
+    struct os_slab_stats slab;
+    os_slab_get_stats(&slab);
+    fprintf(report, "{\"benchmark\":\"alloc_players\",\"allocator\":\"%s\",\"cycles\":%d,"
+            "\"allocs_per_player\":%d,\"ns_per_cycle\":%llu,\"live_kb\":%zu,\"rss_growth_kb\":%ld,"
+            "\"slab_committed_kb\":%zu,\"slab_free_kb\":%zu}\n",
+            ops->name, ALLOC_BENCH_PLAYERS, ALLOC_BENCH_PLAYER_ALLOCS, cycle_ns, live / 1024,
+            rss_after - rss_before, slab.committed / 1024, (slab.free + slab.cached) / 1024);
+}
+
+void bench_alloc(FILE *report)
+{
+    unsigned int i;
+    alloc_hooks_load();
+    for (i = 0; i < sizeof(sAllocOps)/sizeof(sAllocOps[0]); i++) {
+        fflush(report);
+        pid_t pid = fork();
+        if (pid == 0) {
+            if (!sAllocOps[i].arena)
+                bench_alloc_churn(report, &sAllocOps[i]);
+            bench_alloc_players(report, &sAllocOps[i]);
+            fflush(report);
+            _exit(0);
+        }
+        if (pid > 0)
+            waitpid(pid, NULL, 0);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Allocations of steady playback and of player reuse
+
+struct zalloc_check {
+    null_sink_t null_sink;
+    sink_handle_t handle;
+    unsigned long long writes;
+    unsigned long long steady_begin;  // allocation count at the end of warm-up
+    unsigned long long steady_end;    // allocation count at the last write
+};
+
+static sink_handle_t zalloc_check_open(int samplerate, int channels, void *sink_priv)
+{
+    struct zalloc_check *check = (struct zalloc_check *)sink_priv;
+    check->handle = null_wrapper_open(samplerate, channels, check->null_sink);
+    return check->handle != NULL ? (sink_handle_t)check : NULL;
+}
+
+static int zalloc_check_write(sink_handle_t handle, char *buffer, int size)
+{
+    struct zalloc_check *check = (struct zalloc_check *)handle;
+    unsigned long long allocs = bench_alloc_count();
+    if (++check->writes == ZALLOC_WARMUP_WRITES)
+        check->steady_begin = allocs;
+    check->steady_end = allocs;
+    return null_wrapper_write(check->handle, buffer, size);
+}
+
+static void zalloc_check_close(sink_handle_t handle)
+{
+    struct zalloc_check *check = (struct zalloc_check *)handle;
+    null_wrapper_close(check->handle);
+    check->handle = NULL;
+}
+
+int bench_zalloc(FILE *report, int max_per_cycle)
+{
+    const char *fixture_path = "liteplayer_bench_zalloc.wav";
+    alloc_hooks_load();
+    if (bench_generate_fixture(fixture_path, ZALLOC_CHECK_SEC) != 0) {
+        fprintf(stderr, "Failed to generate fixture: %s\n", fixture_path);
+        return -1;
+    }
+    liteplayer_handle_t player = liteplayer_create();
+    if (player == NULL) {
+        unlink(fixture_path);
+        return -1;
+    }
+    struct file_wrapper file_ops = {
+        .file_priv = NULL,
+        .open = fatfs_wrapper_open,
+        .read = fatfs_wrapper_read,
+        .filesize = fatfs_wrapper_filesize,
+        .seek = fatfs_wrapper_seek,
+        .close = fatfs_wrapper_close,
+    };
+    liteplayer_register_file_wrapper(player, &file_ops);
+
+    struct zalloc_check check;
+    memset(&check, 0, sizeof(check));
+    check.null_sink = null_sink_create(NULL);
+    struct sink_wrapper sink_ops = {
+        .sink_priv = &check,
+        .open = zalloc_check_open,
+        .write = zalloc_check_write,
+        .close = zalloc_check_close,
+    };
+    int ret = check.null_sink != NULL ? liteplayer_decode_to(player, fixture_path, &sink_ops) : -1;
+    unsigned long long steady_allocs = check.steady_end - check.steady_begin;
+    bool steady_ok = ret == 0 && check.writes > ZALLOC_WARMUP_WRITES && steady_allocs == 0;
+
+    // What a pooled player goes through for every sound, the first cycle warms up
+    liteplayer_register_sink_wrapper(player, &sink_ops);
+    unsigned long long cycle_allocs = 0;
+    int i, cycles = 0;
+    for (i = 0; i <= ZALLOC_CYCLES && ret == 0; i++) {
+        unsigned long long allocs = bench_alloc_count();
+        if (liteplayer_set_data_source(player, fixture_path, 0) != 0 || liteplayer_prepare(player) != 0)
+            ret = -1;
+        liteplayer_reset(player);
+        if (i > 0 && ret == 0) {
+            cycle_allocs += bench_alloc_count() - allocs;
+            cycles++;
+        }
+    }
+    double per_cycle = cycles > 0 ? (double)cycle_allocs / cycles : 0.0;
+    bool cycle_ok = ret == 0 && cycles == ZALLOC_CYCLES && per_cycle < max_per_cycle;
+
+    fprintf(report, "{\"benchmark\":\"zero_alloc\",\"writes\":%llu,\"steady_writes\":%llu,"
+            "\"steady_allocs\":%llu,\"cycles\":%d,\"allocs_per_cycle\":%.2f,\"max_per_cycle\":%d,"
+            "\"passed\":%s}\n",
+            check.writes, check.writes > ZALLOC_WARMUP_WRITES ? check.writes - ZALLOC_WARMUP_WRITES : 0,
+            steady_allocs, cycles, per_cycle, max_per_cycle, steady_ok && cycle_ok ? "true" : "false");
+    if (!steady_ok)
+        fprintf(stderr, "Steady playback allocated %llu times over %llu writes\n", steady_allocs, check.writes);
+    if (!cycle_ok)
+        fprintf(stderr, "Reset cycle allocated %.2f times, limit %d\n", per_cycle, max_per_cycle);
+
+    if (check.null_sink != NULL)
+        null_sink_destroy(check.null_sink);
+    liteplayer_destroy(player);
+    unlink(fixture_path);
+    return steady_ok && cycle_ok ? 0 : -1;
+}
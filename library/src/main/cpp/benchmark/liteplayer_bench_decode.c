@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "msgutils/cutils/os_time.h"
+#include "liteplayer/liteplayer_main.h"
+#include "liteplayer/adapter/fatfs_wrapper.h"
+#include "adapter/null_wrapper.h"
+#include "liteplayer_decoder.h"
+#include "liteplayer_bench.h"
+
+#define TAG "liteplayer_bench"
+
+// Offline decode of files into an unpaced null sink, median of the runs is reported
+
+struct bench_sink {
+    null_sink_t null_sink;
+    int byterate;
+};
+
+struct bench_result {
+    double audio_sec;
+    double wall_sec;
+    double cpu_user_sec;
+    double cpu_sys_sec;
+    unsigned long long allocs;
+    struct null_sink_stats sink;
+};
+
+static double timeval_sec(struct timeval *tv)
+{
+    return tv->tv_sec + tv->tv_usec / 1000000.0;
+}
+
+static sink_handle_t bench_sink_open(int samplerate, int channels, void *sink_priv)
+{
+    struct bench_sink *sink = (struct bench_sink *)sink_priv;
+    sink->byterate = samplerate * channels * sizeof(short);
+    return null_wrapper_open(samplerate, channels, sink->null_sink);
+}
+
+static int bench_decode_run(liteplayer_handle_t player, const char *url, struct bench_result *result)
+{
+    struct bench_sink sink_priv = {
+        .null_sink = null_sink_create(NULL),
+        .byterate = 0,
+    };
+    if (sink_priv.null_sink == NULL)
+        return -1;
+    struct sink_wrapper sink_ops = {
+        .sink_priv = &sink_priv,
+        .open = bench_sink_open,
+        .write = null_wrapper_write,
+        .close = null_wrapper_close,
+    };
+
+    struct rusage usage_begin, usage_end;
+    getrusage(RUSAGE_SELF, &usage_begin);
+    unsigned long long allocs = bench_alloc_count();
+    unsigned long long begin = OS_MONOTONIC_USEC();
+    int ret = liteplayer_decode_to(player, url, &sink_ops);
+    unsigned long long end = OS_MONOTONIC_USEC();
+    result->allocs = bench_alloc_count() - allocs;
+    getrusage(RUSAGE_SELF, &usage_end);
+    null_sink_get_stats(sink_priv.null_sink, &result->sink);
+    null_sink_destroy(sink_priv.null_sink);
+    if (ret != 0 || result->sink.bytes == 0 || sink_priv.byterate == 0)
+        return -1;
+
+    result->audio_sec = (double)result->sink.bytes / sink_priv.byterate;
+    result->wall_sec = (end - begin) / 1000000.0;
+    result->cpu_user_sec = timeval_sec(&usage_end.ru_utime) - timeval_sec(&usage_begin.ru_utime);
+    result->cpu_sys_sec = timeval_sec(&usage_end.ru_stime) - timeval_sec(&usage_begin.ru_stime);
+    return 0;
+}
+
+static int result_compare(const void *a, const void *b)
+{
+    double wa = ((const struct bench_result *)a)->wall_sec;
+    double wb = ((const struct bench_result *)b)->wall_sec;
+    return wa < wb ? -1 : (wa > wb ? 1 : 0);
+}
+
+int bench_decode(FILE *report, const char **urls, int count, int runs)
+{
+    liteplayer_handle_t player = liteplayer_create();
+    if (player == NULL)
+        return count;
+    struct file_wrapper file_ops = {
+        .file_priv = NULL,
+        .open = fatfs_wrapper_open,
+        .read = fatfs_wrapper_read,
+        .filesize = fatfs_wrapper_filesize,
+        .seek = fatfs_wrapper_seek,
+        .close = fatfs_wrapper_close,
+    };
+    liteplayer_register_file_wrapper(player, &file_ops);
+
+    int i, j, failed = 0;
+    fprintf(report, "{\"benchmark\":\"liteplayer-decode\",\"runs\":%d,\"results\":[", runs);
+    for (i = 0; i < count; i++) {
+        const char *url = urls[i];
+        struct bench_result results[BENCH_MAX_RUNS];
+        for (j = 0; j < runs; j++) {
+            if (bench_decode_run(player, url, &results[j]) != 0)
+                break;
+        }
+        if (j < runs) {
+            fprintf(stderr, "Failed to decode: %s\n", url);
+            failed++;
+            continue;
+        }
+        qsort(results, runs, sizeof(struct bench_result), result_compare);
+        struct bench_result *median = &results[runs / 2];
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        fprintf(report, "%s\n{\"file\":\"%s\",\"audio_sec\":%.3f,\"wall_sec\":%.6f,\"wall_min_sec\":%.6f,"
+                "\"realtime_factor\":%.2f,\"cpu_user_sec\":%.6f,\"cpu_sys_sec\":%.6f,"
+                "\"peak_rss_kb\":%ld,\"allocs\":%llu,\"writes\":%llu,\"write_size_p50\":%d,"
+                "\"write_interval_us_p50\":%d,\"write_interval_us_p99\":%d,\"write_interval_us_max\":%d}",
+                i - failed == 0 ? "" : ",", url, median->audio_sec, median->wall_sec, results[0].wall_sec,
+                median->audio_sec / median->wall_sec, median->cpu_user_sec, median->cpu_sys_sec,
+                usage.ru_maxrss, median->allocs, median->sink.writes, median->sink.write_size_p50,
+                median->sink.interval_us_p50, median->sink.interval_us_p99, median->sink.interval_us_max);
+    }
+    fprintf(report, "\n]}\n");
+    liteplayer_destroy(player);
+    return failed;
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include "msgutils/cutils/os_time.h"
+#include "cutils/log_gate.h"
+#include "liteplayer_bench.h"
+
+#define LOG_BENCH_CALLS       10000000
+
+#define TAG "liteplayer_bench"
+
+// Cost of log calls below the level, gated at runtime and compiled out
+
+void bench_log(FILE *report)
+{
+    int i;
+    // Verbose logs are compiled in but disabled at runtime
+    os_logger_set_level(true, OS_LOG_INFO);
+    unsigned long long begin = OS_MONOTONIC_USEC();
+    for (i = 0; i < LOG_BENCH_CALLS; i++)
+        OS_LOGV(TAG, "Disabled log: i=%d", i);
+    unsigned long long runtime_us = OS_MONOTONIC_USEC() - begin;
+
+    begin = OS_MONOTONIC_USEC();
+    for (i = 0; i < LOG_BENCH_CALLS; i++)
+        OS_LOG_STRIPPED(TAG, "Stripped log: i=%d", i);
+    unsigned long long stripped_us = OS_MONOTONIC_USEC() - begin;
+    os_logger_set_level(true, OS_LOG_VERBOSE);
+
+    fprintf(report, "{\"benchmark\":\"log-gate\",\"calls\":%d,\"runtime_disabled_ns\":%.3f,"
+            "\"compiled_out_ns\":%.3f}\n", LOG_BENCH_CALLS,
+            runtime_us * 1000.0 / LOG_BENCH_CALLS, stripped_us * 1000.0 / LOG_BENCH_CALLS);
+}
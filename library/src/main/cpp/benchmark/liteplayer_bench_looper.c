@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "msgutils/cutils/os_thread.h"
+#include "msgutils/cutils/msglooper.h"
+#include "cutils/looper.h"
+#include "liteplayer_stats.h"
+#include "liteplayer_bench.h"
+
+#define LOOPER_BENCH_PENDING  10000
+#define LOOPER_BENCH_TICKS    1000
+#define LOOPER_BENCH_TICK_MS  2
+#define LOOPER_BENCH_BULK     2000
+#define LOOPER_BENCH_BULK_US  50
+#define LOOPER_BENCH_CONTROLS 20
+
+#define TAG "liteplayer_bench"
+
+// Delayed messages, 10k far-off messages stay pending in msglooper and looper
+// while short delays are posted and fired one at a time. Then control
+// messages are posted behind a backlog of bulk work
+
+#define LOOPER_BENCH_WHAT_PENDING 1
+#define LOOPER_BENCH_WHAT_TICK    2
+#define LOOPER_BENCH_WHAT_BULK    3
+#define LOOPER_BENCH_WHAT_CONTROL 4
+
+struct looper_ops {
+    const char *name;
+    void *(*create)(struct os_threadattr *attr, message_handle_cb handle_cb);
+    void (*destroy)(void *looper);
+    int (*start)(void *looper);
+    struct message *(*obtain)(void *looper, int what);
+    int (*post)(void *looper, struct message *msg, bool control);
+    int (*post_delay)(void *looper, struct message *msg, unsigned long msec);
+    int (*remove)(void *looper, int what);
+};
+
+struct looper_bench {
+    unsigned long long due_ns;
+    int fired;
+    struct stats_histogram late_us;
+    unsigned long long control_posted_ns[LOOPER_BENCH_CONTROLS];
+    int bulk_done;
+    int control_done;
+    struct stats_histogram control_wait_us;
+};
+
+// Not passed as msg->data, a looper may free data of messages without free_cb
+static struct looper_bench sLooperBench;
+
+static void *msglooper_create(struct os_threadattr *attr, message_handle_cb handle_cb) { return mlooper_create(attr, handle_cb, NULL); }
+static void msglooper_destroy(void *looper) { mlooper_destroy(looper); }
+static int msglooper_start(void *looper) { return mlooper_start(looper); }
+static struct message *msglooper_obtain(void *looper, int what) { return message_obtain(what, 0, 0, NULL); }
+static int msglooper_post(void *looper, struct message *msg, bool control) { return mlooper_post_message(looper, msg); }
+static int msglooper_post_delay(void *looper, struct message *msg, unsigned long msec) { return mlooper_post_message_delay(looper, msg, msec); }
+static int msglooper_remove(void *looper, int what) { return mlooper_remove_message(looper, what); }
+
+static void *heap_looper_create(struct os_threadattr *attr, message_handle_cb handle_cb) { return looper_create(attr, handle_cb, NULL); }
+static void heap_looper_destroy(void *looper) { looper_destroy(looper); }
+static int heap_looper_start(void *looper) { return looper_start(looper); }
+static struct message *heap_looper_obtain(void *looper, int what) { return looper_obtain_message(looper, what, 0, 0, NULL); }
+static int heap_looper_post(void *looper, struct message *msg, bool control)
+{
+    looper_message_set_priority(msg, control ? LOOPER_PRIO_CONTROL : LOOPER_PRIO_BULK);
+    return looper_post_message(looper, msg);
+}
+static int heap_looper_post_delay(void *looper, struct message *msg, unsigned long msec) { return looper_post_message_delay(looper, msg, msec); }
+static int heap_looper_remove(void *looper, int what) { return looper_remove_message(looper, what); }
+
+static struct looper_ops sLooperOps[] = {
+    { "msglooper", msglooper_create, msglooper_destroy, msglooper_start, msglooper_obtain,
+      msglooper_post, msglooper_post_delay, msglooper_remove },
+    { "looper", heap_looper_create, heap_looper_destroy, heap_looper_start, heap_looper_obtain,
+      heap_looper_post, heap_looper_post_delay, heap_looper_remove },
+};
+
+static void looper_bench_handle(struct message *msg)
+{
+    struct looper_bench *bench = &sLooperBench;
+    if (msg->what == LOOPER_BENCH_WHAT_BULK) {
+        unsigned long long until = bench_monotonic_nsec() + LOOPER_BENCH_BULK_US * 1000ULL;
+        while (bench_monotonic_nsec() < until);
+        __atomic_add_fetch(&bench->bulk_done, 1, __ATOMIC_RELEASE);
+        return;
+    }
+    if (msg->what == LOOPER_BENCH_WHAT_CONTROL) {
+        unsigned long long wait_ns = bench_monotonic_nsec() - bench->control_posted_ns[msg->arg1];
+        stats_histogram_add(&bench->control_wait_us, wait_ns / 1000);
+        __atomic_add_fetch(&bench->control_done, 1, __ATOMIC_RELEASE);
+        return;
+    }
+    if (msg->what != LOOPER_BENCH_WHAT_TICK)
+        return;
+    long long late_ns = (long long)(bench_monotonic_nsec() - bench->due_ns);
+    stats_histogram_add(&bench->late_us, late_ns > 0 ? late_ns / 1000 : 0);
+    __atomic_store_n(&bench->fired, 1, __ATOMIC_RELEASE);
+}
+
+static void bench_looper_run(FILE *report, struct looper_ops *ops)
+{
+    struct looper_bench *bench = &sLooperBench;
+    memset(bench, 0, sizeof(*bench));
+    struct os_threadattr attr = {
+        .name = "bench_looper",
+        .priority = OS_THREAD_PRIO_NORMAL,
+        .stacksize = 64*1024,
+        .joinable = true,
+    };
+    void *looper = ops->create(&attr, looper_bench_handle);
+    if (looper == NULL || ops->start(looper) != 0) {
+        if (looper != NULL)
+            ops->destroy(looper);
+        return;
+    }
+
+    // Far-off random due times, as many timeouts and retries of a busy player
+    unsigned int seed = 1;
+    int i;
+    unsigned long long begin = bench_monotonic_nsec();
+    for (i = 0; i < LOOPER_BENCH_PENDING; i++) {
+        struct message *msg = ops->obtain(looper, LOOPER_BENCH_WHAT_PENDING);
+        if (msg == NULL || ops->post_delay(looper, msg, 600000 + rand_r(&seed) % 600000) != 0)
+            break;
+    }
+    unsigned long long fill_ns = bench_monotonic_nsec() - begin;
+    int pending = i;
+
+    // A far-off post lands among the pending ones, a near one ahead of them
+    struct stats_histogram far_ns, near_ns;
+    memset(&far_ns, 0, sizeof(far_ns));
+    memset(&near_ns, 0, sizeof(near_ns));
+    for (i = 0; i < LOOPER_BENCH_TICKS; i++) {
+        struct message *msg = ops->obtain(looper, LOOPER_BENCH_WHAT_PENDING);
+        if (msg == NULL)
+            break;
+        unsigned long long post_begin = bench_monotonic_nsec();
+        if (ops->post_delay(looper, msg, 600000 + rand_r(&seed) % 600000) != 0)
+            break;
+        stats_histogram_add(&far_ns, bench_monotonic_nsec() - post_begin);
+    }
+    pending += i;
+
+    // Ticks are recycled one after another, allocation-free with a pool
+    unsigned long long allocs = bench_alloc_count();
+    for (i = 0; i < LOOPER_BENCH_TICKS; i++) {
+        struct message *msg = ops->obtain(looper, LOOPER_BENCH_WHAT_TICK);
+        if (msg == NULL)
+            break;
+        __atomic_store_n(&bench->fired, 0, __ATOMIC_RELAXED);
+        unsigned long long post_begin = bench_monotonic_nsec();
+        bench->due_ns = post_begin + LOOPER_BENCH_TICK_MS * 1000000ULL;
+        if (ops->post_delay(looper, msg, LOOPER_BENCH_TICK_MS) != 0)
+            break;
+        stats_histogram_add(&near_ns, bench_monotonic_nsec() - post_begin);
+        while (!__atomic_load_n(&bench->fired, __ATOMIC_ACQUIRE))
+            OS_THREAD_SLEEP_USEC(100);
+    }
+    int ticks = i;
+    allocs = bench_alloc_count() - allocs;
+
+    begin = bench_monotonic_nsec();
+    ops->remove(looper, LOOPER_BENCH_WHAT_PENDING);
+    unsigned long long remove_ns = bench_monotonic_nsec() - begin;
+    ops->destroy(looper);
+
+    fprintf(report, "{\"benchmark\":\"looper\",\"looper\":\"%s\",\"pending\":%d,\"ticks\":%d,"
+            "\"fill_ns_per_msg\":%llu,\"post_far_ns_p50\":%d,\"post_far_ns_p99\":%d,"
+            "\"post_near_ns_p50\":%d,\"post_near_ns_p99\":%d,"
+            "\"late_us_p50\":%d,\"late_us_p99\":%d,\"allocs_per_tick\":%.3f,\"remove_all_us\":%llu}\n",
+            ops->name, pending, ticks, LOOPER_BENCH_PENDING > 0 ? fill_ns / LOOPER_BENCH_PENDING : 0,
+            stats_histogram_percentile(&far_ns, 50), stats_histogram_percentile(&far_ns, 99),
+            stats_histogram_percentile(&near_ns, 50), stats_histogram_percentile(&near_ns, 99),
+            stats_histogram_percentile(&bench->late_us, 50), stats_histogram_percentile(&bench->late_us, 99),
+            ticks > 0 ? (double)allocs / ticks : 0.0, remove_ns / 1000);
+}
+
+// Controls of a player, e.g. pause or seek, posted while it's busy
+static void bench_looper_control(FILE *report, struct looper_ops *ops)
+{
+    struct looper_bench *bench = &sLooperBench;
+    memset(bench, 0, sizeof(*bench));
+    struct os_threadattr attr = {
+        .name = "bench_looper",
+        .priority = OS_THREAD_PRIO_NORMAL,
+        .stacksize = 64*1024,
+        .joinable = true,
+    };
+    void *looper = ops->create(&attr, looper_bench_handle);
+    if (looper == NULL || ops->start(looper) != 0) {
+        if (looper != NULL)
+            ops->destroy(looper);
+        return;
+    }
+    int bulk, controls, i;
+    for (bulk = 0; bulk < LOOPER_BENCH_BULK; bulk++) {
+        struct message *msg = ops->obtain(looper, LOOPER_BENCH_WHAT_BULK);
+        if (msg == NULL || ops->post(looper, msg, false) != 0)
+            break;
+    }
+    for (controls = 0; controls < LOOPER_BENCH_CONTROLS; controls++) {
+        OS_THREAD_SLEEP_USEC(2000);
+        struct message *msg = ops->obtain(looper, LOOPER_BENCH_WHAT_CONTROL);
+        if (msg == NULL)
+            break;
+        msg->arg1 = controls;
+        bench->control_posted_ns[controls] = bench_monotonic_nsec();
+        if (ops->post(looper, msg, true) != 0)
+            break;
+    }
+    for (i = 0; i < 10000; i++) {
+        if (__atomic_load_n(&bench->bulk_done, __ATOMIC_ACQUIRE) >= bulk &&
+            __atomic_load_n(&bench->control_done, __ATOMIC_ACQUIRE) >= controls)
+            break;
+        OS_THREAD_SLEEP_MSEC(1);
+    }
+    ops->destroy(looper);
+
+    fprintf(report, "{\"benchmark\":\"looper_control\",\"looper\":\"%s\",\"bulk\":%d,\"bulk_us\":%d,"
+            "\"controls\":%d,\"control_wait_us_p50\":%d,\"control_wait_us_p99\":%d}\n",
+            ops->name, bulk, LOOPER_BENCH_BULK_US, controls,
+            stats_histogram_percentile(&bench->control_wait_us, 50),
+            stats_histogram_percentile(&bench->control_wait_us, 99));
+}
+
+void bench_looper(FILE *report)
+{
+    unsigned int i;
+    for (i = 0; i < sizeof(sLooperOps)/sizeof(sLooperOps[0]); i++) {
+        bench_looper_run(report, &sLooperOps[i]);
+        bench_looper_control(report, &sLooperOps[i]);
+    }
+}
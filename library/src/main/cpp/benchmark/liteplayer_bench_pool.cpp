@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Scalability of ThreadPool from 1 to N cores, run by liteplayer-bench -x.
+ * Workers are pinned to the first n cores. Two workloads of the same total
+ * work: "flat" posts every task from the bench thread into the injection
+ * queue, "forkjoin" posts one root task that splits itself recursively, so
+ * that other workers only get work by stealing it.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <atomic>
+#include <future>
+
+#include "msgutils/cutils/os_time.h"
+#include "utils/ThreadPool.h"
+#include "liteplayer_bench.h"
+
+#define POOL_BENCH_TASKS      20000
+#define POOL_BENCH_WORK_ITERS 5000   // a few microseconds of work per task
+#define POOL_BENCH_MAX_CORES  (int)(sizeof(uint64_t) * 8)
+
+struct pool_bench {
+    ThreadPool *pool;
+    std::atomic<int> done;
+    std::atomic<unsigned int> sink;
+    std::promise<void> finished;
+};
+
+static void pool_bench_work(struct pool_bench *bench, unsigned int seed)
+{
+    unsigned int x = seed;
+    for (int i = 0; i < POOL_BENCH_WORK_ITERS; i++)
+        x = x * 1103515245U + 12345U;
+    bench->sink.fetch_add(x, std::memory_order_relaxed);
+    if (bench->done.fetch_add(1, std::memory_order_acq_rel) + 1 == POOL_BENCH_TASKS)
+        bench->finished.set_value();
+}
+
+static void pool_bench_split(struct pool_bench *bench, int lo, int hi)
+{
+    while (hi - lo > 1) {
+        int mid = lo + (hi - lo) / 2;
+        bench->pool->post([bench, mid, hi]() { pool_bench_split(bench, mid, hi); });
+        hi = mid;
+    }
+    pool_bench_work(bench, (unsigned int)lo);
+}
+
+static double pool_bench_run(FILE *report, int threads, bool forkjoin, double base_tasks_per_sec)
+{
+    uint64_t cpumask = threads < POOL_BENCH_MAX_CORES ? (1ULL << threads) - 1 : ~0ULL;
+    struct pool_bench bench;
+    bench.done.store(0);
+    bench.sink.store(0);
+    ThreadPool::Stats stats;
+    unsigned long long start_us, end_us;
+    {
+        ThreadPool pool("bench_pool", threads, OS_THREAD_PRIO_NORMAL, cpumask);
+        if (!pool.isValid()) {
+            fprintf(stderr, "Failed to create pool of %d threads\n", threads);
+            return 0;
+        }
+        bench.pool = &pool;
+        std::future<void> finished = bench.finished.get_future();
+        start_us = OS_MONOTONIC_USEC();
+        if (forkjoin) {
+            pool.post([&bench]() { pool_bench_split(&bench, 0, POOL_BENCH_TASKS); });
+        } else {
+            for (int i = 0; i < POOL_BENCH_TASKS; i++)
+                pool.post([&bench, i]() { pool_bench_work(&bench, (unsigned int)i); });
+        }
+        finished.wait();
+        end_us = OS_MONOTONIC_USEC();
+        pool.getStats(&stats);
+    }
+
+    double wall_sec = (double)(end_us - start_us) / 1000000;
+    double tasks_per_sec = POOL_BENCH_TASKS / wall_sec;
+    fprintf(report, "{\"benchmark\":\"thread_pool\",\"workload\":\"%s\",\"threads\":%d,\"tasks\":%d,"
+            "\"wall_ms\":%.3f,\"tasks_per_sec\":%.0f,\"speedup\":%.2f,\"stolen\":%llu,\"parked\":%llu}\n",
+            forkjoin ? "forkjoin" : "flat", threads, POOL_BENCH_TASKS, wall_sec * 1000, tasks_per_sec,
+            base_tasks_per_sec > 0 ? tasks_per_sec / base_tasks_per_sec : 1.0,
+            stats.stolen, stats.parked);
+    return tasks_per_sec;
+}
+
+void bench_pool(FILE *report)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = cores > 0 ? (int)cores : 1;
+    if (max_threads > POOL_BENCH_MAX_CORES)
+        max_threads = POOL_BENCH_MAX_CORES;
+
+    for (int forkjoin = 0; forkjoin <= 1; forkjoin++) {
+        double base = 0;
+        for (int threads = 1; ; threads *= 2) {
+            if (threads > max_threads)
+                threads = max_threads;
+            double tasks_per_sec = pool_bench_run(report, threads, forkjoin != 0, base);
+            if (threads == 1)
+                base = tasks_per_sec;
+            if (threads == max_threads)
+                break;
+        }
+    }
+}
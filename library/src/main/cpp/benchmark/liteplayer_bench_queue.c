@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "msgutils/cutils/os_time.h"
+#include "msgutils/cutils/os_thread.h"
+#include "msgutils/cutils/msgqueue.h"
+#include "cutils/mpmc_queue.h"
+#include "liteplayer_stats.h"
+#include "liteplayer_bench.h"
+
+#define QUEUE_BENCH_MSGS      (1 << 21)
+#define QUEUE_BENCH_PACED_MSGS 20000
+#define QUEUE_BENCH_PACE_US   200
+#define QUEUE_BENCH_LENGTH    64
+#define QUEUE_BENCH_MAX_PRODUCERS 8
+
+#define TAG "liteplayer_bench"
+
+// Queue contention, 1 to 8 producers send stamped messages to one consumer,
+// either through one shared queue or each through its own queue of a set
+
+struct queue_ops {
+    const char *name;
+    void *(*create)(unsigned int msg_size, unsigned int msg_count);
+    void (*destroy)(void *queue);
+    int (*send)(void *queue, char *msg, unsigned int timeout_ms);
+    int (*receive)(void *queue, char *msg, unsigned int timeout_ms);
+    void *(*set_create)(unsigned int msg_count);
+    void (*set_destroy)(void *set);
+    int (*set_add)(void *set, void *queue);
+    int (*set_remove)(void *set, void *queue);
+    void *(*select)(void *set, unsigned int timeout_ms);
+};
+
+struct queue_msg {
+    unsigned long long stamp;
+    int producer;
+    int last;
+    char payload[16];       // same size as a looper message
+};
+
+struct queue_bench;
+
+struct queue_producer {
+    struct queue_bench *bench;
+    void *queue;
+    int id;
+    os_thread_t thread;
+};
+
+struct queue_bench {
+    struct queue_ops *ops;
+    int pace_us;            // producer sleep between messages, 0 for throughput
+    long long msgs;         // per producer
+    struct queue_producer producers[QUEUE_BENCH_MAX_PRODUCERS];
+    struct stats_histogram latency_ns;
+};
+
+static void *msgqueue_create(unsigned int msg_size, unsigned int msg_count) { return mqueue_create(msg_size, msg_count); }
+static void msgqueue_destroy(void *queue) { mqueue_destroy(queue); }
+static int msgqueue_send(void *queue, char *msg, unsigned int timeout_ms) { return mqueue_send(queue, msg, timeout_ms); }
+static int msgqueue_receive(void *queue, char *msg, unsigned int timeout_ms) { return mqueue_receive(queue, msg, timeout_ms); }
+static void *msgqueueset_create(unsigned int msg_count) { return mqueueset_create(msg_count); }
+static void msgqueueset_destroy(void *set) { mqueueset_destroy(set); }
+static int msgqueueset_add(void *set, void *queue) { return mqueueset_add_queue(set, queue); }
+static int msgqueueset_remove(void *set, void *queue) { return mqueueset_remove_queue(set, queue); }
+static void *msgqueueset_select(void *set, unsigned int timeout_ms) { return mqueueset_select_queue(set, timeout_ms); }
+
+static void *mpmc_create(unsigned int msg_size, unsigned int msg_count) { return mpmc_queue_create(msg_size, msg_count); }
+static void mpmc_destroy(void *queue) { mpmc_queue_destroy(queue); }
+static int mpmc_send(void *queue, char *msg, unsigned int timeout_ms) { return mpmc_queue_send(queue, msg, timeout_ms); }
+static int mpmc_receive(void *queue, char *msg, unsigned int timeout_ms) { return mpmc_queue_receive(queue, msg, timeout_ms); }
+static void *mpmc_set_create(unsigned int msg_count) { return mpmc_queueset_create(msg_count); }
+static void mpmc_set_destroy(void *set) { mpmc_queueset_destroy(set); }
+static int mpmc_set_add(void *set, void *queue) { return mpmc_queueset_add_queue(set, queue); }
+static int mpmc_set_remove(void *set, void *queue) { return mpmc_queueset_remove_queue(set, queue); }
+static void *mpmc_set_select(void *set, unsigned int timeout_ms) { return mpmc_queueset_select_queue(set, timeout_ms); }
+
+static struct queue_ops sQueueOps[] = {
+    { "msgqueue", msgqueue_create, msgqueue_destroy, msgqueue_send, msgqueue_receive,
+      msgqueueset_create, msgqueueset_destroy, msgqueueset_add, msgqueueset_remove, msgqueueset_select },
+    { "mpmc_queue", mpmc_create, mpmc_destroy, mpmc_send, mpmc_receive,
+      mpmc_set_create, mpmc_set_destroy, mpmc_set_add, mpmc_set_remove, mpmc_set_select },
+};
+
+static void *queue_bench_producer(void *arg)
+{
+    struct queue_producer *producer = (struct queue_producer *)arg;
+    struct queue_bench *bench = producer->bench;
+    struct queue_msg msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.producer = producer->id;
+    long long i;
+    for (i = 0; i < bench->msgs; i++) {
+        msg.stamp = bench_monotonic_nsec();
+        msg.last = i == bench->msgs - 1;
+        // Timeout 0 doesn't block in msgqueue semantics, retry on expiry
+        while (bench->ops->send(producer->queue, (char *)&msg, 1000) != 0);
+        if (bench->pace_us > 0)
+            OS_THREAD_SLEEP_USEC(bench->pace_us);
+    }
+    return NULL;
+}
+
+static void bench_queue_run(FILE *report, struct queue_ops *ops, int producers, bool use_set, int pace_us)
+{
+    struct queue_bench bench;
+    memset(&bench, 0, sizeof(bench));
+    bench.ops = ops;
+    bench.pace_us = pace_us;
+    bench.msgs = (pace_us > 0 ? QUEUE_BENCH_PACED_MSGS : QUEUE_BENCH_MSGS) / producers;
+
+    int queues = use_set ? producers : 1, i;
+    void *queue[QUEUE_BENCH_MAX_PRODUCERS];
+    void *set = NULL;
+    memset(queue, 0, sizeof(queue));
+    for (i = 0; i < queues; i++) {
+        queue[i] = ops->create(sizeof(struct queue_msg), QUEUE_BENCH_LENGTH);
+        if (queue[i] == NULL)
+            goto out;
+    }
+    if (use_set) {
+        set = ops->set_create(queues * QUEUE_BENCH_LENGTH);
+        if (set == NULL)
+            goto out;
+        for (i = 0; i < queues; i++)
+            ops->set_add(set, queue[i]);
+    }
+
+    struct os_threadattr attr = {
+        .name = "queue_producer",
+        .priority = OS_THREAD_PRIO_NORMAL,
+        .stacksize = 64*1024,
+        .joinable = true,
+    };
+    int started = 0;
+    unsigned long long begin = OS_MONOTONIC_USEC();
+    for (i = 0; i < producers; i++) {
+        struct queue_producer *producer = &bench.producers[i];
+        producer->bench = &bench;
+        producer->queue = queue[use_set ? i : 0];
+        producer->id = i;
+        producer->thread = OS_THREAD_CREATE(&attr, queue_bench_producer, producer);
+        if (producer->thread == NULL)
+            break;
+        started++;
+    }
+    long long received = 0;
+    int finished = 0;
+    while (finished < started) {
+        struct queue_msg msg;
+        void *active = use_set ? ops->select(set, 1000) : queue[0];
+        if (active == NULL || ops->receive(active, (char *)&msg, use_set ? 0 : 1000) != 0)
+            continue;
+        stats_histogram_add(&bench.latency_ns, bench_monotonic_nsec() - msg.stamp);
+        received++;
+        finished += msg.last;
+    }
+    unsigned long long elapsed_us = OS_MONOTONIC_USEC() - begin;
+    for (i = 0; i < started; i++)
+        OS_THREAD_JOIN(bench.producers[i].thread, NULL);
+
+    fprintf(report, "{\"benchmark\":\"queue\",\"queue\":\"%s\",\"set\":%s,\"mode\":\"%s\",\"producers\":%d,"
+            "\"msgs\":%lld,\"msgs_per_sec\":%.0f,\"latency_ns_p50\":%d,\"latency_ns_p99\":%d}\n",
+            ops->name, use_set ? "true" : "false", pace_us > 0 ? "paced" : "throughput", started, received,
+            elapsed_us > 0 ? received * 1000000.0 / elapsed_us : 0.0,
+            stats_histogram_percentile(&bench.latency_ns, 50),
+            stats_histogram_percentile(&bench.latency_ns, 99));
+
+out:
+    if (set != NULL) {
+        for (i = 0; i < queues; i++)
+            ops->set_remove(set, queue[i]);
+        ops->set_destroy(set);
+    }
+    for (i = 0; i < queues; i++) {
+        if (queue[i] != NULL)
+            ops->destroy(queue[i]);
+    }
+}
+
+void bench_queue(FILE *report)
+{
+    unsigned int i;
+    int producers, use_set;
+    for (i = 0; i < sizeof(sQueueOps)/sizeof(sQueueOps[0]); i++) {
+        for (use_set = 0; use_set <= 1; use_set++) {
+            for (producers = 1; producers <= QUEUE_BENCH_MAX_PRODUCERS; producers *= 2) {
+                bench_queue_run(report, &sQueueOps[i], producers, use_set, 0);
+                bench_queue_run(report, &sQueueOps[i], producers, use_set, QUEUE_BENCH_PACE_US);
+            }
+        }
+    }
+}
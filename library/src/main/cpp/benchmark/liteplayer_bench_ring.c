@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "msgutils/cutils/os_time.h"
+#include "msgutils/cutils/os_thread.h"
+#include "msgutils/cutils/ringbuf.h"
+#include "cutils/spsc_ring.h"
+#include "liteplayer_stats.h"
+#include "liteplayer_bench.h"
+
+#define RING_BENCH_CHUNK      1920        // 10ms of 48KHz stereo
+#define RING_BENCH_SIZE       19200       // 100ms, default mixer source buffer
+#define RING_BENCH_BYTES      (256LL << 20)
+#define RING_BENCH_PACED_CHUNKS 20000
+#define RING_BENCH_PACE_US    200
+#define RING_BENCH_PIECES     8
+
+#define TAG "liteplayer_bench"
+
+// Ring contention, a producer and a consumer thread exchange stamped chunks
+// through msgutils ringbuf and spsc_ring with the mixer source geometry
+
+struct ring_ops {
+    const char *name;
+    void *(*create)(int size);
+    void (*destroy)(void *rb);
+    int (*read)(void *rb, char *buf, int len, unsigned int timeout_ms);
+    int (*write)(void *rb, char *buf, int len, unsigned int timeout_ms);
+    void (*done_write)(void *rb);
+    int watermark;          // spsc_ring wake watermark of both sides, 0 for default
+    int pieces;             // chunk written in pieces like small network reads, 0 for whole
+};
+
+struct ring_bench {
+    struct ring_ops *ops;
+    bool zerocopy;          // spsc_ring acquire/commit instead of read/write
+    void *rb;
+    int pace_us;            // producer sleep between chunks, 0 for throughput
+    long long chunks;
+    struct stats_histogram handoff_ns;
+};
+
+static void *ringbuf_create(int size) { return rb_create(size); }
+static void ringbuf_destroy(void *rb) { rb_destroy(rb); }
+static int ringbuf_read(void *rb, char *buf, int len, unsigned int timeout_ms) { return rb_read(rb, buf, len, timeout_ms); }
+static int ringbuf_write(void *rb, char *buf, int len, unsigned int timeout_ms) { return rb_write(rb, buf, len, timeout_ms); }
+static void ringbuf_done_write(void *rb) { rb_done_write(rb); }
+
+static void *spsc_create(int size) { return spsc_ring_create(size); }
+static void spsc_destroy(void *rb) { spsc_ring_destroy(rb); }
+static void *spsc_create_mirrored(int size) { return spsc_ring_create_mirrored(size); }
+static int spsc_read(void *rb, char *buf, int len, unsigned int timeout_ms) { return spsc_ring_read(rb, buf, len, timeout_ms); }
+static int spsc_write(void *rb, char *buf, int len, unsigned int timeout_ms) { return spsc_ring_write(rb, buf, len, timeout_ms); }
+static void spsc_done_write(void *rb) { spsc_ring_done_write(rb); }
+
+static struct ring_ops sRingOps[] = {
+    { "ringbuf", ringbuf_create, ringbuf_destroy, ringbuf_read, ringbuf_write, ringbuf_done_write },
+    { "spsc_ring", spsc_create, spsc_destroy, spsc_read, spsc_write, spsc_done_write },
+    { "spsc_ring_zerocopy", spsc_create, spsc_destroy, NULL, NULL, spsc_done_write },
+    { "spsc_ring_mirrored", spsc_create_mirrored, spsc_destroy, NULL, NULL, spsc_done_write },
+    { "spsc_ring_small_writes", spsc_create, spsc_destroy, spsc_read, spsc_write, spsc_done_write, 0, RING_BENCH_PIECES },
+    { "spsc_ring_watermark", spsc_create, spsc_destroy, spsc_read, spsc_write, spsc_done_write, RING_BENCH_CHUNK, RING_BENCH_PIECES },
+};
+
+// Chunks may wrap, the stamp is copied byte-wise at the start of each chunk
+static int ring_zerocopy_write(spsc_ring_t rb, unsigned long long stamp)
+{
+    int done = 0;
+    while (done < RING_BENCH_CHUNK) {
+        char *ptr = NULL;
+        int len = 0;
+        int ret = spsc_ring_acquire_write(rb, &ptr, &len, 0);
+        if (ret != RB_OK)
+            return ret;
+        if (len > RING_BENCH_CHUNK - done)
+            len = RING_BENCH_CHUNK - done;
+        memset(ptr, 0, len);
+        int i;
+        for (i = 0; done + i < (int)sizeof(stamp) && i < len; i++)
+            ptr[i] = ((char *)&stamp)[done + i];
+        spsc_ring_commit_write(rb, len);
+        done += len;
+    }
+    return done;
+}
+
+static int ring_zerocopy_read(spsc_ring_t rb, unsigned long long *stamp)
+{
+    int done = 0;
+    while (done < RING_BENCH_CHUNK) {
+        char *ptr = NULL;
+        int len = 0;
+        int ret = spsc_ring_acquire_read(rb, &ptr, &len, 0);
+        if (ret != RB_OK)
+            return ret;
+        if (len > RING_BENCH_CHUNK - done)
+            len = RING_BENCH_CHUNK - done;
+        int i;
+        for (i = 0; done + i < (int)sizeof(*stamp) && i < len; i++)
+            ((char *)stamp)[done + i] = ptr[i];
+        spsc_ring_commit_read(rb, len);
+        done += len;
+    }
+    return done;
+}
+
+static void *ring_bench_producer(void *arg)
+{
+    struct ring_bench *bench = (struct ring_bench *)arg;
+    char chunk[RING_BENCH_CHUNK];
+    memset(chunk, 0, sizeof(chunk));
+    long long i;
+    for (i = 0; i < bench->chunks; i++) {
+        unsigned long long stamp = bench_monotonic_nsec();
+        if (bench->zerocopy) {
+            if (ring_zerocopy_write(bench->rb, stamp) != RING_BENCH_CHUNK)
+                break;
+        } else if (bench->ops->pieces > 0) {
+            memcpy(chunk, &stamp, sizeof(stamp));
+            int piece = RING_BENCH_CHUNK / bench->ops->pieces, j;
+            for (j = 0; j < bench->ops->pieces; j++) {
+                if (bench->ops->write(bench->rb, chunk + j * piece, piece, 0) != piece)
+                    break;
+            }
+            if (j < bench->ops->pieces)
+                break;
+        } else {
+            memcpy(chunk, &stamp, sizeof(stamp));
+            if (bench->ops->write(bench->rb, chunk, sizeof(chunk), 0) != sizeof(chunk))
+                break;
+        }
+        if (bench->pace_us > 0)
+            OS_THREAD_SLEEP_USEC(bench->pace_us);
+    }
+    bench->ops->done_write(bench->rb);
+    return NULL;
+}
+
+static void bench_ring_run(FILE *report, struct ring_ops *ops, int pace_us)
+{
+    struct ring_bench bench;
+    memset(&bench, 0, sizeof(bench));
+    bench.ops = ops;
+    bench.zerocopy = ops->read == NULL;
+    bench.pace_us = pace_us;
+    bench.chunks = pace_us > 0 ? RING_BENCH_PACED_CHUNKS : RING_BENCH_BYTES / RING_BENCH_CHUNK;
+    bench.rb = ops->create(RING_BENCH_SIZE);
+    if (bench.rb == NULL)
+        return;
+    bool spsc = ops->create != ringbuf_create;
+    if (spsc && ops->watermark > 0)
+        spsc_ring_set_watermarks(bench.rb, ops->watermark, ops->watermark);
+
+    struct os_threadattr attr = {
+        .name = "ring_producer",
+        .priority = OS_THREAD_PRIO_NORMAL,
+        .stacksize = 64*1024,
+        .joinable = true,
+    };
+    char chunk[RING_BENCH_CHUNK];
+    long long received = 0;
+    unsigned long long begin = OS_MONOTONIC_USEC();
+    os_thread_t producer = OS_THREAD_CREATE(&attr, ring_bench_producer, &bench);
+    if (producer == NULL) {
+        ops->destroy(bench.rb);
+        return;
+    }
+    while (1) {
+        unsigned long long stamp = 0;
+        if (bench.zerocopy) {
+            if (ring_zerocopy_read(bench.rb, &stamp) != RING_BENCH_CHUNK)
+                break;
+        } else {
+            if (ops->read(bench.rb, chunk, sizeof(chunk), 0) != sizeof(chunk))
+                break;
+            memcpy(&stamp, chunk, sizeof(stamp));
+        }
+        stats_histogram_add(&bench.handoff_ns, bench_monotonic_nsec() - stamp);
+        received++;
+    }
+    unsigned long long elapsed_us = OS_MONOTONIC_USEC() - begin;
+    OS_THREAD_JOIN(producer, NULL);
+    // Wakeups of ringbuf aren't observable, reported as -1
+    double wakeups_per_sec = -1;
+    if (spsc && elapsed_us > 0) {
+        struct spsc_ring_counters counters;
+        spsc_ring_get_counters(bench.rb, &counters);
+        wakeups_per_sec = (counters.reader_wakeups + counters.writer_wakeups) * 1000000.0 / elapsed_us;
+    }
+    ops->destroy(bench.rb);
+
+    fprintf(report, "{\"benchmark\":\"ring\",\"ring\":\"%s\",\"mode\":\"%s\",\"chunk\":%d,\"size\":%d,"
+            "\"chunks\":%lld,\"mbytes_per_sec\":%.1f,\"handoff_ns_p50\":%d,\"handoff_ns_p99\":%d,"
+            "\"wakeups_per_sec\":%.0f}\n",
+            ops->name, pace_us > 0 ? "paced" : "throughput", RING_BENCH_CHUNK, RING_BENCH_SIZE, received,
+            elapsed_us > 0 ? received * RING_BENCH_CHUNK / (double)elapsed_us : 0.0,
+            stats_histogram_percentile(&bench.handoff_ns, 50),
+            stats_histogram_percentile(&bench.handoff_ns, 99), wakeups_per_sec);
+}
+
+void bench_ring(FILE *report)
+{
+    unsigned int i;
+    for (i = 0; i < sizeof(sRingOps)/sizeof(sRingOps[0]); i++) {
+        // Throughput with both sides spinning on a full ring, then wake-up
+        // latency with the consumer sleeping on an empty ring
+        bench_ring_run(report, &sRingOps[i], 0);
+        bench_ring_run(report, &sRingOps[i], RING_BENCH_PACE_US);
+    }
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "msgutils/cutils/os_time.h"
+#include "msgutils/cutils/os_thread.h"
+#include "liteplayer/liteplayer_main.h"
+#include "liteplayer/adapter/fatfs_wrapper.h"
+#include "adapter/null_wrapper.h"
+#include "cutils/os_sched.h"
+#include "liteplayer_decoder.h"
+#include "liteplayer_stats.h"
+#include "liteplayer_bench.h"
+
+#define UNDERRUN_BENCH_SEC    20          // audio played in realtime per scheduling setting
+#define UNDERRUN_BENCH_MAX_BUSY 64
+
+#define TAG "liteplayer_bench"
+
+// Underruns under competing cpu load
+
+struct underrun_bench {
+    null_sink_t null_sink;
+    sink_handle_t handle;
+    int byterate;
+    struct os_schedattr sched;
+    struct stats_collector stats;
+    int busy_stop;
+};
+
+static struct underrun_bench sUnderrunBench;
+
+static void *underrun_bench_busy(void *arg)
+{
+    struct underrun_bench *bench = (struct underrun_bench *)arg;
+    unsigned int x = 1;
+    while (!__atomic_load_n(&bench->busy_stop, __ATOMIC_RELAXED))
+        x = x * 1103515245U + 12345U;
+    return (void *)(unsigned long)x;
+}
+
+// The decoder thread opens the sink, like liteplayer_sink_open of the jni
+static sink_handle_t underrun_bench_open(int samplerate, int channels, void *sink_priv)
+{
+    struct underrun_bench *bench = (struct underrun_bench *)sink_priv;
+    OS_SCHED_APPLY(&bench->sched);
+    bench->byterate = samplerate * channels * sizeof(short);
+    bench->handle = null_wrapper_open(samplerate, channels, bench->null_sink);
+    return bench->handle != NULL ? (sink_handle_t)bench : NULL;
+}
+
+static int underrun_bench_write(sink_handle_t handle, char *buffer, int size)
+{
+    struct underrun_bench *bench = (struct underrun_bench *)handle;
+    unsigned long long begin = OS_MONOTONIC_USEC();
+    int ret = null_wrapper_write(bench->handle, buffer, size);
+    stats_on_sink_write(&bench->stats, size, bench->byterate, begin, OS_MONOTONIC_USEC());
+    return ret;
+}
+
+static void underrun_bench_close(sink_handle_t handle)
+{
+    struct underrun_bench *bench = (struct underrun_bench *)handle;
+    null_wrapper_close(bench->handle);
+    bench->handle = NULL;
+}
+
+static void bench_underrun_run(FILE *report, liteplayer_handle_t player, const char *url,
+                               const char *name, enum os_threadprio prio, int busy)
+{
+    struct underrun_bench *bench = &sUnderrunBench;
+    memset(bench, 0, sizeof(*bench));
+    struct null_sink_attr sink_attr = {
+        .paced = true,
+        .buffer_ms = 0,
+        .stall_every_ms = 0,
+        .stall_ms = 0,
+    };
+    bench->null_sink = null_sink_create(&sink_attr);
+    if (bench->null_sink == NULL)
+        return;
+    OS_SCHED_FROM_PRIO(prio, &bench->sched);
+    stats_init(&bench->stats);
+
+    struct os_threadattr attr = {
+        .name = "bench_busy",
+        .priority = OS_THREAD_PRIO_NORMAL,
+        .stacksize = 16*1024,
+        .joinable = true,
+    };
+    os_thread_t threads[UNDERRUN_BENCH_MAX_BUSY];
+    int i, started = 0;
+    for (i = 0; i < busy; i++) {
+        threads[started] = OS_THREAD_CREATE(&attr, underrun_bench_busy, bench);
+        if (threads[started] != NULL)
+            started++;
+    }
+
+    struct sink_wrapper sink_ops = {
+        .sink_priv = bench,
+        .open = underrun_bench_open,
+        .write = underrun_bench_write,
+        .close = underrun_bench_close,
+    };
+    stats_on_prepare(&bench->stats);
+    int ret = liteplayer_decode_to(player, url, &sink_ops);
+
+    __atomic_store_n(&bench->busy_stop, 1, __ATOMIC_RELAXED);
+    for (i = 0; i < started; i++)
+        OS_THREAD_JOIN(threads[i], NULL);
+
+    struct liteplayer_stats stats;
+    struct null_sink_stats sink;
+    stats_get(&bench->stats, &stats);
+    null_sink_get_stats(bench->null_sink, &sink);
+    null_sink_destroy(bench->null_sink);
+    fprintf(report, "{\"benchmark\":\"underrun\",\"sched\":\"%s\",\"policy\":%d,\"priority\":%d,"
+            "\"busy_threads\":%d,\"completed\":%s,\"audio_sec\":%.3f,\"underrun_count\":%d,"
+            "\"decode_us_p50\":%d,\"decode_us_p99\":%d,\"write_interval_us_max\":%d}\n",
+            name, bench->sched.policy, bench->sched.priority, started, ret == 0 ? "true" : "false",
+            bench->byterate > 0 ? (double)sink.bytes / bench->byterate : 0.0, stats.underrun_count,
+            stats.decode_us_p50, stats.decode_us_p99, sink.interval_us_max);
+}
+
+int bench_underrun(FILE *report, int busy)
+{
+    static const struct {
+        const char *name;
+        enum os_threadprio prio;
+    } settings[] = {
+        { "normal", OS_THREAD_PRIO_NORMAL },
+        { "high", OS_THREAD_PRIO_HIGH },
+        { "soft_realtime", OS_THREAD_PRIO_SOFT_REALTIME },
+        { "hard_realtime", OS_THREAD_PRIO_HARD_REALTIME },
+    };
+    const char *fixture_path = "liteplayer_bench_underrun.wav";
+    if (busy <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        busy = cores > 0 ? (int)cores : 1;
+    }
+    if (busy > UNDERRUN_BENCH_MAX_BUSY)
+        busy = UNDERRUN_BENCH_MAX_BUSY;
+    if (bench_generate_fixture(fixture_path, UNDERRUN_BENCH_SEC) != 0) {
+        fprintf(stderr, "Failed to generate fixture: %s\n", fixture_path);
+        return -1;
+    }
+    liteplayer_handle_t player = liteplayer_create();
+    if (player == NULL) {
+        unlink(fixture_path);
+        return -1;
+    }
+    struct file_wrapper file_ops = {
+        .file_priv = NULL,
+        .open = fatfs_wrapper_open,
+        .read = fatfs_wrapper_read,
+        .filesize = fatfs_wrapper_filesize,
+        .seek = fatfs_wrapper_seek,
+        .close = fatfs_wrapper_close,
+    };
+    liteplayer_register_file_wrapper(player, &file_ops);
+    unsigned int i;
+    for (i = 0; i < sizeof(settings)/sizeof(settings[0]); i++)
+        bench_underrun_run(report, player, fixture_path, settings[i].name, settings[i].prio, busy);
+    liteplayer_destroy(player);
+    unlink(fixture_path);
+    return 0;
+}
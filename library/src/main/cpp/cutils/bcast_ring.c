@@ -0,0 +1,328 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define OS_MEMORY_TAG OS_MEMTAG_RINGBUF
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "cutils/os_alloc.h"
+#include "msgutils/cutils/os_time.h"
+#include "cutils/os_futex.h"
+#include "cutils/bcast_ring.h"
+
+#define CACHELINE_SIZE 64
+
+#define FLAG_DONE  0x1
+#define FLAG_ABORT 0x2
+
+enum bcast_reader_state {
+    READER_FREE = 0,
+    READER_CLAIMED,
+    READER_JOINING,         // cursor is set by the writer on its next write
+    READER_ACTIVE,
+};
+
+struct bcast_reader {
+    struct bcast_ring *rb;
+    int state __attribute__((aligned(CACHELINE_SIZE))); // enum bcast_reader_state, accessed atomically
+    bool lossy;
+    unsigned int cursor;        // written by the reader once active, read by the writer
+    long long dropped;
+};
+
+struct bcast_ring {
+    // Writer side
+    unsigned int head __attribute__((aligned(CACHELINE_SIZE)));
+    unsigned int reserve;       // end of the region being copied in, >= head
+    int writer_waiting;
+    int writer_seq;             // futex word the writer sleeps on
+    // Shared by all readers
+    int readers_waiting __attribute__((aligned(CACHELINE_SIZE)));
+    int readers_seq;            // futex word the readers sleep on
+    // Read only after creation, except flags
+    int flags __attribute__((aligned(CACHELINE_SIZE)));
+    unsigned int size;          // power of two
+    unsigned int mask;
+    char *data;
+    int reader_count;           // claimed readers, accessed atomically
+    struct bcast_reader readers[BCAST_RING_MAX_READERS];
+};
+
+static unsigned long long ring_deadline(unsigned int timeout_ms)
+{
+    return timeout_ms != 0 ? OS_MONOTONIC_USEC() + (unsigned long long)timeout_ms * 1000 : 0;
+}
+
+static void ring_wake_readers(struct bcast_ring *rb)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&rb->readers_waiting, __ATOMIC_RELAXED) > 0) {
+        __atomic_add_fetch(&rb->readers_seq, 1, __ATOMIC_RELEASE);
+        os_futex_wake(&rb->readers_seq, INT_MAX);
+    }
+}
+
+static void ring_wake_writer(struct bcast_ring *rb)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&rb->writer_waiting, __ATOMIC_RELAXED)) {
+        __atomic_add_fetch(&rb->writer_seq, 1, __ATOMIC_RELEASE);
+        os_futex_wake(&rb->writer_seq, 1);
+    }
+}
+
+// Free space bounded by the slowest blocking reader, joining readers are
+// started at head here so that their cursor is never behind what was written
+static unsigned int ring_space(struct bcast_ring *rb, unsigned int head)
+{
+    unsigned int space = rb->size;
+    int i;
+    for (i = 0; i < BCAST_RING_MAX_READERS; i++) {
+        struct bcast_reader *reader = &rb->readers[i];
+        int state = __atomic_load_n(&reader->state, __ATOMIC_ACQUIRE);
+        if (state == READER_JOINING) {
+            __atomic_store_n(&reader->cursor, head, __ATOMIC_RELAXED);
+            __atomic_compare_exchange_n(&reader->state, &state, READER_ACTIVE,
+                                        false, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (state != READER_ACTIVE || reader->lossy)
+            continue;
+        unsigned int free = rb->size - (head - __atomic_load_n(&reader->cursor, __ATOMIC_ACQUIRE));
+        if (free < space)
+            space = free;
+    }
+    return space;
+}
+
+bcast_ring_t bcast_ring_create(int size)
+{
+    if (size <= 0)
+        return NULL;
+    unsigned int capacity = 1;
+    while (capacity < (unsigned int)size)
+        capacity <<= 1;
+    struct bcast_ring *rb = NULL;
+    if (posix_memalign((void **)&rb, CACHELINE_SIZE, sizeof(struct bcast_ring)) != 0)
+        return NULL;
+    memset(rb, 0, sizeof(struct bcast_ring));
+    rb->data = OS_MALLOC(capacity);
+    if (rb->data == NULL) {
+        free(rb);
+        return NULL;
+    }
+    rb->size = capacity;
+    rb->mask = capacity - 1;
+    int i;
+    for (i = 0; i < BCAST_RING_MAX_READERS; i++)
+        rb->readers[i].rb = rb;
+    return rb;
+}
+
+void bcast_ring_destroy(bcast_ring_t rb)
+{
+    if (rb == NULL)
+        return;
+    OS_FREE(rb->data);
+    free(rb);
+}
+
+bcast_reader_t bcast_ring_add_reader(bcast_ring_t rb, bool lossy)
+{
+    int i;
+    for (i = 0; i < BCAST_RING_MAX_READERS; i++) {
+        struct bcast_reader *reader = &rb->readers[i];
+        int expected = READER_FREE;
+        if (!__atomic_compare_exchange_n(&reader->state, &expected, READER_CLAIMED,
+                                         false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            continue;
+        __atomic_add_fetch(&rb->reader_count, 1, __ATOMIC_ACQ_REL);
+        reader->lossy = lossy;
+        reader->dropped = 0;
+        __atomic_store_n(&reader->state, READER_JOINING, __ATOMIC_RELEASE);
+        return reader;
+    }
+    return NULL;
+}
+
+void bcast_ring_remove_reader(bcast_ring_t rb, bcast_reader_t reader)
+{
+    if (reader == NULL)
+        return;
+    __atomic_store_n(&reader->state, READER_FREE, __ATOMIC_RELEASE);
+    __atomic_sub_fetch(&rb->reader_count, 1, __ATOMIC_ACQ_REL);
+    // Writer may be waiting for this reader only
+    ring_wake_writer(rb);
+}
+
+void bcast_ring_abort(bcast_ring_t rb)
+{
+    __atomic_or_fetch(&rb->flags, FLAG_ABORT, __ATOMIC_RELEASE);
+    ring_wake_readers(rb);
+    ring_wake_writer(rb);
+}
+
+int bcast_ring_write(bcast_ring_t rb, char *buf, int len, unsigned int timeout_ms)
+{
+    unsigned long long deadline = 0;
+    unsigned int head = rb->head;
+    int done = 0;
+    if (__atomic_load_n(&rb->reader_count, __ATOMIC_ACQUIRE) == 0) {
+        if (__atomic_load_n(&rb->flags, __ATOMIC_ACQUIRE) & FLAG_ABORT)
+            return RB_ABORT;
+        // Nobody to read it, a reader joining now starts from the next write
+        __atomic_store_n(&rb->reserve, head + len, __ATOMIC_RELAXED);
+        __atomic_store_n(&rb->head, head + len, __ATOMIC_RELEASE);
+        return len;
+    }
+    while (done < len) {
+        if (__atomic_load_n(&rb->flags, __ATOMIC_ACQUIRE) & FLAG_ABORT)
+            return RB_ABORT;
+        unsigned int space = ring_space(rb, head);
+        if (space > 0) {
+            unsigned int count = (unsigned int)(len - done) < space ? (unsigned int)(len - done) : space;
+            unsigned int offset = head & rb->mask;
+            unsigned int first = rb->size - offset < count ? rb->size - offset : count;
+            // Announce the overwrite before touching data, see lossy readers
+            __atomic_store_n(&rb->reserve, head + count, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            memcpy(rb->data + offset, buf + done, first);
+            memcpy(rb->data, buf + done + first, count - first);
+            head += count;
+            done += count;
+            __atomic_store_n(&rb->head, head, __ATOMIC_RELEASE);
+            ring_wake_readers(rb);
+            continue;
+        }
+
+        if (deadline == 0 && timeout_ms != 0)
+            deadline = ring_deadline(timeout_ms);
+        int seq = __atomic_load_n(&rb->writer_seq, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&rb->writer_waiting, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        int ret = 0;
+        if (ring_space(rb, head) == 0 && (__atomic_load_n(&rb->flags, __ATOMIC_RELAXED) & FLAG_ABORT) == 0)
+            ret = os_futex_wait(&rb->writer_seq, seq, deadline);
+        __atomic_store_n(&rb->writer_waiting, 0, __ATOMIC_RELAXED);
+        if (ret == -ETIMEDOUT)
+            return done > 0 ? done : RB_TIMEOUT;
+    }
+    return done;
+}
+
+void bcast_ring_done_write(bcast_ring_t rb)
+{
+    __atomic_or_fetch(&rb->flags, FLAG_DONE, __ATOMIC_RELEASE);
+    ring_wake_readers(rb);
+}
+
+// Skip what the writer has overwritten, only lossy readers can fall behind
+static unsigned int reader_filled(struct bcast_reader *reader, unsigned int head)
+{
+    struct bcast_ring *rb = reader->rb;
+    unsigned int filled = head - reader->cursor;
+    if (filled > rb->size) {
+        reader->dropped += filled - rb->size;
+        reader->cursor = head - rb->size;
+        filled = rb->size;
+    }
+    return filled;
+}
+
+int bcast_ring_bytes_filled(bcast_reader_t reader)
+{
+    if (__atomic_load_n(&reader->state, __ATOMIC_ACQUIRE) != READER_ACTIVE)
+        return 0;
+    unsigned int filled = __atomic_load_n(&reader->rb->head, __ATOMIC_ACQUIRE) - reader->cursor;
+    return (int)(filled < reader->rb->size ? filled : reader->rb->size);
+}
+
+int bcast_ring_read(bcast_reader_t reader, char *buf, int len, unsigned int timeout_ms)
+{
+    struct bcast_ring *rb = reader->rb;
+    unsigned long long deadline = 0;
+    int done = 0;
+    while (done < len) {
+        if (__atomic_load_n(&rb->flags, __ATOMIC_ACQUIRE) & FLAG_ABORT)
+            return RB_ABORT;
+        unsigned int filled = 0;
+        if (__atomic_load_n(&reader->state, __ATOMIC_ACQUIRE) == READER_ACTIVE) {
+            long long dropped = reader->dropped;
+            filled = reader_filled(reader, __atomic_load_n(&rb->head, __ATOMIC_ACQUIRE));
+            // Never return data with a gap, restart the read after the drop
+            if (reader->dropped != dropped) {
+                reader->dropped += done;
+                done = 0;
+            }
+        }
+        if (filled > 0) {
+            unsigned int cursor = reader->cursor;
+            unsigned int count = (unsigned int)(len - done) < filled ? (unsigned int)(len - done) : filled;
+            unsigned int offset = cursor & rb->mask;
+            unsigned int first = rb->size - offset < count ? rb->size - offset : count;
+            memcpy(buf + done, rb->data + offset, first);
+            memcpy(buf + done + first, rb->data, count - first);
+            if (reader->lossy) {
+                // Writer doesn't wait for lossy readers, discard the copy if
+                // it was being overwritten meanwhile, like a seqlock reader
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+                unsigned int reserve = __atomic_load_n(&rb->reserve, __ATOMIC_RELAXED);
+                if (reserve - cursor > rb->size) {
+                    reader->dropped += reserve - rb->size - cursor;
+                    reader->cursor = reserve - rb->size;
+                    reader->dropped += done;
+                    done = 0;
+                    continue;
+                }
+            }
+            done += count;
+            __atomic_store_n(&reader->cursor, cursor + count, __ATOMIC_RELEASE);
+            if (!reader->lossy)
+                ring_wake_writer(rb);
+            continue;
+        }
+
+        // Head written before done is visible once done is seen
+        if (__atomic_load_n(&rb->flags, __ATOMIC_ACQUIRE) & FLAG_DONE) {
+            if (__atomic_load_n(&reader->state, __ATOMIC_ACQUIRE) == READER_ACTIVE &&
+                __atomic_load_n(&rb->head, __ATOMIC_ACQUIRE) != reader->cursor)
+                continue;
+            return done > 0 ? done : RB_DONE;
+        }
+
+        if (deadline == 0 && timeout_ms != 0)
+            deadline = ring_deadline(timeout_ms);
+        int seq = __atomic_load_n(&rb->readers_seq, __ATOMIC_ACQUIRE);
+        __atomic_add_fetch(&rb->readers_waiting, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        int ret = 0;
+        if ((__atomic_load_n(&reader->state, __ATOMIC_RELAXED) != READER_ACTIVE ||
+             __atomic_load_n(&rb->head, __ATOMIC_RELAXED) == reader->cursor) &&
+            __atomic_load_n(&rb->flags, __ATOMIC_RELAXED) == 0)
+            ret = os_futex_wait(&rb->readers_seq, seq, deadline);
+        __atomic_sub_fetch(&rb->readers_waiting, 1, __ATOMIC_RELAXED);
+        if (ret == -ETIMEDOUT)
+            return done > 0 ? done : RB_TIMEOUT;
+    }
+    return done;
+}
+
+long long bcast_ring_dropped(bcast_reader_t reader)
+{
+    return reader->dropped;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CUTILS_BCAST_RING_H__
+#define __CUTILS_BCAST_RING_H__
+
+#include <stdbool.h>
+#include "msgutils/cutils/ringbuf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BCAST_RING_MAX_READERS 8
+
+typedef struct bcast_ring *bcast_ring_t;
+typedef struct bcast_reader *bcast_reader_t;
+
+/**
+ * Ring with one writer and up to BCAST_RING_MAX_READERS readers, each reader
+ * has its own cursor and sees every byte written after it was added.
+ *
+ * Blocking readers back-pressure the writer like a ringbuf reader. Lossy
+ * readers never block the writer, when one falls more than the ring size
+ * behind, the overwritten bytes are skipped and counted as dropped.
+ * Without readers writes only advance the write position.
+ *
+ * Return values and timeouts follow ringbuf: bytes transferred, or RB_DONE,
+ * RB_ABORT, RB_TIMEOUT, RB_FAIL; timeout_ms 0 waits forever.
+ */
+bcast_ring_t bcast_ring_create(int size);
+
+void bcast_ring_destroy(bcast_ring_t rb);
+
+// Reader starts at the next write, NULL if all slots are taken
+bcast_reader_t bcast_ring_add_reader(bcast_ring_t rb, bool lossy);
+
+// Must not race with a read of the same reader
+void bcast_ring_remove_reader(bcast_ring_t rb, bcast_reader_t reader);
+
+// Wake all sides, pending and further reads/writes return RB_ABORT
+void bcast_ring_abort(bcast_ring_t rb);
+
+// Block until len bytes are written, only blocking readers can make it wait
+int bcast_ring_write(bcast_ring_t rb, char *buf, int len, unsigned int timeout_ms);
+
+// No more data will be written, readers get the remaining data then RB_DONE
+void bcast_ring_done_write(bcast_ring_t rb);
+
+// Bytes readable by the reader, capped to ring size for a lossy reader
+int bcast_ring_bytes_filled(bcast_reader_t reader);
+
+// Block until len bytes are read, or less if writer is done. Data returned to
+// a lossy reader is always contiguous, a drop restarts the read
+int bcast_ring_read(bcast_reader_t reader, char *buf, int len, unsigned int timeout_ms);
+
+// Bytes a lossy reader skipped because they were overwritten
+long long bcast_ring_dropped(bcast_reader_t reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CUTILS_BCAST_RING_H__ */
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CUTILS_LOG_GATE_H__
+#define __CUTILS_LOG_GATE_H__
+
+#include "msgutils/cutils/os_logger.h"
+
+//#define ENABLE_ASYNC_LOGGER
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Level gating on top of msgutils os_logger.h, include this header instead of
+ * it. OS_LOGE..OS_LOGV are redefined to check the runtime level before any
+ * formatting, and to be stripped below the compile-time level. OS_LOGF and
+ * OS_ASSERT/OS_FATAL_IF of os_logger.h are kept as they are.
+ */
+
+// Printers behind the gate, the same as the ungated macros of os_logger.h
+#if defined(ENABLE_ASYNC_LOGGER)
+// Formatted and emitted by the logger thread, see cutils/os_logger_async.h
+void os_logger_async_print(enum os_logprio prio, const char *tag, const char *format, ...)
+        __attribute__((format(printf, 3, 4)));
+    #define OS_LOG_PRINT_E(tag, format, ...) os_logger_async_print(OS_LOG_ERROR, tag, format, ##__VA_ARGS__)
+    #define OS_LOG_PRINT_W(tag, format, ...) os_logger_async_print(OS_LOG_WARN, tag, format, ##__VA_ARGS__)
+    #define OS_LOG_PRINT_I(tag, format, ...) os_logger_async_print(OS_LOG_INFO, tag, format, ##__VA_ARGS__)
+    #define OS_LOG_PRINT_D(tag, format, ...) os_logger_async_print(OS_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+    #define OS_LOG_PRINT_V(tag, format, ...) os_logger_async_print(OS_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+#elif defined(OS_ANDROID)
+    #define OS_LOG_PRINT_E(tag, format, ...) __android_log_print(ANDROID_LOG_ERROR, tag, format, ##__VA_ARGS__)
+    #define OS_LOG_PRINT_W(tag, format, ...) __android_log_print(ANDROID_LOG_WARN, tag, format, ##__VA_ARGS__)
+    #define OS_LOG_PRINT_I(tag, format, ...) __android_log_print(ANDROID_LOG_INFO, tag, format, ##__VA_ARGS__)
+    #define OS_LOG_PRINT_D(tag, format, ...) __android_log_print(ANDROID_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+    #define OS_LOG_PRINT_V(tag, format, ...) __android_log_print(ANDROID_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+#else
+    #define OS_LOG_PRINT_E(tag, format, ...) \
+        os_logger_trace(OS_LOG_ERROR, tag, __FUNCTION__, __LINE__, OS_LOG_FORMAT(E, format), ##__VA_ARGS__)
+    #define OS_LOG_PRINT_W(tag, format, ...) \
+        os_logger_trace(OS_LOG_WARN, tag, __FUNCTION__, __LINE__, OS_LOG_FORMAT(W, format), ##__VA_ARGS__)
+    #define OS_LOG_PRINT_I(tag, format, ...) \
+        os_logger_trace(OS_LOG_INFO, tag, __FUNCTION__, __LINE__, OS_LOG_FORMAT(I, format), ##__VA_ARGS__)
+    #define OS_LOG_PRINT_D(tag, format, ...) \
+        os_logger_trace(OS_LOG_DEBUG, tag, __FUNCTION__, __LINE__, OS_LOG_FORMAT(D, format), ##__VA_ARGS__)
+    #define OS_LOG_PRINT_V(tag, format, ...) \
+        os_logger_trace(OS_LOG_VERBOSE, tag, __FUNCTION__, __LINE__, OS_LOG_FORMAT(V, format), ##__VA_ARGS__)
+#endif
+
+// Compile-time minimum level, logs less important than it are stripped,
+// e.g. -DOS_LOG_LEVEL=OS_LOG_LEVEL_INFO for release builds
+#define OS_LOG_LEVEL_FATAL   0
+#define OS_LOG_LEVEL_ERROR   1
+#define OS_LOG_LEVEL_WARN    2
+#define OS_LOG_LEVEL_INFO    3
+#define OS_LOG_LEVEL_DEBUG   4
+#define OS_LOG_LEVEL_VERBOSE 5
+#if !defined(OS_LOG_LEVEL)
+    #define OS_LOG_LEVEL OS_LOG_LEVEL_VERBOSE
+#endif
+
+// Runtime level checked before any formatting, -1 disables all logs.
+// Set it with os_logger_set_level, which also applies os_logger_config.
+// Defined in cutils/os_logger.c
+extern int os_logger_level;
+
+static inline void os_logger_set_level(bool enable, enum os_logprio prio)
+{
+    __atomic_store_n(&os_logger_level, enable ? (int)prio : -1, __ATOMIC_RELAXED);
+    os_logger_config(enable, prio);
+}
+
+// Keeps arguments type checked and referenced when a log is stripped
+static inline __attribute__((format(printf, 1, 2))) void os_logger_discard(const char *format, ...)
+{
+    (void)format;
+}
+
+#define OS_LOG_ENABLED(prio) ((int)(prio) <= __atomic_load_n(&os_logger_level, __ATOMIC_RELAXED))
+#define OS_LOG_GATED(prio, letter, tag, format, ...) \
+    do {\
+        if (OS_LOG_ENABLED(prio))\
+            OS_LOG_PRINT_ ## letter(tag, format, ##__VA_ARGS__);\
+    } while (0)
+#define OS_LOG_STRIPPED(tag, format, ...) \
+    do {\
+        if (0)\
+            os_logger_discard(format, ##__VA_ARGS__);\
+    } while (0)
+
+#undef OS_LOGE
+#undef OS_LOGW
+#undef OS_LOGI
+#undef OS_LOGD
+#undef OS_LOGV
+#if OS_LOG_LEVEL >= OS_LOG_LEVEL_ERROR
+    #define OS_LOGE(tag, format, ...) OS_LOG_GATED(OS_LOG_ERROR, E, tag, format, ##__VA_ARGS__)
+#else
+    #define OS_LOGE(tag, format, ...) OS_LOG_STRIPPED(tag, format, ##__VA_ARGS__)
+#endif
+#if OS_LOG_LEVEL >= OS_LOG_LEVEL_WARN
+    #define OS_LOGW(tag, format, ...) OS_LOG_GATED(OS_LOG_WARN, W, tag, format, ##__VA_ARGS__)
+#else
+    #define OS_LOGW(tag, format, ...) OS_LOG_STRIPPED(tag, format, ##__VA_ARGS__)
+#endif
+#if OS_LOG_LEVEL >= OS_LOG_LEVEL_INFO
+    #define OS_LOGI(tag, format, ...) OS_LOG_GATED(OS_LOG_INFO, I, tag, format, ##__VA_ARGS__)
+#else
+    #define OS_LOGI(tag, format, ...) OS_LOG_STRIPPED(tag, format, ##__VA_ARGS__)
+#endif
+#if OS_LOG_LEVEL >= OS_LOG_LEVEL_DEBUG
+    #define OS_LOGD(tag, format, ...) OS_LOG_GATED(OS_LOG_DEBUG, D, tag, format, ##__VA_ARGS__)
+#else
+    #define OS_LOGD(tag, format, ...) OS_LOG_STRIPPED(tag, format, ##__VA_ARGS__)
+#endif
+#if OS_LOG_LEVEL >= OS_LOG_LEVEL_VERBOSE
+    #define OS_LOGV(tag, format, ...) OS_LOG_GATED(OS_LOG_VERBOSE, V, tag, format, ##__VA_ARGS__)
+#else
+    #define OS_LOGV(tag, format, ...) OS_LOG_STRIPPED(tag, format, ##__VA_ARGS__)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CUTILS_LOG_GATE_H__ */
@@ -0,0 +1,606 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define OS_MEMORY_TAG OS_MEMTAG_LOOPER
+
+#include <string.h>
+
+#include "cutils/os_alloc.h"
+#include "msgutils/cutils/os_time.h"
+#include "cutils/log_gate.h"
+#include "msgutils/cutils/common_list.h"
+#include "cutils/timer_heap.h"
+#include "cutils/mpmc_queue.h"
+#include "cutils/looper.h"
+
+#define TAG "looper"
+
+struct looper_message {
+    struct message msg;             // must be first, callers only see it
+    struct listnode node;           // in ready list, or collected for removal
+    struct timer_heap_node delay;   // in delayed heap until due
+    struct timer_heap_node timeout; // in timeout heap until handled
+    struct looper *owner;           // pool the message returns to, if any
+    enum looper_priority prio;
+    unsigned long long ready_us;    // when it entered its lane
+};
+
+struct looper_lane {
+    struct listnode ready;          // due messages in handling order
+    int depth;
+    int max_depth;
+    unsigned long long handled;
+    unsigned long long wait_us_total;
+    unsigned long long wait_us_max;
+};
+
+static const char *sLaneNames[LOOPER_PRIO_COUNT] = { "control", "normal", "bulk" };
+
+struct looper {
+    char *name;
+    struct os_threadattr attr;
+    message_handle_cb handle_cb;
+    message_free_cb free_cb;
+    os_mutex_t mutex;
+    os_cond_t cond;
+    os_thread_t thread;
+    bool exit;
+    bool sleeping;
+    struct looper_lane lanes[LOOPER_PRIO_COUNT];
+    int ready_count;                // in all lanes
+    struct looper_sched_attr sched;
+    int credits[LOOPER_PRIO_COUNT]; // left in this round when weighted
+    struct timer_heap delayed;      // not yet due, by due time
+    struct timer_heap timeouts;     // with timeout_ms, by expiry time
+    mpmc_queue_t pool;              // free messages, NULL if disabled
+    int outstanding;                // obtained from the pool and not freed yet, accessed atomically
+    struct looper_pool_stats pool_stats;
+};
+
+static inline struct looper_message *message_node(struct message *msg)
+{
+    return (struct looper_message *)msg;
+}
+
+static struct message *message_init(struct looper_message *node, int what, int arg1, int arg2, void *data,
+                                    unsigned long timeout_ms, message_handle_cb handle_cb,
+                                    message_free_cb free_cb, message_timeout_cb timeout_cb)
+{
+    node->msg.what = what;
+    node->msg.arg1 = arg1;
+    node->msg.arg2 = arg2;
+    node->msg.data = data;
+    node->msg.timeout_ms = timeout_ms;
+    node->msg.handle_cb = handle_cb;
+    node->msg.free_cb = free_cb;
+    node->msg.timeout_cb = timeout_cb;
+    list_init(&node->node);
+    timer_heap_node_init(&node->delay);
+    timer_heap_node_init(&node->timeout);
+    node->prio = LOOPER_PRIO_NORMAL;
+    return &node->msg;
+}
+
+void looper_message_set_priority(struct message *msg, enum looper_priority prio)
+{
+    if (prio >= LOOPER_PRIO_CONTROL && prio < LOOPER_PRIO_COUNT)
+        message_node(msg)->prio = prio;
+}
+
+struct message *looper_message_obtain(int what, int arg1, int arg2, void *data)
+{
+    return looper_message_obtain2(what, arg1, arg2, data, 0, NULL, NULL, NULL);
+}
+
+struct message *looper_message_obtain2(int what, int arg1, int arg2, void *data, unsigned long timeout_ms,
+                                       message_handle_cb handle_cb, message_free_cb free_cb, message_timeout_cb timeout_cb)
+{
+    struct looper_message *node = OS_CALLOC(1, sizeof(struct looper_message));
+    if (node == NULL) {
+        OS_LOGE(TAG, "Failed to allocate message");
+        return NULL;
+    }
+    return message_init(node, what, arg1, arg2, data, timeout_ms, handle_cb, free_cb, timeout_cb);
+}
+
+struct message *looper_obtain_message(looper_t looper, int what, int arg1, int arg2, void *data)
+{
+    return looper_obtain_message2(looper, what, arg1, arg2, data, 0, NULL, NULL, NULL);
+}
+
+struct message *looper_obtain_message2(looper_t looper, int what, int arg1, int arg2, void *data, unsigned long timeout_ms,
+                                       message_handle_cb handle_cb, message_free_cb free_cb, message_timeout_cb timeout_cb)
+{
+    struct looper_message *node = NULL;
+    if (looper->pool != NULL) {
+        if (mpmc_queue_receive(looper->pool, (char *)&node, 0) == 0)
+            __atomic_add_fetch(&looper->pool_stats.hits, 1, __ATOMIC_RELAXED);
+        else
+            __atomic_add_fetch(&looper->pool_stats.misses, 1, __ATOMIC_RELAXED);
+    }
+    if (node == NULL) {
+        node = OS_MALLOC(sizeof(struct looper_message));
+        if (node == NULL) {
+            OS_LOGE(TAG, "[%s] Failed to allocate message", looper->name);
+            return NULL;
+        }
+    }
+    node->owner = looper;
+    __atomic_add_fetch(&looper->outstanding, 1, __ATOMIC_RELAXED);
+    return message_init(node, what, arg1, arg2, data, timeout_ms, handle_cb, free_cb, timeout_cb);
+}
+
+static void message_free(struct looper *looper, struct looper_message *node)
+{
+    if (node->msg.free_cb != NULL)
+        node->msg.free_cb(&node->msg);
+    else if (looper->free_cb != NULL)
+        looper->free_cb(&node->msg);
+    if (node->owner == looper)
+        __atomic_sub_fetch(&looper->outstanding, 1, __ATOMIC_RELEASE);
+    if (node->owner == looper && looper->pool != NULL) {
+        if (mpmc_queue_send(looper->pool, (char *)&node, 0) == 0) {
+            __atomic_add_fetch(&looper->pool_stats.recycled, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        __atomic_add_fetch(&looper->pool_stats.released, 1, __ATOMIC_RELAXED);
+    }
+    OS_FREE(node);
+}
+
+static void pool_destroy(struct looper *looper)
+{
+    if (looper->pool == NULL)
+        return;
+    struct looper_message *node = NULL;
+    while (mpmc_queue_receive(looper->pool, (char *)&node, 0) == 0)
+        OS_FREE(node);
+    mpmc_queue_destroy(looper->pool);
+    looper->pool = NULL;
+}
+
+int looper_set_pool_size(looper_t looper, unsigned int size)
+{
+    pool_destroy(looper);
+    if (size == 0)
+        return 0;
+    looper->pool = mpmc_queue_create(sizeof(struct looper_message *), size);
+    return looper->pool != NULL ? 0 : -1;
+}
+
+void looper_get_pool_stats(looper_t looper, struct looper_pool_stats *stats)
+{
+    stats->hits = __atomic_load_n(&looper->pool_stats.hits, __ATOMIC_RELAXED);
+    stats->misses = __atomic_load_n(&looper->pool_stats.misses, __ATOMIC_RELAXED);
+    stats->recycled = __atomic_load_n(&looper->pool_stats.recycled, __ATOMIC_RELAXED);
+    stats->released = __atomic_load_n(&looper->pool_stats.released, __ATOMIC_RELAXED);
+}
+
+int looper_set_sched(looper_t looper, struct looper_sched_attr *attr)
+{
+    int prio;
+    for (prio = LOOPER_PRIO_CONTROL; prio < LOOPER_PRIO_COUNT; prio++) {
+        if (attr->weights[prio] < 1)
+            return -1;
+    }
+    OS_THREAD_MUTEX_LOCK(looper->mutex);
+    looper->sched = *attr;
+    for (prio = LOOPER_PRIO_CONTROL; prio < LOOPER_PRIO_COUNT; prio++)
+        looper->credits[prio] = attr->weights[prio];
+    OS_THREAD_MUTEX_UNLOCK(looper->mutex);
+    return 0;
+}
+
+void looper_get_lane_stats(looper_t looper, enum looper_priority prio, struct looper_lane_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (prio < LOOPER_PRIO_CONTROL || prio >= LOOPER_PRIO_COUNT)
+        return;
+    OS_THREAD_MUTEX_LOCK(looper->mutex);
+    struct looper_lane *lane = &looper->lanes[prio];
+    stats->depth = lane->depth;
+    stats->max_depth = lane->max_depth;
+    stats->handled = lane->handled;
+    stats->wait_us_avg = lane->handled > 0 ? lane->wait_us_total / lane->handled : 0;
+    stats->wait_us_max = lane->wait_us_max;
+    OS_THREAD_MUTEX_UNLOCK(looper->mutex);
+}
+
+// Take the message out of wherever it's queued, with looper locked
+static void message_unlink(struct looper *looper, struct looper_message *node)
+{
+    if (timer_heap_node_queued(&node->delay)) {
+        timer_heap_remove(&looper->delayed, &node->delay);
+    } else {
+        list_remove(&node->node);
+        list_init(&node->node);
+        looper->lanes[node->prio].depth--;
+        looper->ready_count--;
+    }
+    timer_heap_remove(&looper->timeouts, &node->timeout);
+}
+
+static void lane_push(struct looper *looper, struct looper_message *node, bool front, unsigned long long now)
+{
+    struct looper_lane *lane = &looper->lanes[node->prio];
+    node->ready_us = now;
+    if (front)
+        list_add_head(&lane->ready, &node->node);
+    else
+        list_add_tail(&lane->ready, &node->node);
+    if (++lane->depth > lane->max_depth)
+        lane->max_depth = lane->depth;
+    looper->ready_count++;
+}
+
+static inline struct looper_message *lane_head(struct looper *looper, int prio)
+{
+    struct looper_lane *lane = &looper->lanes[prio];
+    if (list_empty(&lane->ready))
+        return NULL;
+    return node_to_item(list_head(&lane->ready), struct looper_message, node);
+}
+
+// Next message to handle, with looper locked
+static struct looper_message *lane_pick(struct looper *looper, unsigned long long now)
+{
+    struct looper_message *node, *oldest = NULL;
+    int prio;
+    if (looper->ready_count == 0)
+        return NULL;
+    // A lane kept waiting too long goes first, whatever its priority
+    if (looper->sched.starvation_ms > 0) {
+        unsigned long long limit_us = (unsigned long long)looper->sched.starvation_ms * 1000;
+        for (prio = LOOPER_PRIO_CONTROL; prio < LOOPER_PRIO_COUNT; prio++) {
+            node = lane_head(looper, prio);
+            if (node != NULL && now - node->ready_us >= limit_us &&
+                (oldest == NULL || node->ready_us < oldest->ready_us))
+                oldest = node;
+        }
+        if (oldest != NULL)
+            return oldest;
+    }
+    if (!looper->sched.weighted) {
+        for (prio = LOOPER_PRIO_CONTROL; prio < LOOPER_PRIO_COUNT; prio++) {
+            node = lane_head(looper, prio);
+            if (node != NULL)
+                return node;
+        }
+        return NULL;
+    }
+    // Weighted, the highest lane with credit left, a new round when all
+    // waiting lanes used theirs
+    int round;
+    for (round = 0; round < 2; round++) {
+        for (prio = LOOPER_PRIO_CONTROL; prio < LOOPER_PRIO_COUNT; prio++) {
+            node = lane_head(looper, prio);
+            if (node != NULL && looper->credits[prio] > 0) {
+                looper->credits[prio]--;
+                return node;
+            }
+        }
+        for (prio = LOOPER_PRIO_CONTROL; prio < LOOPER_PRIO_COUNT; prio++)
+            looper->credits[prio] = looper->sched.weights[prio];
+    }
+    return NULL;
+}
+
+static void *looper_thread(void *arg)
+{
+    struct looper *looper = (struct looper *)arg;
+    OS_THREAD_MUTEX_LOCK(looper->mutex);
+    while (!looper->exit) {
+        unsigned long long now = OS_MONOTONIC_USEC();
+        struct timer_heap_node *top;
+        while ((top = timer_heap_top(&looper->delayed)) != NULL && top->deadline <= now) {
+            struct looper_message *node = node_to_item(top, struct looper_message, delay);
+            timer_heap_pop(&looper->delayed);
+            lane_push(looper, node, false, now);
+        }
+
+        struct looper_message *node = NULL;
+        bool expired = false;
+        top = timer_heap_top(&looper->timeouts);
+        if (top != NULL && top->deadline <= now) {
+            node = node_to_item(top, struct looper_message, timeout);
+            expired = true;
+        } else {
+            node = lane_pick(looper, now);
+        }
+        if (node != NULL) {
+            message_unlink(looper, node);
+            if (!expired) {
+                struct looper_lane *lane = &looper->lanes[node->prio];
+                unsigned long long wait_us = now - node->ready_us;
+                lane->handled++;
+                lane->wait_us_total += wait_us;
+                if (wait_us > lane->wait_us_max)
+                    lane->wait_us_max = wait_us;
+            }
+            OS_THREAD_MUTEX_UNLOCK(looper->mutex);
+            if (expired) {
+                if (node->msg.timeout_cb != NULL)
+                    node->msg.timeout_cb(&node->msg);
+            } else if (node->msg.handle_cb != NULL) {
+                node->msg.handle_cb(&node->msg);
+            } else if (looper->handle_cb != NULL) {
+                looper->handle_cb(&node->msg);
+            }
+            message_free(looper, node);
+            OS_THREAD_MUTEX_LOCK(looper->mutex);
+            continue;
+        }
+
+        // Sleep until the earliest due time or expiry, posts wake us earlier
+        unsigned long long deadline = 0;
+        top = timer_heap_top(&looper->delayed);
+        if (top != NULL)
+            deadline = top->deadline;
+        top = timer_heap_top(&looper->timeouts);
+        if (top != NULL && (deadline == 0 || top->deadline < deadline))
+            deadline = top->deadline;
+        looper->sleeping = true;
+        if (deadline == 0)
+            OS_THREAD_COND_WAIT(looper->cond, looper->mutex);
+        else
+            OS_THREAD_COND_TIMEDWAIT(looper->cond, looper->mutex, (unsigned long)(deadline - now));
+        looper->sleeping = false;
+    }
+    OS_THREAD_MUTEX_UNLOCK(looper->mutex);
+    return NULL;
+}
+
+looper_t looper_create(struct os_threadattr *attr, message_handle_cb handle_cb, message_free_cb free_cb)
+{
+    struct looper *looper = OS_CALLOC(1, sizeof(struct looper));
+    if (looper == NULL)
+        return NULL;
+    looper->name = OS_STRDUP(attr->name != NULL ? attr->name : "looper");
+    looper->attr = *attr;
+    looper->attr.name = looper->name;
+    looper->attr.joinable = true;
+    looper->handle_cb = handle_cb;
+    looper->free_cb = free_cb;
+    looper->mutex = OS_THREAD_MUTEX_CREATE();
+    looper->cond = OS_THREAD_COND_CREATE();
+    int prio;
+    for (prio = LOOPER_PRIO_CONTROL; prio < LOOPER_PRIO_COUNT; prio++)
+        list_init(&looper->lanes[prio].ready);
+    struct looper_sched_attr sched = LOOPER_SCHED_DEFAULT;
+    looper->sched = sched;
+    timer_heap_init(&looper->delayed);
+    timer_heap_init(&looper->timeouts);
+    if (looper->name == NULL || looper->mutex == NULL || looper->cond == NULL ||
+        looper_set_pool_size(looper, LOOPER_POOL_SIZE_DEFAULT) != 0) {
+        looper_destroy(looper);
+        return NULL;
+    }
+    return looper;
+}
+
+void looper_destroy(looper_t looper)
+{
+    if (looper == NULL)
+        return;
+    looper_stop(looper);
+    if (looper->mutex != NULL)
+        looper_remove_message_if(looper, NULL);
+    // Messages held by callers point to the looper, leak it rather than leave them dangling
+    int outstanding = __atomic_load_n(&looper->outstanding, __ATOMIC_ACQUIRE);
+    if (outstanding != 0) {
+        OS_LOGE(TAG, "[%s] Refuse to destroy looper with %d obtained messages", looper->name, outstanding);
+        return;
+    }
+    pool_destroy(looper);
+    timer_heap_deinit(&looper->delayed);
+    timer_heap_deinit(&looper->timeouts);
+    if (looper->cond != NULL)
+        OS_THREAD_COND_DESTROY(looper->cond);
+    if (looper->mutex != NULL)
+        OS_THREAD_MUTEX_DESTROY(looper->mutex);
+    OS_FREE(looper->name);
+    OS_FREE(looper);
+}
+
+int looper_start(looper_t looper)
+{
+    OS_THREAD_MUTEX_LOCK(looper->mutex);
+    if (looper->thread != NULL) {
+        OS_THREAD_MUTEX_UNLOCK(looper->mutex);
+        return 0;
+    }
+    looper->exit = false;
+    looper->thread = OS_THREAD_CREATE(&looper->attr, looper_thread, looper);
+    OS_THREAD_MUTEX_UNLOCK(looper->mutex);
+    if (looper->thread == NULL) {
+        OS_LOGE(TAG, "[%s] Failed to create looper thread", looper->name);
+        return -1;
+    }
+    return 0;
+}
+
+void looper_stop(looper_t looper)
+{
+    OS_THREAD_MUTEX_LOCK(looper->mutex);
+    os_thread_t thread = looper->thread;
+    looper->thread = NULL;
+    looper->exit = true;
+    OS_THREAD_COND_SIGNAL(looper->cond);
+    OS_THREAD_MUTEX_UNLOCK(looper->mutex);
+    if (thread != NULL)
+        OS_THREAD_JOIN(thread, NULL);
+}
+
+int looper_message_count(looper_t looper)
+{
+    OS_THREAD_MUTEX_LOCK(looper->mutex);
+    int count = looper->ready_count + looper->delayed.count;
+    OS_THREAD_MUTEX_UNLOCK(looper->mutex);
+    return count;
+}
+
+void looper_dump(looper_t looper)
+{
+    OS_THREAD_MUTEX_LOCK(looper->mutex);
+    unsigned long long now = OS_MONOTONIC_USEC();
+    struct timer_heap_node *next = timer_heap_top(&looper->delayed);
+    OS_LOGI(TAG, "[%s] ready:%d, delayed:%d, with timeout:%d, next due in:%lldms",
+            looper->name, looper->ready_count, looper->delayed.count, looper->timeouts.count,
+            next != NULL ? ((long long)next->deadline - (long long)now) / 1000 : -1LL);
+    struct looper_pool_stats stats;
+    looper_get_pool_stats(looper, &stats);
+    unsigned long long obtained = stats.hits + stats.misses;
+    OS_LOGI(TAG, "[%s] pool cached:%u, hits:%llu, misses:%llu, hit rate:%llu%%, released:%llu",
+            looper->name, looper->pool != NULL ? mpmc_queue_count_filled(looper->pool) : 0,
+            stats.hits, stats.misses, obtained > 0 ? stats.hits * 100 / obtained : 0, stats.released);
+    struct listnode *item;
+    int prio;
+    for (prio = LOOPER_PRIO_CONTROL; prio < LOOPER_PRIO_COUNT; prio++) {
+        struct looper_lane *lane = &looper->lanes[prio];
+        OS_LOGI(TAG, "[%s] lane %s: depth:%d, max depth:%d, handled:%llu, wait avg:%lluus, max:%lluus",
+                looper->name, sLaneNames[prio], lane->depth, lane->max_depth, lane->handled,
+                lane->handled > 0 ? lane->wait_us_total / lane->handled : 0, lane->wait_us_max);
+        list_for_each(item, &lane->ready) {
+            struct looper_message *node = node_to_item(item, struct looper_message, node);
+            OS_LOGI(TAG, "  ready: what=%d, arg1=%d, arg2=%d, waiting:%lldms", node->msg.what, node->msg.arg1,
+                    node->msg.arg2, (long long)(now - node->ready_us) / 1000);
+        }
+    }
+    int i;
+    for (i = 0; i < looper->delayed.count; i++) {
+        struct looper_message *node = node_to_item(looper->delayed.nodes[i], struct looper_message, delay);
+        OS_LOGI(TAG, "  delayed: what=%d, arg1=%d, arg2=%d, due in:%lldms", node->msg.what, node->msg.arg1,
+                node->msg.arg2, ((long long)node->delay.deadline - (long long)now) / 1000);
+    }
+    OS_THREAD_MUTEX_UNLOCK(looper->mutex);
+}
+
+static int looper_enqueue(struct looper *looper, struct message *msg, unsigned long msec, bool front)
+{
+    if (msg == NULL)
+        return -1;
+    struct looper_message *node = message_node(msg);
+    unsigned long long now = OS_MONOTONIC_USEC();
+    unsigned long long due = now + (unsigned long long)msec * 1000;
+    bool wake = false;
+
+    OS_THREAD_MUTEX_LOCK(looper->mutex);
+    if (msec > 0) {
+        if (timer_heap_push(&looper->delayed, &node->delay, due) != 0)
+            goto fail;
+        // Only a new earliest due time changes how long the thread sleeps
+        wake = timer_heap_top(&looper->delayed) == &node->delay;
+    } else {
+        lane_push(looper, node, front, now);
+        wake = true;
+    }
+    if (msg->timeout_ms > 0) {
+        if (timer_heap_push(&looper->timeouts, &node->timeout, due + (unsigned long long)msg->timeout_ms * 1000) != 0) {
+            message_unlink(looper, node);
+            goto fail;
+        }
+        wake = wake || timer_heap_top(&looper->timeouts) == &node->timeout;
+    }
+    if (wake && looper->sleeping)
+        OS_THREAD_COND_SIGNAL(looper->cond);
+    OS_THREAD_MUTEX_UNLOCK(looper->mutex);
+    return 0;
+
+fail:
+    OS_THREAD_MUTEX_UNLOCK(looper->mutex);
+    OS_LOGE(TAG, "[%s] Failed to queue message what=%d", looper->name, msg->what);
+    return -1;
+}
+
+int looper_post_message(looper_t looper, struct message *msg)
+{
+    return looper_enqueue(looper, msg, 0, false);
+}
+
+void looper_message_release(looper_t looper, struct message *msg)
+{
+    if (msg != NULL)
+        message_free(looper, message_node(msg));
+}
+
+int looper_post_message_front(looper_t looper, struct message *msg)
+{
+    return looper_enqueue(looper, msg, 0, true);
+}
+
+int looper_post_message_delay(looper_t looper, struct message *msg, unsigned long msec)
+{
+    return looper_enqueue(looper, msg, msec, false);
+}
+
+static inline bool message_match(struct message *msg, const int *match_what, message_match_cb match_cb)
+{
+    if (match_what != NULL)
+        return msg->what == *match_what;
+    return match_cb == NULL || match_cb(msg);
+}
+
+// NULL match_what and match_cb removes all
+static int looper_remove(struct looper *looper, const int *match_what, message_match_cb match_cb)
+{
+    struct listnode removed, *item, *tmp;
+    list_init(&removed);
+
+    OS_THREAD_MUTEX_LOCK(looper->mutex);
+    int prio;
+    for (prio = LOOPER_PRIO_CONTROL; prio < LOOPER_PRIO_COUNT; prio++) {
+        list_for_each_safe(item, tmp, &looper->lanes[prio].ready) {
+            struct looper_message *node = node_to_item(item, struct looper_message, node);
+            if (!message_match(&node->msg, match_what, match_cb))
+                continue;
+            message_unlink(looper, node);
+            list_add_tail(&removed, &node->node);
+        }
+    }
+    // Collect first, removing reorders the heap under the scan. Delayed
+    // messages aren't linked in any list meanwhile
+    struct listnode delayed;
+    list_init(&delayed);
+    int i;
+    for (i = 0; i < looper->delayed.count; i++) {
+        struct looper_message *node = node_to_item(looper->delayed.nodes[i], struct looper_message, delay);
+        if (message_match(&node->msg, match_what, match_cb))
+            list_add_tail(&delayed, &node->node);
+    }
+    list_for_each_safe(item, tmp, &delayed) {
+        struct looper_message *node = node_to_item(item, struct looper_message, node);
+        list_remove(&node->node);
+        message_unlink(looper, node);
+        list_add_tail(&removed, &node->node);
+    }
+    OS_THREAD_MUTEX_UNLOCK(looper->mutex);
+
+    list_for_each_safe(item, tmp, &removed) {
+        struct looper_message *node = node_to_item(item, struct looper_message, node);
+        message_free(looper, node);
+    }
+    return 0;
+}
+
+int looper_remove_message(looper_t looper, int what)
+{
+    return looper_remove(looper, &what, NULL);
+}
+
+int looper_remove_message_if(looper_t looper, message_match_cb match_cb)
+{
+    return looper_remove(looper, NULL, match_cb);
+}
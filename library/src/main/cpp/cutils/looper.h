@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CUTILS_LOOPER_H__
+#define __CUTILS_LOOPER_H__
+
+#include <stdbool.h>
+#include "msgutils/cutils/os_thread.h"
+#include "msgutils/cutils/msglooper.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct looper *looper_t;
+
+/**
+ * Message looper with the calls and struct message of msglooper, delayed
+ * messages and message timeouts are kept in timer heaps instead of sorted
+ * lists: posting with a delay and removing a timed out message are O(log n),
+ * the next deadline is O(1), however many messages are pending.
+ *
+ * Messages must come from looper_message_obtain()/looper_message_obtain2(),
+ * not message_obtain(). A message is handled by msg->handle_cb, or the looper
+ * handle_cb if NULL, then freed with msg->free_cb, or the looper free_cb if
+ * NULL. A message with timeout_ms that isn't handled within timeout_ms after
+ * it's due is passed to msg->timeout_cb instead, then freed.
+ */
+struct message *looper_message_obtain(int what, int arg1, int arg2, void *data);
+struct message *looper_message_obtain2(int what, int arg1, int arg2, void *data, unsigned long timeout_ms,
+                                       message_handle_cb handle_cb, message_free_cb free_cb, message_timeout_cb timeout_cb);
+
+/**
+ * Same as above, but taken from the message pool of the looper and put back
+ * there once handled, so posting is allocation-free in steady state. Such a
+ * message must be posted to that looper only. The pool is a lock-free queue,
+ * messages can be obtained from any thread.
+ */
+struct message *looper_obtain_message(looper_t looper, int what, int arg1, int arg2, void *data);
+struct message *looper_obtain_message2(looper_t looper, int what, int arg1, int arg2, void *data, unsigned long timeout_ms,
+                                       message_handle_cb handle_cb, message_free_cb free_cb, message_timeout_cb timeout_cb);
+
+/**
+ * Due messages wait in one lane per priority, so control messages aren't
+ * stuck behind bulk work already queued. Lanes are served strictly by
+ * priority, or by weight when weighted is set; in both cases a lane whose
+ * oldest message has waited starvation_ms is served next. Set the priority
+ * before posting, default is LOOPER_PRIO_NORMAL.
+ */
+enum looper_priority {
+    LOOPER_PRIO_CONTROL = 0,
+    LOOPER_PRIO_NORMAL,
+    LOOPER_PRIO_BULK,
+    LOOPER_PRIO_COUNT,
+};
+
+struct looper_sched_attr {
+    bool weighted;                  // false for strict priority
+    int weights[LOOPER_PRIO_COUNT]; // messages of each lane per round when weighted, at least 1
+    unsigned long starvation_ms;    // 0 disables starvation protection
+};
+
+#define LOOPER_SCHED_DEFAULT { false, { 8, 4, 1 }, 100 }
+
+struct looper_lane_stats {
+    int depth;                      // messages waiting now
+    int max_depth;
+    unsigned long long handled;
+    unsigned long long wait_us_avg; // from due to handled
+    unsigned long long wait_us_max;
+};
+
+void looper_message_set_priority(struct message *msg, enum looper_priority prio);
+
+#define LOOPER_POOL_SIZE_DEFAULT 32
+
+struct looper_pool_stats {
+    unsigned long long hits;     // obtained from the pool
+    unsigned long long misses;   // allocated, the pool was empty
+    unsigned long long recycled; // put back into the pool
+    unsigned long long released; // freed, the pool was full
+};
+
+looper_t looper_create(struct os_threadattr *attr, message_handle_cb handle_cb, message_free_cb free_cb);
+
+// Pending messages are freed without being handled. Refused, leaving the
+// looper stopped, while messages obtained from its pool are neither posted
+// nor released
+void looper_destroy(looper_t looper);
+
+// Max messages kept for reuse, rounded up to a power of two, 0 disables the
+// pool. Call before obtaining messages from the looper
+int looper_set_pool_size(looper_t looper, unsigned int size);
+
+void looper_get_pool_stats(looper_t looper, struct looper_pool_stats *stats);
+
+int looper_set_sched(looper_t looper, struct looper_sched_attr *attr);
+
+void looper_get_lane_stats(looper_t looper, enum looper_priority prio, struct looper_lane_stats *stats);
+
+int looper_start(looper_t looper);
+
+// Returns after the message being handled, pending messages are kept
+void looper_stop(looper_t looper);
+
+int looper_message_count(looper_t looper);
+
+void looper_dump(looper_t looper);
+
+int looper_post_message(looper_t looper, struct message *msg);
+
+// Free a message that won't be posted, e.g. after a failed post, with
+// msg->free_cb or the looper free_cb like a handled one
+void looper_message_release(looper_t looper, struct message *msg);
+
+// Ahead of the messages of the same priority
+int looper_post_message_front(looper_t looper, struct message *msg);
+
+int looper_post_message_delay(looper_t looper, struct message *msg, unsigned long msec);
+
+// Pending messages matched are freed without being handled
+int looper_remove_message(looper_t looper, int what);
+
+int looper_remove_message_if(looper_t looper, message_match_cb match_cb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CUTILS_LOOPER_H__ */
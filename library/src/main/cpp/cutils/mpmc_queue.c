@@ -0,0 +1,401 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define OS_MEMORY_TAG OS_MEMTAG_QUEUE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sched.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include "cutils/os_alloc.h"
+#include "msgutils/cutils/os_time.h"
+#include "cutils/log_gate.h"
+#include "cutils/os_futex.h"
+#include "cutils/mpmc_queue.h"
+
+#define TAG "mpmc_queue"
+
+#define CACHELINE_SIZE 64
+
+// Polls of a full or empty queue before sleeping, a peer running on another
+// core is often just about to catch up and both sides save the futex syscalls.
+// Pointless with one core online, the peer can't run meanwhile
+#define QUEUE_SPIN_COUNT 128
+
+#if defined(__aarch64__) || defined(__arm__)
+    #define cpu_relax() __asm__ __volatile__("yield" ::: "memory")
+#elif defined(__i386__) || defined(__x86_64__)
+    #define cpu_relax() __builtin_ia32_pause()
+#else
+    #define cpu_relax() __atomic_signal_fence(__ATOMIC_SEQ_CST)
+#endif
+
+struct mpmc_queue {
+    // Producers
+    unsigned int enqueue_pos __attribute__((aligned(CACHELINE_SIZE)));
+    int senders_waiting;        // futex word, 1 while senders may sleep on a full queue
+    // Consumers
+    unsigned int dequeue_pos __attribute__((aligned(CACHELINE_SIZE)));
+    int receivers_waiting;      // futex word, 1 while receivers may sleep on an empty queue
+    // Read only after creation
+    unsigned int mask __attribute__((aligned(CACHELINE_SIZE)));
+    unsigned int msg_size;
+    unsigned int slot_size;     // sequence plus message, rounded to 8 bytes
+    int spins;
+    struct mpmc_queueset *set;  // accessed atomically
+    char *slots;
+};
+
+struct mpmc_queueset {
+    struct mpmc_queue *ready;   // queues posted by send, one per message
+    int pending;                // posts not selected yet
+    int efd;                    // readable while pending isn't 0
+};
+
+static inline unsigned int *slot_seq(struct mpmc_queue *queue, unsigned int pos)
+{
+    return (unsigned int *)(queue->slots + (size_t)(pos & queue->mask) * queue->slot_size);
+}
+
+static inline char *slot_msg(unsigned int *seq)
+{
+    return (char *)seq + sizeof(unsigned long long);
+}
+
+// 0 for os_futex_wait to wait forever
+static unsigned long long queue_deadline(unsigned int timeout_ms)
+{
+    if (timeout_ms == MPMC_QUEUE_WAIT_FOREVER)
+        return 0;
+    return OS_MONOTONIC_USEC() + (unsigned long long)timeout_ms * 1000;
+}
+
+// Pairs with the fence in queue_wait. All sleepers are woken and the word
+// cleared, so a burst of messages costs one syscall, not one per message
+static void queue_wake(int *waiting)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiting, __ATOMIC_RELAXED) != 0 &&
+        __atomic_exchange_n(waiting, 0, __ATOMIC_ACQ_REL) != 0)
+        os_futex_wake(waiting, INT_MAX);
+}
+
+mpmc_queue_t mpmc_queue_create(unsigned int msg_size, unsigned int msg_count)
+{
+    if (msg_size == 0 || msg_count == 0 || msg_count > (1U << 30))
+        return NULL;
+    unsigned int capacity = 1;
+    while (capacity < msg_count)
+        capacity <<= 1;
+    struct mpmc_queue *queue = NULL;
+    if (posix_memalign((void **)&queue, CACHELINE_SIZE, sizeof(struct mpmc_queue)) != 0)
+        return NULL;
+    memset(queue, 0, sizeof(struct mpmc_queue));
+    queue->mask = capacity - 1;
+    queue->msg_size = msg_size;
+    queue->slot_size = (sizeof(unsigned long long) + msg_size + 7) & ~7U;
+    queue->spins = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? QUEUE_SPIN_COUNT : 0;
+    queue->slots = OS_MALLOC((size_t)capacity * queue->slot_size);
+    if (queue->slots == NULL) {
+        free(queue);
+        return NULL;
+    }
+    mpmc_queue_reset(queue);
+    return queue;
+}
+
+int mpmc_queue_destroy(mpmc_queue_t queue)
+{
+    if (queue == NULL)
+        return -1;
+    if (__atomic_load_n(&queue->set, __ATOMIC_ACQUIRE) != NULL) {
+        OS_LOGE(TAG, "Queue is still member of a set");
+        return -1;
+    }
+    OS_FREE(queue->slots);
+    free(queue);
+    return 0;
+}
+
+int mpmc_queue_reset(mpmc_queue_t queue)
+{
+    if (queue == NULL)
+        return -1;
+    unsigned int i;
+    for (i = 0; i <= queue->mask; i++)
+        __atomic_store_n(slot_seq(queue, i), i, __ATOMIC_RELAXED);
+    __atomic_store_n(&queue->enqueue_pos, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&queue->dequeue_pos, 0, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static int queue_try_send(struct mpmc_queue *queue, const char *msg);
+
+static void queueset_signal(struct mpmc_queueset *set)
+{
+    unsigned long long one = 1;
+    if (write(set->efd, &one, sizeof(one)) != sizeof(one))
+        OS_LOGE(TAG, "Failed to signal queue set");
+}
+
+// Clear the eventfd once pending drops to 0, signal again if a post raced in
+static void queueset_rearm(struct mpmc_queueset *set)
+{
+    unsigned long long count;
+    if (read(set->efd, &count, sizeof(count)) != sizeof(count))
+        return;
+    if (__atomic_load_n(&set->pending, __ATOMIC_SEQ_CST) > 0)
+        queueset_signal(set);
+}
+
+// Only the first post of a burst costs a syscall
+static void queueset_post(struct mpmc_queueset *set, struct mpmc_queue *queue)
+{
+    // Set is sized to hold every message of its members, never full
+    if (queue_try_send(set->ready, (const char *)&queue) != 0) {
+        OS_LOGE(TAG, "Queue set overflow, message lost for select");
+        return;
+    }
+    if (__atomic_fetch_add(&set->pending, 1, __ATOMIC_SEQ_CST) == 0)
+        queueset_signal(set);
+}
+
+static int queue_try_send(struct mpmc_queue *queue, const char *msg)
+{
+    unsigned int pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+    while (1) {
+        unsigned int *seq = slot_seq(queue, pos);
+        int diff = (int)(__atomic_load_n(seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&queue->enqueue_pos, &pos, pos + 1,
+                                            true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                memcpy(slot_msg(seq), msg, queue->msg_size);
+                __atomic_store_n(seq, pos + 1, __ATOMIC_RELEASE);
+                break;
+            }
+        } else if (diff < 0) {
+            // Full, unless a receiver still copies out of this slot
+            if (__atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED) + queue->mask + 1 == pos)
+                return -1;
+            sched_yield();
+        } else {
+            pos = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+    queue_wake(&queue->receivers_waiting);
+    struct mpmc_queueset *set = __atomic_load_n(&queue->set, __ATOMIC_ACQUIRE);
+    if (set != NULL)
+        queueset_post(set, queue);
+    return 0;
+}
+
+static int queue_try_receive(struct mpmc_queue *queue, char *msg)
+{
+    unsigned int pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+    while (1) {
+        unsigned int *seq = slot_seq(queue, pos);
+        int diff = (int)(__atomic_load_n(seq, __ATOMIC_ACQUIRE) - (pos + 1));
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&queue->dequeue_pos, &pos, pos + 1,
+                                            true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                memcpy(msg, slot_msg(seq), queue->msg_size);
+                // Slot is free for the producer one lap later
+                __atomic_store_n(seq, pos + queue->mask + 1, __ATOMIC_RELEASE);
+                break;
+            }
+        } else if (diff < 0) {
+            // Empty, unless a sender still copies into this slot, a message
+            // sent after it may already be visible through the set
+            if (__atomic_load_n(&queue->enqueue_pos, __ATOMIC_RELAXED) == pos)
+                return -1;
+            sched_yield();
+        } else {
+            pos = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+    queue_wake(&queue->senders_waiting);
+    return 0;
+}
+
+// Sleep until ready() may hold, recheck after arming so no wake is missed
+static int queue_wait(struct mpmc_queue *queue, int *waiting,
+                      bool (*ready)(struct mpmc_queue *), unsigned long long deadline)
+{
+    int spins;
+    for (spins = 0; spins < queue->spins; spins++) {
+        if (ready(queue))
+            return 0;
+        cpu_relax();
+    }
+    __atomic_store_n(waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (ready(queue))
+        return 0;
+    return os_futex_wait(waiting, 1, deadline) == -ETIMEDOUT ? -1 : 0;
+}
+
+static bool queue_has_space(struct mpmc_queue *queue)
+{
+    return mpmc_queue_count_available(queue) > 0;
+}
+
+static bool queue_has_data(struct mpmc_queue *queue)
+{
+    return mpmc_queue_count_filled(queue) > 0;
+}
+
+int mpmc_queue_send(mpmc_queue_t queue, char *msg, unsigned int timeout_ms)
+{
+    if (queue_try_send(queue, msg) == 0)
+        return 0;
+    if (timeout_ms == 0)
+        return -1;
+    unsigned long long deadline = queue_deadline(timeout_ms);
+    while (queue_try_send(queue, msg) != 0) {
+        if (queue_wait(queue, &queue->senders_waiting, queue_has_space, deadline) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+int mpmc_queue_receive(mpmc_queue_t queue, char *msg, unsigned int timeout_ms)
+{
+    if (queue_try_receive(queue, msg) == 0)
+        return 0;
+    if (timeout_ms == 0)
+        return -1;
+    unsigned long long deadline = queue_deadline(timeout_ms);
+    while (queue_try_receive(queue, msg) != 0) {
+        if (queue_wait(queue, &queue->receivers_waiting, queue_has_data, deadline) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+unsigned int mpmc_queue_count_filled(mpmc_queue_t queue)
+{
+    unsigned int dequeue = __atomic_load_n(&queue->dequeue_pos, __ATOMIC_ACQUIRE);
+    unsigned int enqueue = __atomic_load_n(&queue->enqueue_pos, __ATOMIC_ACQUIRE);
+    int filled = (int)(enqueue - dequeue);
+    if (filled < 0)
+        return 0;
+    return (unsigned int)filled > queue->mask + 1 ? queue->mask + 1 : (unsigned int)filled;
+}
+
+unsigned int mpmc_queue_count_available(mpmc_queue_t queue)
+{
+    return queue->mask + 1 - mpmc_queue_count_filled(queue);
+}
+
+mpmc_queueset_t mpmc_queueset_create(unsigned int msg_count)
+{
+    struct mpmc_queueset *set = OS_CALLOC(1, sizeof(struct mpmc_queueset));
+    if (set == NULL)
+        return NULL;
+    set->ready = mpmc_queue_create(sizeof(struct mpmc_queue *), msg_count);
+    set->efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (set->ready == NULL || set->efd < 0) {
+        if (set->ready != NULL)
+            mpmc_queue_destroy(set->ready);
+        if (set->efd >= 0)
+            close(set->efd);
+        OS_FREE(set);
+        return NULL;
+    }
+    return set;
+}
+
+int mpmc_queueset_destroy(mpmc_queueset_t set)
+{
+    if (set == NULL)
+        return -1;
+    mpmc_queue_destroy(set->ready);
+    close(set->efd);
+    OS_FREE(set);
+    return 0;
+}
+
+int mpmc_queueset_add_queue(mpmc_queueset_t set, mpmc_queue_t queue)
+{
+    if (mpmc_queue_count_filled(queue) != 0)
+        return -1;
+    struct mpmc_queueset *expected = NULL;
+    if (!__atomic_compare_exchange_n(&queue->set, &expected, set, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        return -1;
+    return 0;
+}
+
+int mpmc_queueset_remove_queue(mpmc_queueset_t set, mpmc_queue_t queue)
+{
+    if (mpmc_queue_count_filled(queue) != 0)
+        return -1;
+    struct mpmc_queueset *expected = set;
+    if (!__atomic_compare_exchange_n(&queue->set, &expected, NULL, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        return -1;
+    return 0;
+}
+
+// Claim one post, posts are pushed before pending is raised
+static struct mpmc_queue *queueset_take(struct mpmc_queueset *set)
+{
+    int pending = __atomic_load_n(&set->pending, __ATOMIC_ACQUIRE);
+    while (pending > 0) {
+        if (__atomic_compare_exchange_n(&set->pending, &pending, pending - 1,
+                                        true, __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE)) {
+            if (pending == 1)
+                queueset_rearm(set);
+            struct mpmc_queue *queue = NULL;
+            if (queue_try_receive(set->ready, (char *)&queue) != 0)
+                return NULL;
+            return queue;
+        }
+    }
+    return NULL;
+}
+
+mpmc_queue_t mpmc_queueset_select_queue(mpmc_queueset_t set, unsigned int timeout_ms)
+{
+    unsigned long long deadline = queue_deadline(timeout_ms);
+    while (1) {
+        struct mpmc_queue *queue = queueset_take(set);
+        if (queue != NULL)
+            return queue;
+        // Drop a stale signal so neither we nor pollers of the fd spin on it
+        queueset_rearm(set);
+        if (timeout_ms == 0)
+            return NULL;
+        int wait_ms = -1;
+        if (deadline != 0) {
+            unsigned long long now = OS_MONOTONIC_USEC();
+            if (now >= deadline)
+                return NULL;
+            wait_ms = (int)((deadline - now + 999) / 1000);
+        }
+        struct pollfd pfd = { .fd = set->efd, .events = POLLIN, .revents = 0 };
+        if (poll(&pfd, 1, wait_ms) < 0 && errno != EINTR)
+            return NULL;
+    }
+}
+
+int mpmc_queueset_get_fd(mpmc_queueset_t set)
+{
+    return set->efd;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CUTILS_MPMC_QUEUE_H__
+#define __CUTILS_MPMC_QUEUE_H__
+
+#include <limits.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mpmc_queue *mpmc_queue_t;
+typedef struct mpmc_queueset *mpmc_queueset_t;
+
+/**
+ * Bounded lock-free queue of fixed size messages for any number of producer
+ * and consumer threads, same calls as msgqueue. Each slot carries a sequence
+ * number (Vyukov), so send and receive only contend on one atomic index each
+ * and never take a lock. Senders sleep on a futex only when full, receivers
+ * only when empty.
+ *
+ * msg_count is rounded up to a power of two. Send and receive return 0, or -1
+ * on timeout. As with msgqueue, timeout_ms 0 doesn't block, use
+ * MPMC_QUEUE_WAIT_FOREVER to block until done.
+ */
+#define MPMC_QUEUE_WAIT_FOREVER UINT_MAX
+
+mpmc_queue_t mpmc_queue_create(unsigned int msg_size, unsigned int msg_count);
+
+int mpmc_queue_destroy(mpmc_queue_t queue);
+
+// Drop all messages, no other thread may access the queue meanwhile
+int mpmc_queue_reset(mpmc_queue_t queue);
+
+int mpmc_queue_send(mpmc_queue_t queue, char *msg, unsigned int timeout_ms);
+
+int mpmc_queue_receive(mpmc_queue_t queue, char *msg, unsigned int timeout_ms);
+
+unsigned int mpmc_queue_count_available(mpmc_queue_t queue);
+
+unsigned int mpmc_queue_count_filled(mpmc_queue_t queue);
+
+/**
+ * Queue set with the semantics of mqueueset: every message sent to a member
+ * queue posts that queue to the set, select returns one posted queue and the
+ * caller receives one message from it. Posts are kept in a ready queue, so
+ * select costs the same however many queues are members. An eventfd is
+ * signaled when the set turns non-empty, select sleeps on it and it can be
+ * polled along with other fds.
+ *
+ * msg_count should be the total length of the member queues. Receive from a
+ * member only after select returned it.
+ */
+mpmc_queueset_t mpmc_queueset_create(unsigned int msg_count);
+
+int mpmc_queueset_destroy(mpmc_queueset_t set);
+
+// Queue must be empty and not member of another set
+int mpmc_queueset_add_queue(mpmc_queueset_t set, mpmc_queue_t queue);
+
+// Queue must be empty
+int mpmc_queueset_remove_queue(mpmc_queueset_t set, mpmc_queue_t queue);
+
+// NULL on timeout
+mpmc_queue_t mpmc_queueset_select_queue(mpmc_queueset_t set, unsigned int timeout_ms);
+
+// Readable while select would return a queue, may wake spuriously, in which
+// case select with timeout 0 returns NULL. Don't read it
+int mpmc_queueset_get_fd(mpmc_queueset_t set);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CUTILS_MPMC_QUEUE_H__ */
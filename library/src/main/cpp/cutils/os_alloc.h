@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CUTILS_OS_ALLOC_H__
+#define __CUTILS_OS_ALLOC_H__
+
+#include "msgutils/cutils/os_memory.h"
+
+//#define ENABLE_MEMORY_SLAB
+//#define ENABLE_MEMORY_ACCOUNTING
+
+#if defined(ENABLE_MEMORY_SLAB)
+#include "cutils/os_slab.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Allocator of in-tree code on top of msgutils os_memory.h, include this
+ * header instead of it. Unless one of the debug allocators of os_memory.h is
+ * enabled, OS_MALLOC and friends are counted per tag with
+ * ENABLE_MEMORY_ACCOUNTING defined (cutils/os_memstat.h), and come from the
+ * slab allocator with ENABLE_MEMORY_SLAB defined (cutils/os_slab.h). Whenever
+ * OS_MALLOC is remapped, OS_NEW/OS_DELETE construct objects in OS_MALLOC
+ * blocks, arrays still come from new[].
+ *
+ * The prebuilt libraries keep their own allocator, memory must not cross
+ * between them and OS_FREE unless the backend accepts foreign blocks.
+ */
+
+// Owners of OS_MALLOC memory, counted apart when ENABLE_MEMORY_ACCOUNTING is
+// defined. A source file picks its tag by defining OS_MEMORY_TAG before the
+// includes, single allocations can pass one to OS_MALLOC_TAG and friends.
+// Only in-tree allocations are seen, decoders and the ringbuf of the
+// prebuilt core allocate with their own malloc
+enum os_memtag {
+    OS_MEMTAG_MISC = 0,
+    OS_MEMTAG_RINGBUF,
+    OS_MEMTAG_QUEUE,
+    OS_MEMTAG_LOOPER,
+    OS_MEMTAG_DECODER,
+    OS_MEMTAG_HTTP,
+    OS_MEMTAG_MIXER,
+    OS_MEMTAG_SINK,
+    OS_MEMTAG_ARENA,
+    OS_MEMTAG_COUNT,
+};
+
+#ifndef OS_MEMORY_TAG
+#define OS_MEMORY_TAG OS_MEMTAG_MISC
+#endif
+
+#if defined(ENABLE_MEMORY_OVERFLOW_DETECT) || defined(ENABLE_MEMORY_LEAK_DETECT)
+    // Debug allocators of os_memory.h win
+
+#elif defined(ENABLE_MEMORY_ACCOUNTING)
+// Per-tag counters and sampled call stacks. Blocks come from the slab
+// allocator if ENABLE_MEMORY_SLAB is defined too, else from libc
+void *os_memstat_malloc(int tag, size_t size);
+void *os_memstat_calloc(int tag, size_t n, size_t size);
+void *os_memstat_realloc(int tag, void *ptr, size_t size);
+void os_memstat_free(void *ptr);
+char *os_memstat_strdup(int tag, const char *str);
+void os_memstat_dump(void);
+
+    #define OS_MEMORY_REMAPPED
+
+    #undef OS_MALLOC
+    #undef OS_CALLOC
+    #undef OS_REALLOC
+    #undef OS_FREE
+    #undef OS_STRDUP
+    #undef OS_MEMORY_DUMP
+    #define OS_MALLOC(size) os_memstat_malloc(OS_MEMORY_TAG, (size_t)(size))
+    #define OS_CALLOC(n, size) os_memstat_calloc(OS_MEMORY_TAG, (size_t)(n), (size_t)(size))
+    #define OS_REALLOC(ptr, size) os_memstat_realloc(OS_MEMORY_TAG, (void *)(ptr), (size_t)(size))
+    #define OS_FREE(ptr) \
+        do {\
+            if (ptr) {\
+                os_memstat_free((void *)(ptr));\
+                (ptr) = NULL;\
+            }\
+        } while (0)
+    #define OS_STRDUP(str) os_memstat_strdup(OS_MEMORY_TAG, (const char *)(str))
+    #define OS_MEMORY_DUMP() os_memstat_dump()
+
+    #define OS_MALLOC_TAG(tag, size) os_memstat_malloc((tag), (size_t)(size))
+    #define OS_CALLOC_TAG(tag, n, size) os_memstat_calloc((tag), (size_t)(n), (size_t)(size))
+    #define OS_STRDUP_TAG(tag, str) os_memstat_strdup((tag), (const char *)(str))
+
+#elif defined(ENABLE_MEMORY_SLAB)
+    #define OS_MEMORY_REMAPPED
+
+    #undef OS_MALLOC
+    #undef OS_CALLOC
+    #undef OS_REALLOC
+    #undef OS_FREE
+    #undef OS_STRDUP
+    #undef OS_MEMORY_DUMP
+    #define OS_MALLOC(size) os_slab_malloc((size_t)(size))
+    #define OS_CALLOC(n, size) os_slab_calloc((size_t)(n), (size_t)(size))
+    #define OS_REALLOC(ptr, size) os_slab_realloc((void *)(ptr), (size_t)(size))
+    #define OS_FREE(ptr) \
+        do {\
+            if (ptr) {\
+                os_slab_free((void *)(ptr));\
+                (ptr) = NULL;\
+            }\
+        } while (0)
+    #define OS_STRDUP(str) os_slab_strdup((const char *)(str))
+    #define OS_MEMORY_DUMP() os_slab_dump()
+#endif
+
+#if !defined(OS_MALLOC_TAG)
+    #define OS_MALLOC_TAG(tag, size) OS_MALLOC(size)
+    #define OS_CALLOC_TAG(tag, n, size) OS_CALLOC(n, size)
+    #define OS_STRDUP_TAG(tag, str) OS_STRDUP(str)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#if defined(__cplusplus) && defined(OS_MEMORY_REMAPPED) && !defined(ENABLE_CLASS_LEAK_DETECT)
+#include <new>
+#include <type_traits>
+#include <utility>
+
+template <typename T, typename... Args>
+static inline T *os_memory_new(Args&&... args)
+{
+    void *ptr = OS_MALLOC(sizeof(T));
+    return ptr != NULL ? new (ptr) T(std::forward<Args>(args)...) : NULL;
+}
+
+template <typename T>
+static inline void *os_memory_object(T *ptr, std::true_type) { return dynamic_cast<void *>(ptr); }
+template <typename T>
+static inline void *os_memory_object(T *ptr, std::false_type) { return (void *)ptr; }
+
+// Virtual destructors are honored, the block is found from the most derived object
+template <typename T>
+static inline void os_memory_delete(T *ptr)
+{
+    void *object = os_memory_object(ptr, std::is_polymorphic<T>());
+    ptr->~T();
+    OS_FREE(object);
+}
+
+    #undef OS_NEW
+    #undef OS_DELETE
+    #define OS_NEW(ptr, Class, ...)        ptr = os_memory_new<Class>(__VA_ARGS__)
+    #define OS_DELETE(ptr) \
+        do {\
+            if (ptr) {\
+                os_memory_delete(ptr);\
+                (ptr) = NULL;\
+            }\
+        } while (0)
+#endif
+
+#endif /* __CUTILS_OS_ALLOC_H__ */
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define OS_MEMORY_TAG OS_MEMTAG_ARENA
+
+#include <stdint.h>
+#include <string.h>
+
+#include "cutils/os_alloc.h"
+#include "msgutils/cutils/os_thread.h"
+#include "cutils/log_gate.h"
+#include "cutils/os_arena.h"
+
+#define TAG "os_arena"
+
+#define ARENA_ALIGN     16
+#define ARENA_NAME_LEN  32
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;        // bytes of data
+    size_t used;        // bumped atomically, may overshoot size once the chunk is full
+    // data follows
+};
+
+#define ARENA_CHUNK_HEADER ((sizeof(struct arena_chunk) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define ARENA_CHUNK_DATA(chunk) ((char *)(chunk) + ARENA_CHUNK_HEADER)
+
+struct os_arena {
+    char name[ARENA_NAME_LEN];
+    os_mutex_t lock;            // serializes adding chunks
+    struct arena_chunk *chunks; // current chunk first, accessed atomically
+    size_t chunk_size;
+    size_t reserved;
+};
+
+os_arena_t os_arena_create(const char *name, size_t chunk_size)
+{
+    struct os_arena *arena = OS_CALLOC(1, sizeof(struct os_arena));
+    if (arena == NULL)
+        return NULL;
+    arena->lock = OS_THREAD_MUTEX_CREATE();
+    if (arena->lock == NULL) {
+        OS_FREE(arena);
+        return NULL;
+    }
+    snprintf(arena->name, sizeof(arena->name), "%s", name != NULL ? name : "arena");
+    arena->chunk_size = chunk_size != 0 ? chunk_size : ARENA_CHUNK_SIZE_DEFAULT;
+    return arena;
+}
+
+void os_arena_destroy(os_arena_t arena)
+{
+    if (arena == NULL)
+        return;
+    struct arena_chunk *chunk = arena->chunks;
+    while (chunk != NULL) {
+        struct arena_chunk *next = chunk->next;
+        OS_FREE(chunk);
+        chunk = next;
+    }
+    OS_THREAD_MUTEX_DESTROY(arena->lock);
+    OS_FREE(arena);
+}
+
+static struct arena_chunk *arena_chunk_add(struct os_arena *arena, size_t size, bool current)
+{
+    struct arena_chunk *chunk = OS_MALLOC(ARENA_CHUNK_HEADER + size);
+    if (chunk == NULL)
+        return NULL;
+    chunk->size = size;
+    chunk->used = current ? 0 : size;
+    // A dedicated chunk goes behind the current one, which still has room
+    if (current || arena->chunks == NULL) {
+        chunk->next = arena->chunks;
+        __atomic_store_n(&arena->chunks, chunk, __ATOMIC_RELEASE);
+    } else {
+        chunk->next = arena->chunks->next;
+        arena->chunks->next = chunk;
+    }
+    arena->reserved += size;
+    return chunk;
+}
+
+// Bump the current chunk, NULL if it's missing or full
+static void *arena_chunk_bump(struct os_arena *arena, size_t size)
+{
+    struct arena_chunk *chunk = __atomic_load_n(&arena->chunks, __ATOMIC_ACQUIRE);
+    if (chunk == NULL)
+        return NULL;
+    size_t offset = __atomic_fetch_add(&chunk->used, size, __ATOMIC_RELAXED);
+    if (offset + size > chunk->size)
+        return NULL;
+    return ARENA_CHUNK_DATA(chunk) + offset;
+}
+
+void *os_arena_alloc(os_arena_t arena, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (size == 0)
+        size = ARENA_ALIGN;
+
+    void *ptr = NULL;
+    bool dedicated = size > arena->chunk_size / 4;
+    if (!dedicated) {
+        ptr = arena_chunk_bump(arena, size);
+        if (ptr != NULL)
+            return ptr;
+    }
+
+    OS_THREAD_MUTEX_LOCK(arena->lock);
+    if (dedicated) {
+        struct arena_chunk *chunk = arena_chunk_add(arena, size, false);
+        if (chunk != NULL)
+            ptr = ARENA_CHUNK_DATA(chunk);
+    } else {
+        // Another thread may have added a chunk meanwhile
+        ptr = arena_chunk_bump(arena, size);
+        if (ptr == NULL && arena_chunk_add(arena, arena->chunk_size, true) != NULL)
+            ptr = arena_chunk_bump(arena, size);
+    }
+    OS_THREAD_MUTEX_UNLOCK(arena->lock);
+    return ptr;
+}
+
+void *os_arena_calloc(os_arena_t arena, size_t n, size_t size)
+{
+    if (size != 0 && n > SIZE_MAX / size)
+        return NULL;
+    void *ptr = os_arena_alloc(arena, n * size);
+    if (ptr != NULL)
+        memset(ptr, 0, n * size);
+    return ptr;
+}
+
+char *os_arena_strdup(os_arena_t arena, const char *str)
+{
+    if (str == NULL)
+        return NULL;
+    size_t len = strlen(str) + 1;
+    char *dup = os_arena_alloc(arena, len);
+    if (dup != NULL)
+        memcpy(dup, str, len);
+    return dup;
+}
+
+void os_arena_usage(os_arena_t arena, size_t *used, size_t *reserved)
+{
+    OS_THREAD_MUTEX_LOCK(arena->lock);
+    struct arena_chunk *chunk;
+    *used = 0;
+    for (chunk = arena->chunks; chunk != NULL; chunk = chunk->next) {
+        size_t bumped = __atomic_load_n(&chunk->used, __ATOMIC_RELAXED);
+        *used += bumped < chunk->size ? bumped : chunk->size;
+    }
+    *reserved = arena->reserved;
+    OS_THREAD_MUTEX_UNLOCK(arena->lock);
+}
+
+void os_arena_dump(os_arena_t arena)
+{
+    size_t used, reserved;
+    os_arena_usage(arena, &used, &reserved);
+    OS_LOGI(TAG, "[%s] used=%zu, reserved=%zu", arena->name, used, reserved);
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CUTILS_OS_ARENA_H__
+#define __CUTILS_OS_ARENA_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ARENA_CHUNK_SIZE_DEFAULT 8192
+
+typedef struct os_arena *os_arena_t;
+
+/**
+ * Scoped arena for allocations sharing one owner, e.g. a player. Blocks are
+ * bumped out of chunks and can't be freed one by one, everything is released
+ * at once by os_arena_destroy. Requests larger than a quarter of chunk_size
+ * get a chunk of their own. Allocation is thread safe, blocks have the
+ * alignment of malloc.
+ *
+ * Don't use an arena for memory that churns over the lifetime of its owner,
+ * such as per-stream buffers, it would grow until the owner is destroyed.
+ */
+os_arena_t os_arena_create(const char *name, size_t chunk_size);
+
+void os_arena_destroy(os_arena_t arena);
+
+void *os_arena_alloc(os_arena_t arena, size_t size);
+
+void *os_arena_calloc(os_arena_t arena, size_t n, size_t size);
+
+char *os_arena_strdup(os_arena_t arena, const char *str);
+
+// Bytes handed out, counting unused tails of full chunks, and bytes held in chunks
+void os_arena_usage(os_arena_t arena, size_t *used, size_t *reserved);
+
+void os_arena_dump(os_arena_t arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CUTILS_OS_ARENA_H__ */
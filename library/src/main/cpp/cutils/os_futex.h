@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CUTILS_OS_FUTEX_H__
+#define __CUTILS_OS_FUTEX_H__
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "msgutils/cutils/os_time.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Sleep while *addr equals val, until woken or the monotonic deadline_us
+ * passes, 0 waits forever. Returns 0 when woken, -ETIMEDOUT, or -EAGAIN if
+ * *addr already changed.
+ */
+static inline int os_futex_wait(int *addr, int val, unsigned long long deadline_us)
+{
+    struct timespec ts, *timeout = NULL;
+    if (deadline_us != 0) {
+        unsigned long long now_us = OS_MONOTONIC_USEC();
+        if (now_us >= deadline_us)
+            return -ETIMEDOUT;
+        unsigned long long left_us = deadline_us - now_us;
+        ts.tv_sec = left_us / 1000000;
+        ts.tv_nsec = (left_us % 1000000) * 1000;
+        timeout = &ts;
+    }
+    if (syscall(__NR_futex, addr, FUTEX_WAIT_PRIVATE, val, timeout, NULL, 0) != 0)
+        return -errno;
+    return 0;
+}
+
+// Wake up to count waiters of addr, INT_MAX for all
+static inline void os_futex_wake(int *addr, int count)
+{
+    syscall(__NR_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CUTILS_OS_FUTEX_H__ */
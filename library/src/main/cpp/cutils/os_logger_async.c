@@ -0,0 +1,494 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cutils/os_logger_async.h"
+
+#if defined(ENABLE_ASYNC_LOGGER)
+#include <stdarg.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "msgutils/cutils/os_thread.h"
+#include "msgutils/cutils/os_time.h"
+#include "cutils/os_alloc.h"
+
+#define ASYNC_LOG_POLL_MS      20
+#define ASYNC_LOG_LINE_SIZE    512
+#define ASYNC_LOG_FLUSH_SPINS  1000 // 1ms each, flush gives up after
+
+union async_log_arg {
+    long long i;
+    double d;
+    const void *p;
+};
+
+struct async_log_record {
+    unsigned long long timestamp_us;
+    const char *tag;
+    const char *format;
+    int prio;
+    int tid;
+    union async_log_arg args[ASYNC_LOG_MAX_ARGS];
+    char strings[ASYNC_LOG_STRING_SIZE];
+};
+
+struct async_log_ring {
+    struct async_log_ring *next;
+    int owner;                      // tid of the producer, 0 if free, accessed atomically
+    unsigned int dropped;           // accessed atomically
+    unsigned int head __attribute__((aligned(64))); // written by producer
+    unsigned int tail __attribute__((aligned(64))); // written by consumer
+    struct async_log_record records[ASYNC_LOG_RING_RECORDS];
+};
+
+// Printf conversion, shared by producer and consumer so both walk the same args
+struct async_log_spec {
+    int length;     // bytes of the spec, including '%'
+    int stars;      // '*' width or precision, each takes an int argument
+    char conv;
+    char size;      // 'H' hh, 'h', 'l', 'L' ll or long double, 'z' size_t/ptrdiff_t, 0 none
+};
+
+static struct async_log_ring *sRings = NULL;
+static pthread_key_t sRingKey;
+static pthread_once_t sRingKeyOnce = PTHREAD_ONCE_INIT;
+static __thread struct async_log_ring *tRing = NULL;
+
+static os_thread_t sThread = NULL;
+static os_mutex_t sLock = NULL;
+static os_cond_t sCond = NULL;
+static int sRunning = 0;        // accessed atomically
+static int sStopping = 1;       // producers log synchronously, accessed atomically
+static int sProducers = 0;      // producers pushing a record, accessed atomically
+static int sDraining = 0;       // one consumer at a time, accessed atomically
+static unsigned long long sDropped = 0;
+
+#if defined(OS_ANDROID)
+static const int sAndroidPrio[] = {
+    ANDROID_LOG_FATAL, ANDROID_LOG_ERROR, ANDROID_LOG_WARN,
+    ANDROID_LOG_INFO, ANDROID_LOG_DEBUG, ANDROID_LOG_VERBOSE,
+};
+#endif
+
+static void log_emit(int prio, const char *tag, int tid, unsigned long long timestamp_us, const char *msg)
+{
+#if defined(OS_ANDROID)
+    (void)tid;
+    (void)timestamp_us;
+    __android_log_write(sAndroidPrio[prio], tag, msg);
+#else
+    static const char sPrioLetter[] = "FEWIDV";
+    fprintf(stderr, "[%llu.%06llu] [%d] [%c] [%s]: %s\n",
+            timestamp_us / 1000000, timestamp_us % 1000000, tid, sPrioLetter[prio], tag, msg);
+#endif
+}
+
+static const char *log_parse_spec(const char *p, struct async_log_spec *spec)
+{
+    const char *begin = p++;
+    spec->stars = 0;
+    spec->size = 0;
+    while (*p != '\0' && strchr("-+ #0", *p) != NULL)
+        p++;
+    if (*p == '*') {
+        spec->stars++;
+        p++;
+    } else {
+        while (*p >= '0' && *p <= '9')
+            p++;
+    }
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            spec->stars++;
+            p++;
+        } else {
+            while (*p >= '0' && *p <= '9')
+                p++;
+        }
+    }
+    switch (*p) {
+    case 'h':
+        spec->size = p[1] == 'h' ? 'H' : 'h';
+        p += p[1] == 'h' ? 2 : 1;
+        break;
+    case 'l':
+        spec->size = p[1] == 'l' ? 'L' : 'l';
+        p += p[1] == 'l' ? 2 : 1;
+        break;
+    case 'L': case 'q': case 'j':
+        spec->size = 'L';
+        p++;
+        break;
+    case 'z': case 't':
+        spec->size = 'z';
+        p++;
+        break;
+    }
+    spec->conv = *p;
+    if (*p != '\0')
+        p++;
+    spec->length = (int)(p - begin);
+    return p;
+}
+
+static void log_capture(struct async_log_record *record, const char *format, va_list ap)
+{
+    struct async_log_spec spec;
+    const char *p = format;
+    int nargs = 0, used = 0, i;
+    while ((p = strchr(p, '%')) != NULL) {
+        p = log_parse_spec(p, &spec);
+        if (spec.conv == '%' || spec.conv == '\0')
+            continue;
+        // Remaining arguments are printed as "?"
+        if (nargs + spec.stars >= ASYNC_LOG_MAX_ARGS)
+            break;
+        for (i = 0; i < spec.stars; i++)
+            record->args[nargs++].i = va_arg(ap, int);
+        union async_log_arg arg;
+        switch (spec.conv) {
+        case 'd': case 'i': case 'c':
+            if (spec.size == 'L') arg.i = va_arg(ap, long long);
+            else if (spec.size == 'l' || spec.size == 'z') arg.i = va_arg(ap, long);
+            else arg.i = va_arg(ap, int);
+            break;
+        case 'u': case 'x': case 'X': case 'o':
+            if (spec.size == 'L') arg.i = (long long)va_arg(ap, unsigned long long);
+            else if (spec.size == 'l' || spec.size == 'z') arg.i = (long long)va_arg(ap, unsigned long);
+            else arg.i = va_arg(ap, unsigned int);
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            arg.d = spec.size == 'L' ? (double)va_arg(ap, long double) : va_arg(ap, double);
+            break;
+        case 's': {
+            // Copy string, the pointer may be gone when the record is formatted
+            const char *str = va_arg(ap, const char *);
+            if (str == NULL)
+                str = "(null)";
+            int room = ASYNC_LOG_STRING_SIZE - used;
+            arg.i = -1;
+            if (room > 0) {
+                int len = (int)strnlen(str, room - 1);
+                memcpy(record->strings + used, str, len);
+                record->strings[used + len] = '\0';
+                arg.i = used;
+                used += len + 1;
+            }
+            break;
+        }
+        default:
+            arg.p = va_arg(ap, const void *);
+            break;
+        }
+        record->args[nargs++] = arg;
+    }
+}
+
+static void log_format_record(struct async_log_record *record, char *out, int size)
+{
+    struct async_log_spec spec;
+    const char *p = record->format;
+    int len = 0, nargs = 0;
+    while (*p != '\0' && len < size - 1) {
+        if (*p != '%') {
+            out[len++] = *p++;
+            continue;
+        }
+        p = log_parse_spec(p, &spec);
+        if (spec.conv == '%') {
+            out[len++] = '%';
+            continue;
+        }
+        if (spec.conv == '\0' || nargs + spec.stars >= ASYNC_LOG_MAX_ARGS) {
+            out[len++] = '?';
+            continue;
+        }
+        char fmt[32];
+        if (spec.length >= (int)sizeof(fmt)) {
+            out[len++] = '?';
+            continue;
+        }
+        memcpy(fmt, p - spec.length, spec.length);
+        fmt[spec.length] = '\0';
+        int star1 = spec.stars > 0 ? (int)record->args[nargs].i : 0;
+        int star2 = spec.stars > 1 ? (int)record->args[nargs + 1].i : 0;
+        nargs += spec.stars;
+        union async_log_arg arg = record->args[nargs++];
+        int room = size - len, ret;
+
+#define LOG_SNPRINTF(value) \
+        (spec.stars == 0 ? snprintf(out + len, room, fmt, value) : \
+         spec.stars == 1 ? snprintf(out + len, room, fmt, star1, value) : \
+                           snprintf(out + len, room, fmt, star1, star2, value))
+
+        switch (spec.conv) {
+        case 'd': case 'i': case 'c': case 'u': case 'x': case 'X': case 'o':
+            if (spec.size == 'L') ret = LOG_SNPRINTF(arg.i);
+            else if (spec.size == 'l' || spec.size == 'z') ret = LOG_SNPRINTF((long)arg.i);
+            else ret = LOG_SNPRINTF((int)arg.i);
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            if (spec.size == 'L') ret = LOG_SNPRINTF((long double)arg.d);
+            else ret = LOG_SNPRINTF(arg.d);
+            break;
+        case 's':
+            ret = LOG_SNPRINTF(arg.i >= 0 && arg.i < ASYNC_LOG_STRING_SIZE ?
+                    (const char *)record->strings + arg.i : "?");
+            break;
+        default:
+            ret = LOG_SNPRINTF(arg.p);
+            break;
+        }
+#undef LOG_SNPRINTF
+        if (ret < 0)
+            break;
+        len += ret < room ? ret : room - 1;
+    }
+    out[len] = '\0';
+}
+
+static void ring_release(void *arg)
+{
+    struct async_log_ring *ring = (struct async_log_ring *)arg;
+    __atomic_store_n(&ring->owner, 0, __ATOMIC_RELEASE);
+}
+
+static void ring_key_create()
+{
+    pthread_key_create(&sRingKey, ring_release);
+}
+
+static struct async_log_ring *ring_get(int *tid)
+{
+    if (tRing != NULL) {
+        *tid = __atomic_load_n(&tRing->owner, __ATOMIC_RELAXED);
+        return tRing;
+    }
+
+    pthread_once(&sRingKeyOnce, ring_key_create);
+    *tid = (int)syscall(__NR_gettid);
+    struct async_log_ring *ring;
+    for (ring = __atomic_load_n(&sRings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&ring->owner, &expected, *tid, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            break;
+    }
+    if (ring == NULL) {
+        ring = OS_CALLOC(1, sizeof(struct async_log_ring));
+        if (ring == NULL)
+            return NULL;
+        ring->owner = *tid;
+        ring->next = __atomic_load_n(&sRings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&sRings, &ring->next, ring, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+    pthread_setspecific(sRingKey, ring);
+    tRing = ring;
+    return ring;
+}
+
+// Caller must own sDraining
+static void rings_drain()
+{
+    char line[ASYNC_LOG_LINE_SIZE];
+    struct async_log_ring *ring;
+    for (ring = __atomic_load_n(&sRings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+        unsigned int tail = ring->tail;
+        unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        for (; tail != head; tail++) {
+            struct async_log_record *record = &ring->records[tail & (ASYNC_LOG_RING_RECORDS - 1)];
+            log_format_record(record, line, sizeof(line));
+            log_emit(record->prio, record->tag, record->tid, record->timestamp_us, line);
+            __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+        }
+        unsigned int dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+        if (dropped > 0) {
+            snprintf(line, sizeof(line), "%u logs dropped, ring full", dropped);
+            log_emit(OS_LOG_WARN, "os_logger", __atomic_load_n(&ring->owner, __ATOMIC_RELAXED),
+                     OS_MONOTONIC_USEC(), line);
+        }
+    }
+}
+
+static bool drain_acquire(int spins)
+{
+    for (;;) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&sDraining, &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return true;
+        if (spins-- <= 0)
+            return false;
+        usleep(1000);
+    }
+}
+
+static void drain_release()
+{
+    __atomic_store_n(&sDraining, 0, __ATOMIC_RELEASE);
+}
+
+static void *logger_thread(void *arg)
+{
+    while (__atomic_load_n(&sRunning, __ATOMIC_ACQUIRE)) {
+        if (drain_acquire(0)) {
+            rings_drain();
+            drain_release();
+        }
+        OS_THREAD_MUTEX_LOCK(sLock);
+        if (__atomic_load_n(&sRunning, __ATOMIC_ACQUIRE))
+            OS_THREAD_COND_TIMEDWAIT(sCond, sLock, ASYNC_LOG_POLL_MS * 1000);
+        OS_THREAD_MUTEX_UNLOCK(sLock);
+    }
+    return NULL;
+}
+
+static void log_push(struct async_log_ring *ring, int tid,
+                     enum os_logprio prio, const char *tag, const char *format, va_list ap)
+{
+    unsigned int head = ring->head;
+    unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (head - tail >= ASYNC_LOG_RING_RECORDS) {
+        __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&sDropped, 1ULL, __ATOMIC_RELAXED);
+        return;
+    }
+    struct async_log_record *record = &ring->records[head & (ASYNC_LOG_RING_RECORDS - 1)];
+    record->timestamp_us = OS_MONOTONIC_USEC();
+    record->tag = tag;
+    record->format = format;
+    record->prio = prio;
+    record->tid = tid;
+    log_capture(record, format, ap);
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+    // Wake the logger early when the ring is getting full, without lock a
+    // wakeup may be missed but the poll timeout covers it. sCond stays alive
+    // while this producer is counted in sProducers
+    if (head + 1 - tail >= ASYNC_LOG_RING_RECORDS * 3 / 4)
+        OS_THREAD_COND_SIGNAL(sCond);
+}
+
+void os_logger_async_print(enum os_logprio prio, const char *tag, const char *format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    if (__atomic_load_n(&sRunning, __ATOMIC_ACQUIRE)) {
+        // Pairs with os_logger_async_stop: either stop waits for this record
+        // before the last drain, or this producer sees sStopping and logs
+        // synchronously
+        int tid;
+        struct async_log_ring *ring;
+        __atomic_add_fetch(&sProducers, 1, __ATOMIC_SEQ_CST);
+        if (!__atomic_load_n(&sStopping, __ATOMIC_SEQ_CST) && (ring = ring_get(&tid)) != NULL) {
+            log_push(ring, tid, prio, tag, format, ap);
+            __atomic_sub_fetch(&sProducers, 1, __ATOMIC_RELEASE);
+            va_end(ap);
+            return;
+        }
+        __atomic_sub_fetch(&sProducers, 1, __ATOMIC_RELEASE);
+    }
+
+#if defined(OS_ANDROID)
+    __android_log_vprint(sAndroidPrio[prio], tag, format, ap);
+#else
+    vfprintf(stderr, format, ap);
+    fputc('\n', stderr);
+#endif
+    va_end(ap);
+}
+
+// Turn producers away and wait for those already pushing, after that no
+// record is pushed and sCond isn't reachable from producers
+static void producers_stop()
+{
+    __atomic_store_n(&sStopping, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&sProducers, __ATOMIC_SEQ_CST) > 0)
+        OS_THREAD_SLEEP_MSEC(1);
+}
+
+int os_logger_async_start()
+{
+    if (__atomic_load_n(&sRunning, __ATOMIC_ACQUIRE))
+        return 0;
+    sLock = OS_THREAD_MUTEX_CREATE();
+    sCond = OS_THREAD_COND_CREATE();
+    if (sLock == NULL || sCond == NULL)
+        goto fail;
+
+    __atomic_store_n(&sStopping, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&sRunning, 1, __ATOMIC_RELEASE);
+    struct os_threadattr attr = {
+        .name = "os_logger_async",
+        .priority = OS_THREAD_PRIO_LOW,
+        .stacksize = 16384,
+        .joinable = true,
+    };
+    sThread = OS_THREAD_CREATE(&attr, logger_thread, NULL);
+    if (sThread == NULL) {
+        producers_stop();
+        __atomic_store_n(&sRunning, 0, __ATOMIC_RELEASE);
+        os_logger_async_flush();
+        goto fail;
+    }
+    return 0;
+
+fail:
+    if (sCond != NULL)
+        OS_THREAD_COND_DESTROY(sCond);
+    if (sLock != NULL)
+        OS_THREAD_MUTEX_DESTROY(sLock);
+    sCond = NULL;
+    sLock = NULL;
+    return -1;
+}
+
+void os_logger_async_stop()
+{
+    if (!__atomic_load_n(&sRunning, __ATOMIC_ACQUIRE))
+        return;
+    producers_stop();
+
+    OS_THREAD_MUTEX_LOCK(sLock);
+    __atomic_store_n(&sRunning, 0, __ATOMIC_RELEASE);
+    OS_THREAD_COND_SIGNAL(sCond);
+    OS_THREAD_MUTEX_UNLOCK(sLock);
+    OS_THREAD_JOIN(sThread, NULL);
+    sThread = NULL;
+    // Last drain, the rings can't grow any more
+    os_logger_async_flush();
+
+    OS_THREAD_COND_DESTROY(sCond);
+    OS_THREAD_MUTEX_DESTROY(sLock);
+    sCond = NULL;
+    sLock = NULL;
+}
+
+void os_logger_async_flush()
+{
+    // The logger thread may be draining
+    if (!drain_acquire(ASYNC_LOG_FLUSH_SPINS))
+        return;
+    rings_drain();
+    drain_release();
+}
+
+unsigned long long os_logger_async_dropped()
+{
+    return __atomic_load_n(&sDropped, __ATOMIC_RELAXED);
+}
+#endif
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CUTILS_OS_LOGGER_ASYNC_H__
+#define __CUTILS_OS_LOGGER_ASYNC_H__
+
+#include "cutils/log_gate.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ASYNC_LOG_RING_RECORDS 128 // records per thread, power of two
+#define ASYNC_LOG_MAX_ARGS     8   // arguments beyond are printed as "?"
+#define ASYNC_LOG_STRING_SIZE  64  // bytes for copies of %s arguments per record
+
+/**
+ * Asynchronous logger. With ENABLE_ASYNC_LOGGER defined in log_gate.h, all
+ * logs except fatal ones are pushed as binary records (timestamp, tag, format
+ * pointer, raw arguments) into a ring owned by the calling thread without any
+ * lock or formatting, then formatted and emitted by a background thread.
+ * Records are dropped and counted if a ring is full.
+ *
+ * Tag and format must be string literals, %s arguments are copied and
+ * truncated to fit the record, %n isn't supported.
+ *
+ * There is no crash hook: formatting isn't async-signal-safe, so records
+ * still queued when the process crashes (up to one poll period) are lost.
+ * Fatal logs and assertions are printed synchronously and aren't affected.
+ */
+int os_logger_async_start();
+
+// Stop queueing, emit all pending records and stop the background thread,
+// logs are printed synchronously from the moment stop is called
+void os_logger_async_stop();
+
+// Emit all pending records on the calling thread
+void os_logger_async_flush();
+
+// Total records dropped due to full rings
+unsigned long long os_logger_async_dropped();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CUTILS_OS_LOGGER_ASYNC_H__ */
@@ -0,0 +1,578 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <unwind.h>
+#include <sys/syscall.h>
+
+#include "msgutils/cutils/os_time.h"
+#include "cutils/log_gate.h"
+#include "cutils/os_memstat.h"
+#if defined(ENABLE_MEMORY_SLAB)
+#include "cutils/os_slab.h"
+#endif
+
+#define TAG "os_memstat"
+
+// Blocks come from the backend directly, OS_MALLOC is mapped to this file
+#if defined(ENABLE_MEMORY_SLAB)
+#define memstat_backend_malloc(size)       os_slab_malloc(size)
+#define memstat_backend_calloc(n, size)    os_slab_calloc(n, size)
+#define memstat_backend_realloc(ptr, size) os_slab_realloc(ptr, size)
+#define memstat_backend_free(ptr)          os_slab_free(ptr)
+#else
+#define memstat_backend_malloc(size)       malloc(size)
+#define memstat_backend_calloc(n, size)    calloc(n, size)
+#define memstat_backend_realloc(ptr, size) realloc(ptr, size)
+#define memstat_backend_free(ptr)          free(ptr)
+#endif
+
+#define MEMSTAT_HEADER_SIZE      16  // keeps the alignment of the backend
+#define MEMSTAT_MAGIC(hdr)       ((uint32_t)((uintptr_t)(hdr) >> 4) ^ 0x6d656d73U)
+#define MEMSTAT_SAMPLE_RECHECK   65536  // allocations between checks while sampling is off
+#define MEMSTAT_DUMP_STACKS      16     // stacks logged by os_memstat_dump
+
+struct memstat_header {
+    size_t size;
+    uint32_t magic;     // derived from the address, cleared on free
+    uint16_t tag;
+    uint16_t slot;      // sample slot + 1, 0 if not sampled
+};
+
+_Static_assert(sizeof(struct memstat_header) <= MEMSTAT_HEADER_SIZE, "memstat header too large");
+
+#define MEMSTAT_HEADER(ptr) ((struct memstat_header *)((char *)(ptr) - MEMSTAT_HEADER_SIZE))
+#define MEMSTAT_DATA(hdr)   ((void *)((char *)(hdr) + MEMSTAT_HEADER_SIZE))
+
+// Written by the owner thread only with relaxed atomic load/store pairs, no
+// lock prefixed instruction, and summed up with relaxed atomic loads by
+// readers on any thread, e.g. os_memstat_dump_json. A block freed on another
+// thread than the one that allocated it leaves a negative live count behind
+// on the freeing thread. All fields are accessed atomically
+struct memstat_counter {
+    long live_bytes;
+    long live_count;
+    unsigned long long total_bytes;
+    unsigned long long total_count;
+};
+
+struct memstat_thread {
+    struct memstat_thread *next;
+    int owner;          // tid of the owner thread, 0 if free, accessed atomically
+    struct memstat_counter counters[OS_MEMTAG_COUNT];
+};
+
+struct memstat_sample {
+    void *ptr;          // NULL if the slot is free
+    size_t size;
+    int tag;
+    int depth;
+    unsigned long long time_us;
+    uintptr_t pcs[MEMSTAT_STACK_DEPTH];
+};
+
+static const char *sTagName[OS_MEMTAG_COUNT] = {
+    "misc", "ringbuf", "queue", "looper", "decoder", "http", "mixer", "sink", "arena",
+};
+
+// Counters are linked once and never freed, counters of exited threads are
+// reused and keep their sums. sShared is for threads failing to get their own
+static struct memstat_thread sShared = { NULL, -1, {{ 0, 0, 0, 0 }} };
+static struct memstat_thread *sThreads = &sShared;
+static pthread_key_t sThreadKey;
+static pthread_once_t sMemstatOnce = PTHREAD_ONCE_INIT;
+static __thread struct memstat_thread *tThread = NULL;
+static size_t sPeak[OS_MEMTAG_COUNT];  // highest live bytes seen by samples and queries
+static unsigned int sSamplePeriod = MEMSTAT_SAMPLE_PERIOD_DEFAULT;
+static struct memstat_sample sSamples[MEMSTAT_SAMPLE_MAX];
+static unsigned int sSampleHint = 0;
+static unsigned long long sSampleDropped = 0;  // samples lost as the table was full
+static pthread_mutex_t sSampleLock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread unsigned int tSampleCountdown = 0;
+static __thread uint32_t tSampleSeed = 0;
+
+static void memstat_thread_release(void *arg)
+{
+    struct memstat_thread *thread = (struct memstat_thread *)arg;
+    // Allocating again from a later destructor claims counters once more
+    tThread = NULL;
+    __atomic_store_n(&thread->owner, 0, __ATOMIC_RELEASE);
+}
+
+static void memstat_init()
+{
+    pthread_key_create(&sThreadKey, memstat_thread_release);
+}
+
+static struct memstat_thread *memstat_thread_get()
+{
+    if (tThread != NULL)
+        return tThread;
+
+    pthread_once(&sMemstatOnce, memstat_init);
+    int tid = (int)syscall(__NR_gettid);
+    struct memstat_thread *thread;
+    for (thread = __atomic_load_n(&sThreads, __ATOMIC_ACQUIRE); thread != NULL; thread = thread->next) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&thread->owner, &expected, tid, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            break;
+    }
+    if (thread == NULL) {
+        thread = (struct memstat_thread *)calloc(1, sizeof(struct memstat_thread));
+        if (thread == NULL)
+            return &sShared;
+        thread->owner = tid;
+        thread->next = __atomic_load_n(&sThreads, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&sThreads, &thread->next, thread, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+    pthread_setspecific(sThreadKey, thread);
+    tThread = thread;
+    return thread;
+}
+
+#define memstat_add(thread, field, delta) \
+    do {\
+        if ((thread) != &sShared)\
+            __atomic_store_n(&(field), __atomic_load_n(&(field), __ATOMIC_RELAXED) + (delta), __ATOMIC_RELAXED);\
+        else\
+            __atomic_add_fetch(&(field), (delta), __ATOMIC_RELAXED);\
+    } while (0)
+
+static inline void memstat_account(int tag, long bytes, long count)
+{
+    struct memstat_thread *thread = memstat_thread_get();
+    struct memstat_counter *counter = &thread->counters[tag];
+    memstat_add(thread, counter->live_bytes, bytes);
+    memstat_add(thread, counter->live_count, count);
+    if (bytes > 0)
+        memstat_add(thread, counter->total_bytes, (unsigned long long)bytes);
+    if (count > 0)
+        memstat_add(thread, counter->total_count, (unsigned long long)count);
+}
+
+static void memstat_sum(int tag, struct os_memstat *stat)
+{
+    long live_bytes = 0, live_count = 0;
+    unsigned long long total_bytes = 0, total_count = 0;
+    struct memstat_thread *thread;
+    for (thread = __atomic_load_n(&sThreads, __ATOMIC_ACQUIRE); thread != NULL; thread = thread->next) {
+        struct memstat_counter *counter = &thread->counters[tag];
+        live_bytes += __atomic_load_n(&counter->live_bytes, __ATOMIC_RELAXED);
+        live_count += __atomic_load_n(&counter->live_count, __ATOMIC_RELAXED);
+        total_bytes += __atomic_load_n(&counter->total_bytes, __ATOMIC_RELAXED);
+        total_count += __atomic_load_n(&counter->total_count, __ATOMIC_RELAXED);
+    }
+    // Threads are read one by one, a block moving between them may be missed
+    stat->live_bytes = live_bytes > 0 ? (size_t)live_bytes : 0;
+    stat->live_count = live_count > 0 ? (size_t)live_count : 0;
+    stat->total_bytes = total_bytes;
+    stat->total_count = total_count;
+    size_t peak = __atomic_load_n(&sPeak[tag], __ATOMIC_RELAXED);
+    while (stat->live_bytes > peak &&
+           !__atomic_compare_exchange_n(&sPeak[tag], &peak, stat->live_bytes, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    stat->peak_bytes = peak > stat->live_bytes ? peak : stat->live_bytes;
+}
+
+// Distances between samples are uniform in [1, 2 * period], so that
+// allocation patterns repeating at a fixed stride can't hide from sampling
+static unsigned int memstat_sample_distance(unsigned int period)
+{
+    uint32_t x = tSampleSeed;
+    if (x == 0)
+        x = (uint32_t)(uintptr_t)&tSampleCountdown ^ (uint32_t)OS_MONOTONIC_USEC() ^ 0x9e3779b9U;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    tSampleSeed = x;
+    return 1 + x % (2 * period);
+}
+
+static inline bool memstat_sample_due(void)
+{
+    if (tSampleCountdown > 1) {
+        tSampleCountdown--;
+        return false;
+    }
+    bool due = tSampleCountdown == 1;
+    unsigned int period = __atomic_load_n(&sSamplePeriod, __ATOMIC_RELAXED);
+    if (period == 0) {
+        tSampleCountdown = MEMSTAT_SAMPLE_RECHECK;
+        return false;
+    }
+    tSampleCountdown = memstat_sample_distance(period);
+    return due;
+}
+
+struct memstat_unwind {
+    uintptr_t *pcs;
+    int depth;
+    int skip;
+};
+
+static _Unwind_Reason_Code memstat_unwind_frame(struct _Unwind_Context *context, void *arg)
+{
+    struct memstat_unwind *unwind = (struct memstat_unwind *)arg;
+    uintptr_t pc = _Unwind_GetIP(context);
+    if (pc == 0)
+        return _URC_END_OF_STACK;
+    if (unwind->skip > 0) {
+        unwind->skip--;
+        return _URC_NO_REASON;
+    }
+    unwind->pcs[unwind->depth++] = pc;
+    return unwind->depth < MEMSTAT_STACK_DEPTH ? _URC_NO_REASON : _URC_END_OF_STACK;
+}
+
+// Called right from the os_memstat_* entries, both frames are left out of the stack
+static __attribute__((noinline)) void memstat_sample(struct memstat_header *hdr, int tag, size_t size)
+{
+    uintptr_t pcs[MEMSTAT_STACK_DEPTH];
+    struct memstat_unwind unwind = { pcs, 0, 2 };
+    _Unwind_Backtrace(memstat_unwind_frame, &unwind);
+    unsigned long long now = OS_MONOTONIC_USEC();
+
+    pthread_mutex_lock(&sSampleLock);
+    unsigned int i, slot = sSampleHint;
+    for (i = 0; i < MEMSTAT_SAMPLE_MAX; i++, slot = (slot + 1) % MEMSTAT_SAMPLE_MAX) {
+        if (sSamples[slot].ptr == NULL)
+            break;
+    }
+    if (i < MEMSTAT_SAMPLE_MAX) {
+        struct memstat_sample *sample = &sSamples[slot];
+        sample->ptr = MEMSTAT_DATA(hdr);
+        sample->size = size;
+        sample->tag = tag;
+        sample->depth = unwind.depth;
+        sample->time_us = now;
+        memcpy(sample->pcs, pcs, unwind.depth * sizeof(uintptr_t));
+        sSampleHint = (slot + 1) % MEMSTAT_SAMPLE_MAX;
+        hdr->slot = (uint16_t)(slot + 1);
+    } else {
+        sSampleDropped++;
+    }
+    pthread_mutex_unlock(&sSampleLock);
+
+    // Keeps the peak roughly up to date without summing on every allocation
+    struct os_memstat stat;
+    memstat_sum(tag, &stat);
+}
+
+static void memstat_sample_update(struct memstat_header *hdr, void *ptr, size_t size)
+{
+    pthread_mutex_lock(&sSampleLock);
+    struct memstat_sample *sample = &sSamples[hdr->slot - 1];
+    sample->ptr = ptr;
+    sample->size = size;
+    if (ptr == NULL)
+        sSampleHint = hdr->slot - 1;
+    pthread_mutex_unlock(&sSampleLock);
+}
+
+static inline __attribute__((always_inline)) void *memstat_finish(struct memstat_header *hdr, int tag, size_t size)
+{
+    if ((unsigned int)tag >= OS_MEMTAG_COUNT)
+        tag = OS_MEMTAG_MISC;
+    hdr->size = size;
+    hdr->magic = MEMSTAT_MAGIC(hdr);
+    hdr->tag = (uint16_t)tag;
+    hdr->slot = 0;
+    memstat_account(tag, (long)size, 1);
+    if (memstat_sample_due())
+        memstat_sample(hdr, tag, size);
+    return MEMSTAT_DATA(hdr);
+}
+
+void *os_memstat_malloc(int tag, size_t size)
+{
+    if (size > SIZE_MAX - MEMSTAT_HEADER_SIZE)
+        return NULL;
+    struct memstat_header *hdr = memstat_backend_malloc(MEMSTAT_HEADER_SIZE + size);
+    if (hdr == NULL)
+        return NULL;
+    return memstat_finish(hdr, tag, size);
+}
+
+void *os_memstat_calloc(int tag, size_t n, size_t size)
+{
+    if (size != 0 && n > (SIZE_MAX - MEMSTAT_HEADER_SIZE) / size)
+        return NULL;
+    struct memstat_header *hdr = memstat_backend_calloc(1, MEMSTAT_HEADER_SIZE + n * size);
+    if (hdr == NULL)
+        return NULL;
+    return memstat_finish(hdr, tag, n * size);
+}
+
+char *os_memstat_strdup(int tag, const char *str)
+{
+    if (str == NULL)
+        return NULL;
+    size_t len = strlen(str) + 1;
+    struct memstat_header *hdr = memstat_backend_malloc(MEMSTAT_HEADER_SIZE + len);
+    if (hdr == NULL)
+        return NULL;
+    char *dup = memstat_finish(hdr, tag, len);
+    memcpy(dup, str, len);
+    return dup;
+}
+
+void os_memstat_free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    struct memstat_header *hdr = MEMSTAT_HEADER(ptr);
+    if (hdr->magic != MEMSTAT_MAGIC(hdr)) {
+        OS_LOGE(TAG, "Bad free of %p, not from OS_MALLOC or freed twice, leaking it", ptr);
+        return;
+    }
+    hdr->magic = 0;
+    if (hdr->slot != 0)
+        memstat_sample_update(hdr, NULL, 0);
+    memstat_account(hdr->tag, -(long)hdr->size, -1);
+    memstat_backend_free(hdr);
+}
+
+void *os_memstat_realloc(int tag, void *ptr, size_t size)
+{
+    if (ptr == NULL)
+        return os_memstat_malloc(tag, size);
+    struct memstat_header *hdr = MEMSTAT_HEADER(ptr);
+    if (hdr->magic != MEMSTAT_MAGIC(hdr)) {
+        OS_LOGE(TAG, "Bad realloc of %p, not from OS_MALLOC or already freed", ptr);
+        return NULL;
+    }
+    if (size > SIZE_MAX - MEMSTAT_HEADER_SIZE)
+        return NULL;
+
+    size_t old_size = hdr->size;
+    struct memstat_header *new_hdr = memstat_backend_realloc(hdr, MEMSTAT_HEADER_SIZE + size);
+    if (new_hdr == NULL)
+        return NULL;
+    new_hdr->size = size;
+    new_hdr->magic = MEMSTAT_MAGIC(new_hdr);
+    if (new_hdr->slot != 0)
+        memstat_sample_update(new_hdr, MEMSTAT_DATA(new_hdr), size);
+
+    memstat_account(new_hdr->tag, (long)size - (long)old_size, 0);
+    return MEMSTAT_DATA(new_hdr);
+}
+
+int os_memstat_get(int tag, struct os_memstat *stat)
+{
+    if ((unsigned int)tag >= OS_MEMTAG_COUNT)
+        return -1;
+    memstat_sum(tag, stat);
+    return 0;
+}
+
+const char *os_memstat_tag_name(int tag)
+{
+    if ((unsigned int)tag >= OS_MEMTAG_COUNT)
+        return "unknown";
+    return sTagName[tag];
+}
+
+void os_memstat_set_sample_period(unsigned int period)
+{
+    __atomic_store_n(&sSamplePeriod, period, __ATOMIC_RELAXED);
+}
+
+// ---------------------------------------------------------------------------
+
+// Live samples with the same tag and stack
+struct memstat_group {
+    struct memstat_sample *first;
+    size_t count;
+    size_t bytes;
+    unsigned long long oldest_us;
+};
+
+static int memstat_group_compare(const void *a, const void *b)
+{
+    const struct memstat_group *ga = (const struct memstat_group *)a;
+    const struct memstat_group *gb = (const struct memstat_group *)b;
+    if (ga->bytes != gb->bytes)
+        return ga->bytes < gb->bytes ? 1 : -1;
+    return 0;
+}
+
+static bool memstat_same_stack(const struct memstat_sample *a, const struct memstat_sample *b)
+{
+    return a->tag == b->tag && a->depth == b->depth &&
+           memcmp(a->pcs, b->pcs, a->depth * sizeof(uintptr_t)) == 0;
+}
+
+// Snapshots the sample table, caller frees samples, groups point into it
+static int memstat_collect(struct memstat_sample **samples, struct memstat_group **groups,
+                           unsigned long long *dropped)
+{
+    *samples = malloc(sizeof(sSamples));
+    *groups = malloc(MEMSTAT_SAMPLE_MAX * sizeof(struct memstat_group));
+    if (*samples == NULL || *groups == NULL) {
+        free(*samples);
+        free(*groups);
+        *samples = NULL;
+        *groups = NULL;
+        return -1;
+    }
+
+    int i, j, live = 0, count = 0;
+    pthread_mutex_lock(&sSampleLock);
+    for (i = 0; i < MEMSTAT_SAMPLE_MAX; i++) {
+        if (sSamples[i].ptr != NULL)
+            (*samples)[live++] = sSamples[i];
+    }
+    *dropped = sSampleDropped;
+    pthread_mutex_unlock(&sSampleLock);
+
+    for (i = 0; i < live; i++) {
+        struct memstat_sample *sample = &(*samples)[i];
+        for (j = 0; j < count; j++) {
+            if (memstat_same_stack((*groups)[j].first, sample))
+                break;
+        }
+        struct memstat_group *group = &(*groups)[j];
+        if (j == count) {
+            group->first = sample;
+            group->count = 0;
+            group->bytes = 0;
+            group->oldest_us = sample->time_us;
+            count++;
+        }
+        group->count++;
+        group->bytes += sample->size;
+        if (sample->time_us < group->oldest_us)
+            group->oldest_us = sample->time_us;
+    }
+    qsort(*groups, count, sizeof(struct memstat_group), memstat_group_compare);
+    return count;
+}
+
+// Offsets are relative to the load address, as addr2line -e module expects
+static int memstat_frame(uintptr_t pc, char *buf, size_t size)
+{
+    Dl_info info;
+    if (dladdr((void *)pc, &info) == 0 || info.dli_fname == NULL)
+        return snprintf(buf, size, "0x%lx", (unsigned long)pc);
+    const char *module = strrchr(info.dli_fname, '/');
+    module = module != NULL ? module + 1 : info.dli_fname;
+    return snprintf(buf, size, "%s+0x%lx", module, (unsigned long)(pc - (uintptr_t)info.dli_fbase));
+}
+
+void os_memstat_dump(void)
+{
+    unsigned int period = __atomic_load_n(&sSamplePeriod, __ATOMIC_RELAXED);
+    int tag, i, j;
+    for (tag = 0; tag < OS_MEMTAG_COUNT; tag++) {
+        struct os_memstat stat;
+        os_memstat_get(tag, &stat);
+        if (stat.total_count == 0)
+            continue;
+        OS_LOGI(TAG, "[%s] live=%zuKB/%zu, peak=%zuKB, total=%lluKB/%llu",
+                sTagName[tag], stat.live_bytes / 1024, stat.live_count, stat.peak_bytes / 1024,
+                stat.total_bytes / 1024, stat.total_count);
+    }
+
+    struct memstat_sample *samples;
+    struct memstat_group *groups;
+    unsigned long long dropped;
+    int count = memstat_collect(&samples, &groups, &dropped);
+    if (count < 0)
+        return;
+    OS_LOGI(TAG, "sample period=%u, stacks=%d, dropped=%llu", period, count, dropped);
+    unsigned long long now = OS_MONOTONIC_USEC();
+    for (i = 0; i < count && i < MEMSTAT_DUMP_STACKS; i++) {
+        struct memstat_group *group = &groups[i];
+        OS_LOGI(TAG, "-> [%s] samples=%zu, bytes=%zu, estimated=%zuKB, oldest=%llums",
+                sTagName[group->first->tag], group->count, group->bytes,
+                group->bytes * period / 1024, (now - group->oldest_us) / 1000);
+        for (j = 0; j < group->first->depth; j++) {
+            char frame[128];
+            memstat_frame(group->first->pcs[j], frame, sizeof(frame));
+            OS_LOGI(TAG, "     #%02d %s", j, frame);
+        }
+    }
+    free(samples);
+    free(groups);
+}
+
+struct memstat_buf {
+    char *buf;
+    size_t size;
+    size_t len;
+};
+
+static void memstat_printf(struct memstat_buf *out, const char *fmt, ...)
+{
+    size_t avail = out->len < out->size ? out->size - out->len : 0;
+    va_list args;
+    va_start(args, fmt);
+    int ret = vsnprintf(avail > 0 ? out->buf + out->len : NULL, avail, fmt, args);
+    va_end(args);
+    if (ret > 0)
+        out->len += ret;
+}
+
+int os_memstat_dump_json(char *buf, size_t size)
+{
+    struct memstat_buf out = { buf, size, 0 };
+    unsigned int period = __atomic_load_n(&sSamplePeriod, __ATOMIC_RELAXED);
+    struct memstat_sample *samples;
+    struct memstat_group *groups;
+    unsigned long long dropped = 0;
+    int count = memstat_collect(&samples, &groups, &dropped);
+    int tag, i, j;
+
+    memstat_printf(&out, "{\"sample_period\":%u,\"dropped\":%llu,\"tags\":[", period, dropped);
+    for (tag = 0; tag < OS_MEMTAG_COUNT; tag++) {
+        struct os_memstat stat;
+        os_memstat_get(tag, &stat);
+        memstat_printf(&out, "%s{\"tag\":\"%s\",\"live_bytes\":%zu,\"live_count\":%zu,\"peak_bytes\":%zu,"
+                       "\"total_bytes\":%llu,\"total_count\":%llu}",
+                       tag > 0 ? "," : "", sTagName[tag], stat.live_bytes, stat.live_count,
+                       stat.peak_bytes, stat.total_bytes, stat.total_count);
+    }
+    memstat_printf(&out, "],\"stacks\":[");
+    unsigned long long now = OS_MONOTONIC_USEC();
+    for (i = 0; i < count; i++) {
+        struct memstat_group *group = &groups[i];
+        memstat_printf(&out, "%s{\"tag\":\"%s\",\"samples\":%zu,\"bytes\":%zu,\"estimated_bytes\":%llu,"
+                       "\"oldest_ms\":%llu,\"frames\":[",
+                       i > 0 ? "," : "", sTagName[group->first->tag], group->count, group->bytes,
+                       (unsigned long long)group->bytes * period, (now - group->oldest_us) / 1000);
+        for (j = 0; j < group->first->depth; j++) {
+            char frame[128];
+            memstat_frame(group->first->pcs[j], frame, sizeof(frame));
+            memstat_printf(&out, "%s\"%s\"", j > 0 ? "," : "", frame);
+        }
+        memstat_printf(&out, "]}");
+    }
+    memstat_printf(&out, "]}");
+    if (count >= 0) {
+        free(samples);
+        free(groups);
+    }
+    return (int)out.len;
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CUTILS_OS_MEMSTAT_H__
+#define __CUTILS_OS_MEMSTAT_H__
+
+#include <stddef.h>
+
+#include "cutils/os_alloc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Allocation accounting cheap enough for release builds, the backend of
+ * OS_MALLOC when ENABLE_MEMORY_ACCOUNTING is defined in cutils/os_alloc.h.
+ *
+ * Every block carries a 16 bytes header with its size and tag (enum
+ * os_memtag). malloc/free only update the counters of the calling thread
+ * with relaxed atomic stores, no lock prefixed instruction, and queries sum
+ * up the counters of all threads. One in every sample period allocations,
+ * at a randomized distance per thread, also records its call stack into a
+ * fixed table, until the block is freed. The live samples of a tag, scaled
+ * by the period, tell which call sites hold its memory.
+ *
+ * Unlike the slab allocator, blocks can't be told from foreign ones without
+ * reading in front of them, so OS_FREE must only get blocks of OS_MALLOC,
+ * never memory handed out by the prebuilt libraries. A bad or double free
+ * is logged and the block is leaked.
+ *
+ * Only in-tree allocations are counted. The prebuilt core allocates its
+ * decoders and its ringbuf with its own malloc, so the decoder tag stays
+ * about 0 and the ringbuf tag covers only the in-tree rings (mixer, tap).
+ */
+#define MEMSTAT_SAMPLE_PERIOD_DEFAULT 1024
+#define MEMSTAT_SAMPLE_MAX            256
+#define MEMSTAT_STACK_DEPTH           16
+
+struct os_memstat {
+    size_t live_bytes;               // requested bytes not freed yet
+    size_t live_count;
+    size_t peak_bytes;               // highest live_bytes seen at samples and queries
+    unsigned long long total_bytes;  // requested bytes since start, growth of reallocs included
+    unsigned long long total_count;
+};
+
+void *os_memstat_malloc(int tag, size_t size);
+
+void *os_memstat_calloc(int tag, size_t n, size_t size);
+
+// A block keeps the tag it was allocated with, tag is used when ptr is NULL
+void *os_memstat_realloc(int tag, void *ptr, size_t size);
+
+void os_memstat_free(void *ptr);
+
+char *os_memstat_strdup(int tag, const char *str);
+
+// Returns -1 if tag is out of range
+int os_memstat_get(int tag, struct os_memstat *stat);
+
+const char *os_memstat_tag_name(int tag);
+
+// Average allocations between two samples, 0 disables sampling
+void os_memstat_set_sample_period(unsigned int period);
+
+void os_memstat_dump(void);
+
+/**
+ * Counters of all tags and live samples grouped by call stack, as json.
+ * Frames are "module+0xoffset" to be symbolized offline. Like snprintf,
+ * returns the length of the whole json even if buf is too small.
+ */
+int os_memstat_dump_json(char *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CUTILS_OS_MEMSTAT_H__ */
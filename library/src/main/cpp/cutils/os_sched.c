@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+#if defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+#include "cutils/log_gate.h"
+#include "cutils/os_sched.h"
+
+#define TAG "os_sched"
+
+#define NICE_URGENT_AUDIO (-19) // ANDROID_PRIORITY_URGENT_AUDIO
+#define NICE_AUDIO        (-16) // ANDROID_PRIORITY_AUDIO
+#define NICE_NORMAL       (0)
+#define NICE_LOW          (10)
+#define NICE_IDLE         (19)
+
+void OS_SCHED_FROM_PRIO(enum os_threadprio prio, struct os_schedattr *attr)
+{
+    memset(attr, 0, sizeof(*attr));
+    attr->policy = OS_SCHED_NORMAL;
+    switch (prio) {
+    case OS_THREAD_PRIO_HARD_REALTIME:
+        attr->policy = OS_SCHED_FIFO;
+        attr->priority = 2;
+        break;
+    case OS_THREAD_PRIO_SOFT_REALTIME:
+        attr->priority = NICE_URGENT_AUDIO;
+        break;
+    case OS_THREAD_PRIO_HIGH:
+        attr->priority = NICE_AUDIO;
+        break;
+    case OS_THREAD_PRIO_LOW:
+        attr->priority = NICE_LOW;
+        break;
+    case OS_THREAD_PRIO_IDLE:
+        attr->priority = NICE_IDLE;
+        break;
+    default:
+        attr->priority = NICE_NORMAL;
+        break;
+    }
+}
+
+#if defined(__linux__)
+int OS_SCHED_APPLY(struct os_schedattr *attr)
+{
+    pid_t tid = (pid_t)syscall(__NR_gettid);
+    int ret = 0;
+
+    if (attr->policy == OS_SCHED_FIFO || attr->policy == OS_SCHED_RR) {
+        struct sched_param param = { .sched_priority = attr->priority };
+        int policy = attr->policy == OS_SCHED_FIFO ? SCHED_FIFO : SCHED_RR;
+        if (sched_setscheduler(tid, policy, &param) != 0) {
+            OS_LOGW(TAG, "Realtime policy not permitted for tid %d: %s, fallback to nice %d",
+                    tid, strerror(errno), NICE_URGENT_AUDIO);
+            if (setpriority(PRIO_PROCESS, tid, NICE_URGENT_AUDIO) != 0)
+                ret = -1;
+        }
+    } else {
+        struct sched_param param = { .sched_priority = 0 };
+        sched_setscheduler(tid, SCHED_OTHER, &param);
+        if (setpriority(PRIO_PROCESS, tid, attr->priority) != 0) {
+            OS_LOGW(TAG, "Failed to set nice %d for tid %d: %s", attr->priority, tid, strerror(errno));
+            ret = -1;
+        }
+    }
+
+    // No pinning still resets the affinity, pooled threads may carry the mask of a previous player
+    cpu_set_t set;
+    unsigned int cpu;
+    CPU_ZERO(&set);
+    if (attr->cpumask != 0) {
+        for (cpu = 0; cpu < sizeof(attr->cpumask) * 8 && cpu < CPU_SETSIZE; cpu++) {
+            if (attr->cpumask & (1ULL << cpu))
+                CPU_SET(cpu, &set);
+        }
+    } else {
+        long cores = sysconf(_SC_NPROCESSORS_CONF);
+        for (cpu = 0; cpu < (unsigned int)(cores > 0 ? cores : 1) && cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, &set);
+    }
+    if (sched_setaffinity(tid, sizeof(set), &set) != 0) {
+        OS_LOGW(TAG, "Failed to set affinity 0x%llx for tid %d: %s", (unsigned long long)attr->cpumask, tid, strerror(errno));
+        ret = -1;
+    }
+    return ret;
+}
+#else
+int OS_SCHED_APPLY(struct os_schedattr *attr)
+{
+    return -1;
+}
+#endif
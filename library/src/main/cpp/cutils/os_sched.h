@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CUTILS_OS_SCHED_H__
+#define __CUTILS_OS_SCHED_H__
+
+#include <stdint.h>
+#include "msgutils/cutils/os_thread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum os_schedpolicy {
+    OS_SCHED_NORMAL = 0,
+    OS_SCHED_FIFO,
+    OS_SCHED_RR,
+};
+
+struct os_schedattr {
+    enum os_schedpolicy policy;
+    int priority;          // nice value (-20~19) for OS_SCHED_NORMAL,
+                           // realtime priority (1~99) for OS_SCHED_FIFO/OS_SCHED_RR
+    uint64_t cpumask;      // cores the thread is allowed to run on, 0 means all cores
+};
+
+// Map os_threadprio to scheduling attributes on Linux/Android,
+// SOFT_REALTIME uses the same nice value as Android audio threads
+void OS_SCHED_FROM_PRIO(enum os_threadprio prio, struct os_schedattr *attr);
+
+// Apply scheduling attributes to the calling thread. If realtime policy
+// isn't permitted, the thread runs with the highest nice value instead.
+int OS_SCHED_APPLY(struct os_schedattr *attr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CUTILS_OS_SCHED_H__ */
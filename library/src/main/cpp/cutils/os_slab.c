@@ -0,0 +1,391 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "cutils/log_gate.h"
+#include "cutils/os_slab.h"
+
+#define TAG "os_slab"
+
+// Everything here is allocated from libc or mmap directly, OS_MALLOC may be
+// mapped to this allocator itself
+
+#define SLAB_CHUNK_SHIFT   16
+#define SLAB_CHUNK_SIZE    (1UL << SLAB_CHUNK_SHIFT)
+#if UINTPTR_MAX > 0xffffffffUL
+#define SLAB_REGION_SIZE   (1UL << 30)  // address space only, chunks are committed on demand
+#else
+#define SLAB_REGION_SIZE   (64UL << 20)
+#endif
+#define SLAB_REGION_CHUNKS (SLAB_REGION_SIZE >> SLAB_CHUNK_SHIFT)
+#define SLAB_CACHE_BYTES   (16 * 1024)  // free bytes a thread keeps per class
+#define SLAB_CACHE_MIN     8
+#define SLAB_CACHE_MAX     256
+
+static const unsigned int sClassSize[] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096,
+};
+#define SLAB_CLASS_COUNT ((int)(sizeof(sClassSize) / sizeof(sClassSize[0])))
+
+struct slab_block {
+    struct slab_block *next;
+};
+
+struct slab_class {
+    pthread_mutex_t lock;
+    struct slab_block *free;  // global free list
+    unsigned int free_count;
+    char *bump;               // blocks never handed out in the newest chunk
+    char *bump_end;
+    unsigned int limit;       // max free blocks in a thread cache
+    unsigned int batch;       // blocks moved per refill or flush
+};
+
+struct slab_cache {
+    struct slab_cache *next;
+    int owner;                // tid of the thread owning the cache, 0 if free, accessed atomically
+    struct slab_block *head[SLAB_CLASS_COUNT];
+    unsigned int count[SLAB_CLASS_COUNT]; // written by owner, accessed atomically for stats
+};
+
+static char *sRegion = NULL;
+static unsigned int sRegionChunks = 0;  // chunks carved, written under sRegionLock
+static unsigned char sChunkClass[SLAB_REGION_CHUNKS]; // class + 1 of each carved chunk
+static pthread_mutex_t sRegionLock = PTHREAD_MUTEX_INITIALIZER;
+static struct slab_class sClasses[SLAB_CLASS_COUNT];
+static unsigned char sClassIndex[SLAB_MAX_SIZE / 16 + 1]; // (size + 15) / 16 to class
+static pthread_once_t sSlabOnce = PTHREAD_ONCE_INIT;
+
+// Caches are linked once and never freed, caches of exited threads are reused
+static struct slab_cache *sCaches = NULL;
+static pthread_key_t sCacheKey;
+static __thread struct slab_cache *tCache = NULL;
+
+static unsigned long long sRefills = 0;
+static unsigned long long sFlushes = 0;
+static unsigned long long sFallbacks = 0;
+
+static void slab_push_global(int cls, struct slab_block *head, struct slab_block *tail, unsigned int count)
+{
+    struct slab_class *sc = &sClasses[cls];
+    pthread_mutex_lock(&sc->lock);
+    tail->next = sc->free;
+    sc->free = head;
+    sc->free_count += count;
+    pthread_mutex_unlock(&sc->lock);
+}
+
+static void slab_cache_release(void *arg)
+{
+    struct slab_cache *cache = (struct slab_cache *)arg;
+    int cls;
+    for (cls = 0; cls < SLAB_CLASS_COUNT; cls++) {
+        struct slab_block *head = cache->head[cls], *tail = head;
+        if (head == NULL)
+            continue;
+        while (tail->next != NULL)
+            tail = tail->next;
+        slab_push_global(cls, head, tail, cache->count[cls]);
+        cache->head[cls] = NULL;
+        __atomic_store_n(&cache->count[cls], 0, __ATOMIC_RELAXED);
+    }
+    // Allocating again from a later destructor claims a cache once more
+    tCache = NULL;
+    __atomic_store_n(&cache->owner, 0, __ATOMIC_RELEASE);
+}
+
+static void slab_init()
+{
+    int i, cls = 0;
+    for (i = 0; i <= SLAB_MAX_SIZE / 16; i++) {
+        while (sClassSize[cls] < (unsigned int)i * 16)
+            cls++;
+        sClassIndex[i] = (unsigned char)cls;
+    }
+    for (cls = 0; cls < SLAB_CLASS_COUNT; cls++) {
+        struct slab_class *sc = &sClasses[cls];
+        pthread_mutex_init(&sc->lock, NULL);
+        sc->limit = SLAB_CACHE_BYTES / sClassSize[cls];
+        if (sc->limit < SLAB_CACHE_MIN)
+            sc->limit = SLAB_CACHE_MIN;
+        else if (sc->limit > SLAB_CACHE_MAX)
+            sc->limit = SLAB_CACHE_MAX;
+        sc->batch = sc->limit / 2;
+    }
+    pthread_key_create(&sCacheKey, slab_cache_release);
+
+    // Reserve one more chunk to align the region, so a block finds its chunk
+    // by masking, then give back the slack
+    size_t reserve = SLAB_REGION_SIZE + SLAB_CHUNK_SIZE;
+    char *map = (char *)mmap(NULL, reserve, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED) {
+        OS_LOGW(TAG, "Failed to reserve %lu bytes, fallback to libc", (unsigned long)SLAB_REGION_SIZE);
+        return;
+    }
+    char *region = (char *)(((uintptr_t)map + SLAB_CHUNK_SIZE - 1) & ~(uintptr_t)(SLAB_CHUNK_SIZE - 1));
+    if (region > map)
+        munmap(map, region - map);
+    if (map + reserve > region + SLAB_REGION_SIZE)
+        munmap(region + SLAB_REGION_SIZE, map + reserve - (region + SLAB_REGION_SIZE));
+    __atomic_store_n(&sRegion, region, __ATOMIC_RELEASE);
+}
+
+static struct slab_cache *slab_cache_get()
+{
+    if (tCache != NULL)
+        return tCache;
+
+    pthread_once(&sSlabOnce, slab_init);
+    int tid = (int)syscall(__NR_gettid);
+    struct slab_cache *cache;
+    for (cache = __atomic_load_n(&sCaches, __ATOMIC_ACQUIRE); cache != NULL; cache = cache->next) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&cache->owner, &expected, tid, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            break;
+    }
+    if (cache == NULL) {
+        cache = (struct slab_cache *)calloc(1, sizeof(struct slab_cache));
+        if (cache == NULL)
+            return NULL;
+        cache->owner = tid;
+        cache->next = __atomic_load_n(&sCaches, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&sCaches, &cache->next, cache, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+    pthread_setspecific(sCacheKey, cache);
+    tCache = cache;
+    return cache;
+}
+
+// Called with the class locked
+static int slab_chunk_carve(int cls)
+{
+    struct slab_class *sc = &sClasses[cls];
+    pthread_mutex_lock(&sRegionLock);
+    if (sRegionChunks == SLAB_REGION_CHUNKS) {
+        pthread_mutex_unlock(&sRegionLock);
+        return -1;
+    }
+    char *chunk = sRegion + ((size_t)sRegionChunks << SLAB_CHUNK_SHIFT);
+    if (mprotect(chunk, SLAB_CHUNK_SIZE, PROT_READ | PROT_WRITE) != 0) {
+        pthread_mutex_unlock(&sRegionLock);
+        return -1;
+    }
+    sChunkClass[sRegionChunks] = (unsigned char)(cls + 1);
+    __atomic_store_n(&sRegionChunks, sRegionChunks + 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&sRegionLock);
+
+    sc->bump = chunk;
+    sc->bump_end = chunk + SLAB_CHUNK_SIZE / sClassSize[cls] * sClassSize[cls];
+    return 0;
+}
+
+// Move a batch of blocks from the global list of cls, or a fresh chunk, to cache
+static unsigned int slab_refill(struct slab_cache *cache, int cls)
+{
+    struct slab_class *sc = &sClasses[cls];
+    struct slab_block *head = cache->head[cls];
+    unsigned int size = sClassSize[cls], count = 0;
+
+    pthread_mutex_lock(&sc->lock);
+    while (count < sc->batch && sc->free != NULL) {
+        struct slab_block *block = sc->free;
+        sc->free = block->next;
+        block->next = head;
+        head = block;
+        count++;
+    }
+    sc->free_count -= count;
+    while (count < sc->batch) {
+        if (sc->bump == sc->bump_end && slab_chunk_carve(cls) != 0)
+            break;
+        struct slab_block *block = (struct slab_block *)sc->bump;
+        sc->bump += size;
+        block->next = head;
+        head = block;
+        count++;
+    }
+    pthread_mutex_unlock(&sc->lock);
+
+    cache->head[cls] = head;
+    __atomic_store_n(&cache->count[cls], cache->count[cls] + count, __ATOMIC_RELAXED);
+    if (count > 0)
+        __atomic_fetch_add(&sRefills, 1, __ATOMIC_RELAXED);
+    return count;
+}
+
+// Move a batch of blocks from cache to the global list of cls
+static void slab_flush(struct slab_cache *cache, int cls)
+{
+    unsigned int count = sClasses[cls].batch, i;
+    struct slab_block *head = cache->head[cls], *tail = head;
+    for (i = 1; i < count; i++)
+        tail = tail->next;
+    cache->head[cls] = tail->next;
+    __atomic_store_n(&cache->count[cls], cache->count[cls] - count, __ATOMIC_RELAXED);
+    slab_push_global(cls, head, tail, count);
+    __atomic_fetch_add(&sFlushes, 1, __ATOMIC_RELAXED);
+}
+
+void *os_slab_malloc(size_t size)
+{
+    if (size > SLAB_MAX_SIZE)
+        return malloc(size);
+    struct slab_cache *cache = slab_cache_get();
+    if (cache == NULL)
+        return malloc(size);
+
+    int cls = sClassIndex[(size + 15) >> 4];
+    struct slab_block *block = cache->head[cls];
+    if (block == NULL) {
+        if (sRegion == NULL || slab_refill(cache, cls) == 0) {
+            __atomic_fetch_add(&sFallbacks, 1, __ATOMIC_RELAXED);
+            return malloc(size);
+        }
+        block = cache->head[cls];
+    }
+    cache->head[cls] = block->next;
+    __atomic_store_n(&cache->count[cls], cache->count[cls] - 1, __ATOMIC_RELAXED);
+    return block;
+}
+
+void *os_slab_calloc(size_t n, size_t size)
+{
+    if (size != 0 && n > SIZE_MAX / size)
+        return NULL;
+    void *ptr = os_slab_malloc(n * size);
+    if (ptr != NULL)
+        memset(ptr, 0, n * size);
+    return ptr;
+}
+
+size_t os_slab_usable_size(void *ptr)
+{
+    char *region = __atomic_load_n(&sRegion, __ATOMIC_ACQUIRE);
+    uintptr_t offset = (uintptr_t)ptr - (uintptr_t)region;
+    if (region == NULL || offset >= SLAB_REGION_SIZE)
+        return 0;
+    return sClassSize[sChunkClass[offset >> SLAB_CHUNK_SHIFT] - 1];
+}
+
+void os_slab_free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+    char *region = __atomic_load_n(&sRegion, __ATOMIC_ACQUIRE);
+    uintptr_t offset = (uintptr_t)ptr - (uintptr_t)region;
+    if (region == NULL || offset >= SLAB_REGION_SIZE) {
+        free(ptr);
+        return;
+    }
+
+    int cls = sChunkClass[offset >> SLAB_CHUNK_SHIFT] - 1;
+    unsigned int size = sClassSize[cls];
+    // Round down to the block, a C++ object may be deleted through a
+    // pointer to one of its non-primary bases
+    uintptr_t in_chunk = offset & (SLAB_CHUNK_SIZE - 1);
+    struct slab_block *block = (struct slab_block *)((char *)ptr - in_chunk % size);
+
+    struct slab_cache *cache = slab_cache_get();
+    if (cache == NULL) {
+        slab_push_global(cls, block, block, 1);
+        return;
+    }
+    block->next = cache->head[cls];
+    cache->head[cls] = block;
+    __atomic_store_n(&cache->count[cls], cache->count[cls] + 1, __ATOMIC_RELAXED);
+    if (cache->count[cls] > sClasses[cls].limit)
+        slab_flush(cache, cls);
+}
+
+void *os_slab_realloc(void *ptr, size_t size)
+{
+    if (ptr == NULL)
+        return os_slab_malloc(size);
+    size_t old_size = os_slab_usable_size(ptr);
+    if (old_size == 0)
+        return realloc(ptr, size);
+    // Stay in place unless it fits a smaller class
+    if (size <= old_size && size > old_size / 2)
+        return ptr;
+    void *new_ptr = os_slab_malloc(size);
+    if (new_ptr == NULL)
+        return NULL;
+    memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+    os_slab_free(ptr);
+    return new_ptr;
+}
+
+char *os_slab_strdup(const char *str)
+{
+    if (str == NULL)
+        return NULL;
+    size_t len = strlen(str) + 1;
+    char *dup = (char *)os_slab_malloc(len);
+    if (dup != NULL)
+        memcpy(dup, str, len);
+    return dup;
+}
+
+void os_slab_get_stats(struct os_slab_stats *stats)
+{
+    int cls;
+    memset(stats, 0, sizeof(*stats));
+    stats->committed = (size_t)__atomic_load_n(&sRegionChunks, __ATOMIC_RELAXED) << SLAB_CHUNK_SHIFT;
+    if (__atomic_load_n(&sRegion, __ATOMIC_ACQUIRE) != NULL) {
+        for (cls = 0; cls < SLAB_CLASS_COUNT; cls++) {
+            struct slab_class *sc = &sClasses[cls];
+            pthread_mutex_lock(&sc->lock);
+            stats->free += (size_t)sc->free_count * sClassSize[cls];
+            pthread_mutex_unlock(&sc->lock);
+        }
+    }
+    struct slab_cache *cache;
+    for (cache = __atomic_load_n(&sCaches, __ATOMIC_ACQUIRE); cache != NULL; cache = cache->next) {
+        for (cls = 0; cls < SLAB_CLASS_COUNT; cls++)
+            stats->cached += (size_t)__atomic_load_n(&cache->count[cls], __ATOMIC_RELAXED) * sClassSize[cls];
+    }
+    stats->refills = __atomic_load_n(&sRefills, __ATOMIC_RELAXED);
+    stats->flushes = __atomic_load_n(&sFlushes, __ATOMIC_RELAXED);
+    stats->fallbacks = __atomic_load_n(&sFallbacks, __ATOMIC_RELAXED);
+}
+
+void os_slab_dump(void)
+{
+    struct os_slab_stats stats;
+    int cls;
+    os_slab_get_stats(&stats);
+    OS_LOGI(TAG, "committed=%zuKB, free=%zuKB, cached=%zuKB, refills=%llu, flushes=%llu, fallbacks=%llu",
+            stats.committed / 1024, stats.free / 1024, stats.cached / 1024,
+            stats.refills, stats.flushes, stats.fallbacks);
+    if (__atomic_load_n(&sRegion, __ATOMIC_ACQUIRE) == NULL)
+        return;
+    for (cls = 0; cls < SLAB_CLASS_COUNT; cls++) {
+        struct slab_class *sc = &sClasses[cls];
+        pthread_mutex_lock(&sc->lock);
+        unsigned int free_count = sc->free_count;
+        pthread_mutex_unlock(&sc->lock);
+        if (free_count > 0)
+            OS_LOGI(TAG, "-> class %u: free=%u", sClassSize[cls], free_count);
+    }
+}
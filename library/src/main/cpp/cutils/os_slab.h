@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CUTILS_OS_SLAB_H__
+#define __CUTILS_OS_SLAB_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Size-class slab allocator, the backend of OS_MALLOC/OS_NEW when
+ * ENABLE_MEMORY_SLAB is defined in cutils/os_alloc.h.
+ *
+ * Requests up to SLAB_MAX_SIZE are rounded up to one of the size classes and
+ * served from 64KB chunks of a virtual region reserved at first use, each
+ * chunk holds blocks of one class. Every thread keeps a cache of free blocks
+ * per class, so that most malloc/free pairs take no lock, caches exchange
+ * blocks with the per-class global lists in batches. Larger requests, or all
+ * requests once the region is used up, go to libc malloc.
+ *
+ * os_slab_free/os_slab_realloc also accept pointers from libc malloc, found
+ * by their address being out of the region, so memory is free to cross
+ * between in-tree code and the prebuilt libraries. But memory from
+ * os_slab_malloc must never be released by libc free.
+ *
+ * Chunks are never returned to the system, os_slab_get_stats tells how much
+ * of them is sitting in free lists.
+ */
+#define SLAB_MAX_SIZE 4096
+
+struct os_slab_stats {
+    size_t committed;        // bytes of chunks carved from the region
+    size_t free;             // bytes of free blocks in global lists
+    size_t cached;           // bytes of free blocks in thread caches
+    unsigned long long refills;  // batches moved from global lists to thread caches
+    unsigned long long flushes;  // batches moved from thread caches to global lists
+    unsigned long long fallbacks; // requests served by libc as the region was used up
+};
+
+void *os_slab_malloc(size_t size);
+
+void *os_slab_calloc(size_t n, size_t size);
+
+void *os_slab_realloc(void *ptr, size_t size);
+
+void os_slab_free(void *ptr);
+
+char *os_slab_strdup(const char *str);
+
+// Usable size of ptr, 0 if it isn't from the slab region
+size_t os_slab_usable_size(void *ptr);
+
+void os_slab_get_stats(struct os_slab_stats *stats);
+
+void os_slab_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CUTILS_OS_SLAB_H__ */
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cutils/os_trace.h"
+
+#if defined(ENABLE_TRACE)
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "cutils/os_alloc.h"
+#include "msgutils/cutils/os_time.h"
+#include "cutils/log_gate.h"
+
+#define TAG "os_trace"
+
+struct trace_event {
+    const char *name;
+    unsigned long long ts_us;
+    char phase;
+};
+
+struct trace_buffer {
+    struct trace_buffer *next;
+    int owner;          // tid of the thread owning the buffer, 0 if free, accessed atomically
+    int tid;            // tid of the recorded events
+    unsigned int count; // events ever recorded, accessed atomically
+    struct trace_event events[TRACE_EVENTS_PER_THREAD];
+};
+
+// Buffers are linked once and never freed, buffers of exited threads are reused
+static struct trace_buffer *sBuffers = NULL;
+static pthread_key_t sBufferKey;
+static pthread_once_t sBufferKeyOnce = PTHREAD_ONCE_INIT;
+static __thread struct trace_buffer *tBuffer = NULL;
+
+static void trace_buffer_release(void *arg)
+{
+    struct trace_buffer *buf = (struct trace_buffer *)arg;
+    __atomic_store_n(&buf->owner, 0, __ATOMIC_RELEASE);
+}
+
+static void trace_key_create()
+{
+    pthread_key_create(&sBufferKey, trace_buffer_release);
+}
+
+static struct trace_buffer *trace_buffer_get()
+{
+    if (tBuffer != NULL)
+        return tBuffer;
+
+    pthread_once(&sBufferKeyOnce, trace_key_create);
+    int tid = (int)syscall(__NR_gettid);
+    struct trace_buffer *buf;
+    for (buf = __atomic_load_n(&sBuffers, __ATOMIC_ACQUIRE); buf != NULL; buf = buf->next) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&buf->owner, &expected, tid, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+            break;
+    }
+    if (buf == NULL) {
+        buf = OS_CALLOC(1, sizeof(struct trace_buffer));
+        if (buf == NULL)
+            return NULL;
+        buf->owner = tid;
+        buf->next = __atomic_load_n(&sBuffers, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&sBuffers, &buf->next, buf, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+    buf->tid = tid;
+    __atomic_store_n(&buf->count, 0, __ATOMIC_RELEASE);
+    pthread_setspecific(sBufferKey, buf);
+    tBuffer = buf;
+    return buf;
+}
+
+void os_trace_event(const char *name, char phase)
+{
+    struct trace_buffer *buf = trace_buffer_get();
+    if (buf == NULL)
+        return;
+    // Only the owner thread writes events, publish with release store
+    unsigned int count = buf->count;
+    struct trace_event *event = &buf->events[count % TRACE_EVENTS_PER_THREAD];
+    event->name = name;
+    event->ts_us = OS_MONOTONIC_USEC();
+    event->phase = phase;
+    __atomic_store_n(&buf->count, count + 1, __ATOMIC_RELEASE);
+}
+
+int os_trace_dump(const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        OS_LOGE(TAG, "Failed to open trace file: %s", path);
+        return -1;
+    }
+
+    int pid = (int)getpid();
+    bool first = true;
+    struct trace_buffer *buf;
+    fprintf(fp, "{\"traceEvents\":[");
+    for (buf = __atomic_load_n(&sBuffers, __ATOMIC_ACQUIRE); buf != NULL; buf = buf->next) {
+        unsigned int count = __atomic_load_n(&buf->count, __ATOMIC_ACQUIRE);
+        unsigned int i = count > TRACE_EVENTS_PER_THREAD ? count - TRACE_EVENTS_PER_THREAD : 0;
+        for (; i < count; i++) {
+            struct trace_event *event = &buf->events[i % TRACE_EVENTS_PER_THREAD];
+            fprintf(fp, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu,\"pid\":%d,\"tid\":%d}",
+                    first ? "" : ",", event->name, event->phase, event->ts_us, pid, buf->tid);
+            first = false;
+        }
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+    return 0;
+}
+#endif
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CUTILS_OS_TRACE_H__
+#define __CUTILS_OS_TRACE_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+
+//#define ENABLE_TRACE
+
+// ---------------------------------------------------------------------------
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Timeline tracing of the playback pipeline. Spans are recorded into a ring
+ * buffer owned by the calling thread without any lock, the latest
+ * TRACE_EVENTS_PER_THREAD events of each thread are kept, and dumped as
+ * Chrome trace json that can be opened by chrome://tracing or Perfetto.
+ *
+ * @name must be a string literal, only its pointer is recorded.
+ */
+#define TRACE_EVENTS_PER_THREAD 4096
+
+#if defined(ENABLE_TRACE)
+void os_trace_event(const char *name, char phase);
+int os_trace_dump(const char *path);
+
+    #define OS_TRACE_BEGIN(name) os_trace_event(name, 'B')
+    #define OS_TRACE_END(name)   os_trace_event(name, 'E')
+    #define OS_TRACE_INSTANT(name) os_trace_event(name, 'i')
+    #define OS_TRACE_DUMP(path)  os_trace_dump(path)
+
+#else
+    #define OS_TRACE_BEGIN(name) do {} while (0)
+    #define OS_TRACE_END(name)   do {} while (0)
+    #define OS_TRACE_INSTANT(name) do {} while (0)
+    #define OS_TRACE_DUMP(path)  (-1)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+// ---------------------------------------------------------------------------
+
+#endif /* __CUTILS_OS_TRACE_H__ */
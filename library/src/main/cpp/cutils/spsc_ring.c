@@ -0,0 +1,390 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define OS_MEMORY_TAG OS_MEMTAG_RINGBUF
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <linux/memfd.h>
+
+#include "cutils/os_alloc.h"
+#include "msgutils/cutils/os_time.h"
+#include "cutils/os_futex.h"
+#include "cutils/spsc_ring.h"
+
+#define CACHELINE_SIZE 64
+
+#define FLAG_DONE  0x1
+#define FLAG_ABORT 0x2
+
+struct spsc_ring {
+    // Producer side
+    unsigned int head __attribute__((aligned(CACHELINE_SIZE)));
+    unsigned int tail_cache;    // last tail seen by producer
+    int writer_waiting;         // free bytes the sleeping writer needs, 0 if awake
+    int writer_seq;             // futex word the writer sleeps on
+    int write_watermark;
+    unsigned long long reader_wakeups;
+    unsigned long long writer_sleeps;
+    // Consumer side
+    unsigned int tail __attribute__((aligned(CACHELINE_SIZE)));
+    unsigned int head_cache;    // last head seen by consumer
+    int reader_waiting;         // filled bytes the sleeping reader needs, 0 if awake
+    int reader_seq;             // futex word the reader sleeps on
+    int read_watermark;
+    unsigned long long writer_wakeups;
+    unsigned long long reader_sleeps;
+    // Read only after creation, except flags
+    int flags __attribute__((aligned(CACHELINE_SIZE)));
+    unsigned int size;          // power of two
+    unsigned int mask;
+    char *data;
+    int memfd;                  // pages of data mapped twice if >= 0
+};
+
+// Wake the reader once enough is filled, called after publishing head,
+// pairs with the fence in ring_wait_readable
+static void ring_wake_reader(struct spsc_ring *rb, bool force)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int need = __atomic_load_n(&rb->reader_waiting, __ATOMIC_RELAXED);
+    if (need == 0)
+        return;
+    unsigned int filled = __atomic_load_n(&rb->head, __ATOMIC_RELAXED) - __atomic_load_n(&rb->tail, __ATOMIC_RELAXED);
+    if (force || filled >= (unsigned int)need) {
+        __atomic_add_fetch(&rb->reader_seq, 1, __ATOMIC_RELEASE);
+        os_futex_wake(&rb->reader_seq, 1);
+        __atomic_add_fetch(&rb->reader_wakeups, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Wake the writer once enough is free, called after publishing tail
+static void ring_wake_writer(struct spsc_ring *rb, bool force)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int need = __atomic_load_n(&rb->writer_waiting, __ATOMIC_RELAXED);
+    if (need == 0)
+        return;
+    unsigned int space = rb->size - (__atomic_load_n(&rb->head, __ATOMIC_RELAXED) - __atomic_load_n(&rb->tail, __ATOMIC_RELAXED));
+    if (force || space >= (unsigned int)need) {
+        __atomic_add_fetch(&rb->writer_seq, 1, __ATOMIC_RELEASE);
+        os_futex_wake(&rb->writer_seq, 1);
+        __atomic_add_fetch(&rb->writer_wakeups, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static unsigned long long ring_deadline(unsigned int timeout_ms)
+{
+    return timeout_ms != 0 ? OS_MONOTONIC_USEC() + (unsigned long long)timeout_ms * 1000 : 0;
+}
+
+// Bytes addressable contiguously from offset
+static inline unsigned int ring_contiguous(struct spsc_ring *rb, unsigned int offset)
+{
+    return rb->memfd >= 0 ? rb->size : rb->size - offset;
+}
+
+// Reserve twice the size, then map the memfd over both halves
+static char *ring_map_mirrored(int fd, unsigned int size)
+{
+    if (ftruncate(fd, size) != 0)
+        return NULL;
+    char *base = mmap(NULL, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return NULL;
+    if (mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+        mmap(base + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, size * 2);
+        return NULL;
+    }
+    return base;
+}
+
+static spsc_ring_t ring_create(int size, bool mirrored)
+{
+    if (size <= 0)
+        return NULL;
+    unsigned int capacity = mirrored ? (unsigned int)sysconf(_SC_PAGESIZE) : 1;
+    while (capacity < (unsigned int)size)
+        capacity <<= 1;
+    struct spsc_ring *rb = NULL;
+    if (posix_memalign((void **)&rb, CACHELINE_SIZE, sizeof(struct spsc_ring)) != 0)
+        return NULL;
+    memset(rb, 0, sizeof(struct spsc_ring));
+    rb->memfd = -1;
+    rb->read_watermark = 1;
+    rb->write_watermark = 1;
+    if (mirrored) {
+        // memfd_create isn't exported by bionic before API 30
+        int fd = syscall(__NR_memfd_create, "spsc_ring", MFD_CLOEXEC);
+        if (fd >= 0) {
+            rb->data = ring_map_mirrored(fd, capacity);
+            if (rb->data != NULL)
+                rb->memfd = fd;
+            else
+                close(fd);
+        }
+    } else {
+        rb->data = OS_MALLOC(capacity);
+    }
+    if (rb->data == NULL) {
+        free(rb);
+        return NULL;
+    }
+    rb->size = capacity;
+    rb->mask = capacity - 1;
+    return rb;
+}
+
+spsc_ring_t spsc_ring_create(int size)
+{
+    return ring_create(size, false);
+}
+
+spsc_ring_t spsc_ring_create_mirrored(int size)
+{
+    return ring_create(size, true);
+}
+
+void spsc_ring_destroy(spsc_ring_t rb)
+{
+    if (rb == NULL)
+        return;
+    if (rb->memfd >= 0) {
+        munmap(rb->data, rb->size * 2);
+        close(rb->memfd);
+    } else {
+        OS_FREE(rb->data);
+    }
+    free(rb);
+}
+
+bool spsc_ring_is_mirrored(spsc_ring_t rb)
+{
+    return rb->memfd >= 0;
+}
+
+void spsc_ring_abort(spsc_ring_t rb)
+{
+    __atomic_or_fetch(&rb->flags, FLAG_ABORT, __ATOMIC_RELEASE);
+    ring_wake_reader(rb, true);
+    ring_wake_writer(rb, true);
+}
+
+void spsc_ring_reset(spsc_ring_t rb)
+{
+    __atomic_store_n(&rb->head, 0U, __ATOMIC_RELAXED);
+    __atomic_store_n(&rb->tail, 0U, __ATOMIC_RELAXED);
+    rb->tail_cache = 0;
+    rb->head_cache = 0;
+    __atomic_store_n(&rb->flags, 0, __ATOMIC_RELEASE);
+}
+
+int spsc_ring_bytes_available(spsc_ring_t rb)
+{
+    return (int)(rb->size - spsc_ring_bytes_filled(rb));
+}
+
+int spsc_ring_bytes_filled(spsc_ring_t rb)
+{
+    unsigned int tail = __atomic_load_n(&rb->tail, __ATOMIC_ACQUIRE);
+    unsigned int head = __atomic_load_n(&rb->head, __ATOMIC_ACQUIRE);
+    return (int)(head - tail);
+}
+
+int spsc_ring_get_size(spsc_ring_t rb)
+{
+    return (int)rb->size;
+}
+
+// Wait until bytes can be read at tail, RB_OK or RB_DONE/RB_ABORT/RB_TIMEOUT.
+// Returns at once if anything is filled, once empty sleeps until need bytes are
+static int ring_wait_readable(struct spsc_ring *rb, unsigned int tail, int need, unsigned long long deadline)
+{
+    while (1) {
+        if (__atomic_load_n(&rb->flags, __ATOMIC_ACQUIRE) & FLAG_ABORT)
+            return RB_ABORT;
+        if (rb->head_cache != tail)
+            return RB_OK;
+        rb->head_cache = __atomic_load_n(&rb->head, __ATOMIC_ACQUIRE);
+        if (rb->head_cache != tail)
+            return RB_OK;
+
+        // Head written before done is visible once done is seen
+        if (__atomic_load_n(&rb->flags, __ATOMIC_ACQUIRE) & FLAG_DONE) {
+            rb->head_cache = __atomic_load_n(&rb->head, __ATOMIC_ACQUIRE);
+            return rb->head_cache != tail ? RB_OK : RB_DONE;
+        }
+
+        int seq = __atomic_load_n(&rb->reader_seq, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&rb->reader_waiting, need, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        int ret = 0;
+        if (__atomic_load_n(&rb->head, __ATOMIC_RELAXED) - tail < (unsigned int)need &&
+            __atomic_load_n(&rb->flags, __ATOMIC_RELAXED) == 0) {
+            __atomic_store_n(&rb->reader_sleeps, rb->reader_sleeps + 1, __ATOMIC_RELAXED);
+            ret = os_futex_wait(&rb->reader_seq, seq, deadline);
+        }
+        __atomic_store_n(&rb->reader_waiting, 0, __ATOMIC_RELAXED);
+        if (ret == -ETIMEDOUT)
+            return RB_TIMEOUT;
+    }
+}
+
+// Wait until bytes can be written at head, RB_OK or RB_ABORT/RB_TIMEOUT.
+// Returns at once if anything is free, once full sleeps until need bytes are
+static int ring_wait_writable(struct spsc_ring *rb, unsigned int head, int need, unsigned long long deadline)
+{
+    while (1) {
+        if (__atomic_load_n(&rb->flags, __ATOMIC_ACQUIRE) & FLAG_ABORT)
+            return RB_ABORT;
+        if (head - rb->tail_cache != rb->size)
+            return RB_OK;
+        rb->tail_cache = __atomic_load_n(&rb->tail, __ATOMIC_ACQUIRE);
+        if (head - rb->tail_cache != rb->size)
+            return RB_OK;
+
+        int seq = __atomic_load_n(&rb->writer_seq, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&rb->writer_waiting, need, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        int ret = 0;
+        if (rb->size - (head - __atomic_load_n(&rb->tail, __ATOMIC_RELAXED)) < (unsigned int)need &&
+            (__atomic_load_n(&rb->flags, __ATOMIC_RELAXED) & FLAG_ABORT) == 0) {
+            __atomic_store_n(&rb->writer_sleeps, rb->writer_sleeps + 1, __ATOMIC_RELAXED);
+            ret = os_futex_wait(&rb->writer_seq, seq, deadline);
+        }
+        __atomic_store_n(&rb->writer_waiting, 0, __ATOMIC_RELAXED);
+        if (ret == -ETIMEDOUT)
+            return RB_TIMEOUT;
+    }
+}
+
+int spsc_ring_acquire_read(spsc_ring_t rb, char **ptr, int *len, unsigned int timeout_ms)
+{
+    unsigned int tail = rb->tail;
+    int ret = ring_wait_readable(rb, tail, rb->read_watermark, ring_deadline(timeout_ms));
+    if (ret != RB_OK)
+        return ret;
+    unsigned int offset = tail & rb->mask;
+    unsigned int filled = rb->head_cache - tail;
+    *ptr = rb->data + offset;
+    *len = (int)(ring_contiguous(rb, offset) < filled ? ring_contiguous(rb, offset) : filled);
+    return RB_OK;
+}
+
+void spsc_ring_commit_read(spsc_ring_t rb, int len)
+{
+    __atomic_store_n(&rb->tail, rb->tail + (unsigned int)len, __ATOMIC_RELEASE);
+    ring_wake_writer(rb, false);
+}
+
+int spsc_ring_acquire_write(spsc_ring_t rb, char **ptr, int *len, unsigned int timeout_ms)
+{
+    unsigned int head = rb->head;
+    int ret = ring_wait_writable(rb, head, rb->write_watermark, ring_deadline(timeout_ms));
+    if (ret != RB_OK)
+        return ret;
+    unsigned int offset = head & rb->mask;
+    unsigned int space = rb->size - (head - rb->tail_cache);
+    *ptr = rb->data + offset;
+    *len = (int)(ring_contiguous(rb, offset) < space ? ring_contiguous(rb, offset) : space);
+    return RB_OK;
+}
+
+void spsc_ring_commit_write(spsc_ring_t rb, int len)
+{
+    __atomic_store_n(&rb->head, rb->head + (unsigned int)len, __ATOMIC_RELEASE);
+    ring_wake_reader(rb, false);
+}
+
+int spsc_ring_read(spsc_ring_t rb, char *buf, int len, unsigned int timeout_ms)
+{
+    unsigned long long deadline = ring_deadline(timeout_ms);
+    int done = 0;
+    while (done < len) {
+        int need = len - done < rb->read_watermark ? len - done : rb->read_watermark;
+        int ret = ring_wait_readable(rb, rb->tail, need, deadline);
+        if (ret == RB_ABORT)
+            return ret;
+        if (ret != RB_OK)
+            return done > 0 ? done : ret;
+        // Copy everything readable, both sides of the wrap, then publish once
+        unsigned int tail = rb->tail;
+        unsigned int filled = rb->head_cache - tail;
+        unsigned int count = (unsigned int)(len - done) < filled ? (unsigned int)(len - done) : filled;
+        unsigned int offset = tail & rb->mask;
+        unsigned int first = ring_contiguous(rb, offset) < count ? ring_contiguous(rb, offset) : count;
+        memcpy(buf + done, rb->data + offset, first);
+        memcpy(buf + done + first, rb->data, count - first);
+        done += count;
+        spsc_ring_commit_read(rb, count);
+    }
+    return done;
+}
+
+int spsc_ring_write(spsc_ring_t rb, char *buf, int len, unsigned int timeout_ms)
+{
+    unsigned long long deadline = ring_deadline(timeout_ms);
+    int done = 0;
+    while (done < len) {
+        int need = len - done < rb->write_watermark ? len - done : rb->write_watermark;
+        int ret = ring_wait_writable(rb, rb->head, need, deadline);
+        if (ret == RB_ABORT)
+            return ret;
+        if (ret != RB_OK)
+            return done > 0 ? done : ret;
+        unsigned int head = rb->head;
+        unsigned int space = rb->size - (head - rb->tail_cache);
+        unsigned int count = (unsigned int)(len - done) < space ? (unsigned int)(len - done) : space;
+        unsigned int offset = head & rb->mask;
+        unsigned int first = ring_contiguous(rb, offset) < count ? ring_contiguous(rb, offset) : count;
+        memcpy(rb->data + offset, buf + done, first);
+        memcpy(rb->data, buf + done + first, count - first);
+        done += count;
+        spsc_ring_commit_write(rb, count);
+    }
+    return done;
+}
+
+void spsc_ring_done_write(spsc_ring_t rb)
+{
+    __atomic_or_fetch(&rb->flags, FLAG_DONE, __ATOMIC_RELEASE);
+    ring_wake_reader(rb, true);
+}
+
+void spsc_ring_set_watermarks(spsc_ring_t rb, int read_bytes, int write_bytes)
+{
+    if (read_bytes < 1)
+        read_bytes = 1;
+    if (read_bytes > (int)rb->size)
+        read_bytes = (int)rb->size;
+    if (write_bytes < 1)
+        write_bytes = 1;
+    if (write_bytes > (int)rb->size)
+        write_bytes = (int)rb->size;
+    rb->read_watermark = read_bytes;
+    rb->write_watermark = write_bytes;
+}
+
+void spsc_ring_get_counters(spsc_ring_t rb, struct spsc_ring_counters *counters)
+{
+    counters->reader_wakeups = __atomic_load_n(&rb->reader_wakeups, __ATOMIC_RELAXED);
+    counters->writer_wakeups = __atomic_load_n(&rb->writer_wakeups, __ATOMIC_RELAXED);
+    counters->reader_sleeps = __atomic_load_n(&rb->reader_sleeps, __ATOMIC_RELAXED);
+    counters->writer_sleeps = __atomic_load_n(&rb->writer_sleeps, __ATOMIC_RELAXED);
+}
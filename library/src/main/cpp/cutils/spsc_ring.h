@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CUTILS_SPSC_RING_H__
+#define __CUTILS_SPSC_RING_H__
+
+#include <stdbool.h>
+#include "msgutils/cutils/ringbuf.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct spsc_ring *spsc_ring_t;
+
+struct spsc_ring_counters {
+    unsigned long long reader_wakeups;  // futex wakes issued to the sleeping reader
+    unsigned long long writer_wakeups;
+    unsigned long long reader_sleeps;   // times the reader went to sleep
+    unsigned long long writer_sleeps;
+};
+
+/**
+ * Lock-free ring for exactly one producer thread and one consumer thread,
+ * drop-in for ringbuf where that holds. Head and tail are atomic indexes on
+ * separate cache lines, a side only sleeps (futex) when the ring is empty or
+ * full, and the other side only makes a syscall if it is sleeping.
+ *
+ * Return values and timeouts follow ringbuf: bytes transferred, or RB_DONE,
+ * RB_ABORT, RB_TIMEOUT, RB_FAIL; timeout_ms 0 waits forever.
+ */
+spsc_ring_t spsc_ring_create(int size);
+
+/**
+ * Same ring with its pages mapped twice back to back, so any region up to the
+ * ring size is contiguous and acquire never splits at the wrap. The size is
+ * rounded up to pages. Returns NULL if memfd or mmap is unavailable, callers
+ * fall back to spsc_ring_create.
+ */
+spsc_ring_t spsc_ring_create_mirrored(int size);
+
+void spsc_ring_destroy(spsc_ring_t rb);
+
+bool spsc_ring_is_mirrored(spsc_ring_t rb);
+
+// Wake both sides, pending and further reads/writes return RB_ABORT
+void spsc_ring_abort(spsc_ring_t rb);
+
+// Drop all data and clear done/abort, no reader or writer may be active
+void spsc_ring_reset(spsc_ring_t rb);
+
+int spsc_ring_bytes_available(spsc_ring_t rb);
+
+int spsc_ring_bytes_filled(spsc_ring_t rb);
+
+int spsc_ring_get_size(spsc_ring_t rb);
+
+// Block until len bytes are read, or less if writer is done
+int spsc_ring_read(spsc_ring_t rb, char *buf, int len, unsigned int timeout_ms);
+
+// Block until len bytes are written
+int spsc_ring_write(spsc_ring_t rb, char *buf, int len, unsigned int timeout_ms);
+
+/**
+ * Zero-copy access, the consumer reads from and the producer writes into the
+ * ring memory directly. Acquire waits until at least one byte is readable or
+ * writable and returns RB_OK with the contiguous region at ptr/len, the region
+ * is shorter than what is filled/available when it wraps unless the ring is
+ * mirrored, acquire again after commit for the rest. Commit publishes len
+ * bytes of the acquired region.
+ */
+int spsc_ring_acquire_read(spsc_ring_t rb, char **ptr, int *len, unsigned int timeout_ms);
+
+void spsc_ring_commit_read(spsc_ring_t rb, int len);
+
+int spsc_ring_acquire_write(spsc_ring_t rb, char **ptr, int *len, unsigned int timeout_ms);
+
+void spsc_ring_commit_write(spsc_ring_t rb, int len);
+
+/**
+ * Batch wakeups: once the reader had to sleep on an empty ring it is only
+ * woken when read_bytes are filled (or fewer if that completes its read), on
+ * done or abort. Likewise the writer sleeping on a full ring is woken when
+ * write_bytes are free. Both default to 1, values are clamped to the ring
+ * size. Set before the ring is used.
+ */
+void spsc_ring_set_watermarks(spsc_ring_t rb, int read_bytes, int write_bytes);
+
+// Sample twice to derive wakeups per second
+void spsc_ring_get_counters(spsc_ring_t rb, struct spsc_ring_counters *counters);
+
+// No more data will be written, reader gets the remaining data then RB_DONE
+void spsc_ring_done_write(spsc_ring_t rb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CUTILS_SPSC_RING_H__ */
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define OS_MEMORY_TAG OS_MEMTAG_LOOPER
+
+#include "cutils/os_alloc.h"
+#include "cutils/timer_heap.h"
+
+#define TIMER_HEAP_MIN_CAPACITY 16
+
+static inline bool node_before(struct timer_heap_node *a, struct timer_heap_node *b)
+{
+    if (a->deadline != b->deadline)
+        return a->deadline < b->deadline;
+    return a->order < b->order;
+}
+
+static inline void heap_place(struct timer_heap *heap, struct timer_heap_node *node, int index)
+{
+    heap->nodes[index] = node;
+    node->index = index;
+}
+
+static void heap_sift_up(struct timer_heap *heap, int index)
+{
+    struct timer_heap_node *node = heap->nodes[index];
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (!node_before(node, heap->nodes[parent]))
+            break;
+        heap_place(heap, heap->nodes[parent], index);
+        index = parent;
+    }
+    heap_place(heap, node, index);
+}
+
+static void heap_sift_down(struct timer_heap *heap, int index)
+{
+    struct timer_heap_node *node = heap->nodes[index];
+    while (1) {
+        int child = index * 2 + 1;
+        if (child >= heap->count)
+            break;
+        if (child + 1 < heap->count && node_before(heap->nodes[child + 1], heap->nodes[child]))
+            child++;
+        if (!node_before(heap->nodes[child], node))
+            break;
+        heap_place(heap, heap->nodes[child], index);
+        index = child;
+    }
+    heap_place(heap, node, index);
+}
+
+void timer_heap_init(struct timer_heap *heap)
+{
+    heap->nodes = NULL;
+    heap->count = 0;
+    heap->capacity = 0;
+    heap->pushed = 0;
+}
+
+void timer_heap_deinit(struct timer_heap *heap)
+{
+    int i;
+    for (i = 0; i < heap->count; i++)
+        heap->nodes[i]->index = -1;
+    OS_FREE(heap->nodes);
+    heap->count = 0;
+    heap->capacity = 0;
+}
+
+int timer_heap_push(struct timer_heap *heap, struct timer_heap_node *node, unsigned long long deadline)
+{
+    if (heap->count == heap->capacity) {
+        int capacity = heap->capacity > 0 ? heap->capacity * 2 : TIMER_HEAP_MIN_CAPACITY;
+        struct timer_heap_node **nodes = OS_REALLOC(heap->nodes, capacity * sizeof(struct timer_heap_node *));
+        if (nodes == NULL)
+            return -1;
+        heap->nodes = nodes;
+        heap->capacity = capacity;
+    }
+    node->deadline = deadline;
+    node->order = heap->pushed++;
+    heap->nodes[heap->count] = node;
+    heap->count++;
+    heap_sift_up(heap, heap->count - 1);
+    return 0;
+}
+
+void timer_heap_remove(struct timer_heap *heap, struct timer_heap_node *node)
+{
+    int index = node->index;
+    if (index < 0)
+        return;
+    node->index = -1;
+    heap->count--;
+    if (index == heap->count)
+        return;
+    // Move the last node into the hole, it may belong above or below it
+    heap_place(heap, heap->nodes[heap->count], index);
+    if (index > 0 && node_before(heap->nodes[index], heap->nodes[(index - 1) / 2]))
+        heap_sift_up(heap, index);
+    else
+        heap_sift_down(heap, index);
+}
+
+struct timer_heap_node *timer_heap_pop(struct timer_heap *heap)
+{
+    struct timer_heap_node *node = timer_heap_top(heap);
+    if (node != NULL)
+        timer_heap_remove(heap, node);
+    return node;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CUTILS_TIMER_HEAP_H__
+#define __CUTILS_TIMER_HEAP_H__
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Binary min-heap of deadlines, nodes are embedded in the caller's objects
+ * and remember their slot, so push, remove and pop are O(log n) and the
+ * earliest deadline is O(1). Equal deadlines pop in push order.
+ * Not thread safe, callers lock around it.
+ */
+struct timer_heap_node {
+    unsigned long long deadline;
+    unsigned long long order;   // push order, breaks ties
+    int index;                  // slot in heap, -1 if not queued
+};
+
+struct timer_heap {
+    struct timer_heap_node **nodes;
+    int count;
+    int capacity;
+    unsigned long long pushed;
+};
+
+void timer_heap_init(struct timer_heap *heap);
+
+void timer_heap_deinit(struct timer_heap *heap);
+
+static inline void timer_heap_node_init(struct timer_heap_node *node)
+{
+    node->index = -1;
+}
+
+static inline bool timer_heap_node_queued(struct timer_heap_node *node)
+{
+    return node->index >= 0;
+}
+
+static inline struct timer_heap_node *timer_heap_top(struct timer_heap *heap)
+{
+    return heap->count > 0 ? heap->nodes[0] : NULL;
+}
+
+// Returns -1 if the heap can't grow
+int timer_heap_push(struct timer_heap *heap, struct timer_heap_node *node, unsigned long long deadline);
+
+void timer_heap_remove(struct timer_heap *heap, struct timer_heap_node *node);
+
+struct timer_heap_node *timer_heap_pop(struct timer_heap *heap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CUTILS_TIMER_HEAP_H__ */
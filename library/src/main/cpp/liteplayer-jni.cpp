@@ -27,34 +27,152 @@
 #include <jni.h>
 #include <assert.h>
 #include <stdio.h>
+#include <pthread.h>
 #include <string>
 
-#include "msgutils/cutils/os_logger.h"
+#include "cutils/os_alloc.h"
+#include "cutils/log_gate.h"
+#include "msgutils/cutils/os_thread.h"
+#include "msgutils/cutils/os_time.h"
 #include "liteplayer/liteplayer_main.h"
 #include "liteplayer/liteplayer_adapter.h"
 #include "liteplayer/adapter/fatfs_wrapper.h"
 #include "liteplayer/adapter/httpclient_wrapper.h"
 #include "liteplayer/adapter/opensles_wrapper.h"
+#include "adapter/mixer_wrapper.h"
+#include "adapter/wavfile_wrapper.h"
+#include "adapter/tap_wrapper.h"
+#include "cutils/os_sched.h"
+#include "cutils/os_trace.h"
+#include "cutils/os_logger_async.h"
+#include "cutils/os_arena.h"
+#include "cutils/os_memstat.h"
+#include "liteplayer_stats.h"
+#include "liteplayer_clock.h"
+#include "liteplayer_decoder.h"
 
 #define TAG "NativeLiteplayer"
 #define JAVA_CLASS_NAME "com/sepnic/liteplayer/Liteplayer"
 #define NELEM(x) ((int) (sizeof(x) / sizeof((x)[0])))
 
 //#define ENABLE_OPENSLES
+// Mix all players onto one shared OpenSLES output instead of one track per player
+//#define ENABLE_MIXER
+#define MIXER_SAMPLERATE 48000
+#define MIXER_CHANNELS   2
+#if defined(ENABLE_MIXER) && !defined(ENABLE_OPENSLES)
+#define ENABLE_OPENSLES
+#endif
+// Publish pcm written to sink for visualizers, see Liteplayer.readPcm
+//#define ENABLE_PCM_TAP
+#define PCM_TAP_BUFFER_BYTES (64*1024)
+
+#define MAX_POOL_CAPACITY        8
+
+// AudioTrack head is a jni upcall, sink writes sample it at most this often
+#define TRACK_HEAD_INTERVAL_MS   50
+
+#define DEFAULT_MIN_THRESHOLD_MS 200
+#define DEFAULT_MAX_THRESHOLD_MS 5000
+
+struct liteplayer_buffer_config {
+    int thresholdMs;    // source data cached before playback starts
+    int minThresholdMs; // lower bound in adaptive mode
+    int maxThresholdMs; // upper bound in adaptive mode
+    bool adaptive;      // derive threshold from network jitter of previous streams
+};
 
 struct liteplayer_priv {
+    os_arena_t mArena;               // holds this struct, released with the player
     liteplayer_handle_t mPlayer;
+#if defined(ENABLE_MIXER)
+    mixer_handle_t mMixer;
+    int mGainMilli;                  // set by setMixerGain, accessed atomically
+    int mAppliedGainMilli;           // applied to mixer source by sink writes, -1 after open
+#endif
+    struct sink_wrapper mSink;       // sink backend, wrapped by liteplayer_sink_*
+    sink_handle_t mSinkHandle;       // read by stats queries, accessed atomically
+#if defined(ENABLE_PCM_TAP)
+    tap_t mTap;                      // wraps the sink backend
+    bcast_reader_t mTapReader;       // lossy, read by readPcm
+    char *mTapBuffer;                // PCM_TAP_BUFFER_BYTES, readPcm copies through it
+#endif
+    int mSinkByterate;
+    struct stats_collector mStats;
+    struct position_clock *mClock;   // in the arena, read lock-free by position queries
+    struct os_schedattr mSchedAttr;  // guarded by sSchedLock, copied by sink_open
+    struct liteplayer_buffer_config mBufferConfig;
+    unsigned long long mReadStallUs; // slowest http read, decays per data source, accessed atomically
     jmethodID   mPostEvent;
 #if !defined(ENABLE_OPENSLES)
     jmethodID   mOpenTrack;
     jmethodID   mWriteTrack;
     jmethodID   mCloseTrack;
+    jmethodID   mTrackPosition;
+    jbyteArray  mTrackBuffer; // reused by every write to avoid allocating java arrays
+    int         mTrackBufferSize;
+    int         mTrackSamplerate;
+    int         mTrackFrameSize;
+    unsigned int mTrackWritten; // frames, wraps like playback head, accessed atomically
+    unsigned int mTrackHead;    // frames at mTrackHeadUs, sampled by sink writes on player thread
+    unsigned long long mTrackHeadUs; // 0 if not sampled since track opened
 #endif
     jclass      mClass;
-    jobject     mObject;
+    jobject     mObject;    // cleared by native_destroy, accessed atomically
+    int         mCallbacks; // state callbacks using mObject, accessed atomically
 };
 
 static JavaVM *sJavaVM = nullptr;
+static pthread_key_t sThreadKey;
+
+OS_MUTEX_DECLARE(sPoolLock)
+static struct liteplayer_priv *sPool[MAX_POOL_CAPACITY];
+static int sPoolCount = 0;
+static int sPoolCapacity = 0;
+
+// setThreadConfig runs on java threads while sink_open reads the config on player thread
+OS_MUTEX_DECLARE(sSchedLock)
+
+#if defined(ENABLE_MIXER)
+OS_MUTEX_DECLARE(sMixerLock)
+static mixer_handle_t sMixer = nullptr;
+static int sMixerRefs = 0;
+
+static mixer_handle_t mixer_acquire()
+{
+    OS_THREAD_MUTEX_LOCK(sMixerLock);
+    if (sMixer == nullptr) {
+        struct mixer_attr attr = {
+                .samplerate = MIXER_SAMPLERATE,
+                .channels = MIXER_CHANNELS,
+                .period_ms = 0,
+                .source_buffer_ms = 0,
+        };
+        struct sink_wrapper output_ops = {
+                .sink_priv = nullptr,
+                .open = opensles_wrapper_open,
+                .write = opensles_wrapper_write,
+                .close = opensles_wrapper_close,
+        };
+        sMixer = mixer_create(&attr, &output_ops);
+    }
+    if (sMixer != nullptr)
+        sMixerRefs++;
+    mixer_handle_t mixer = sMixer;
+    OS_THREAD_MUTEX_UNLOCK(sMixerLock);
+    return mixer;
+}
+
+static void mixer_release()
+{
+    OS_THREAD_MUTEX_LOCK(sMixerLock);
+    if (sMixer != nullptr && --sMixerRefs == 0) {
+        mixer_destroy(sMixer);
+        sMixer = nullptr;
+    }
+    OS_THREAD_MUTEX_UNLOCK(sMixerLock);
+}
+#endif
 
 static void jniThrowException(JNIEnv *env, const char *className, const char *msg) {
     jclass clazz = env->FindClass(className);
@@ -71,170 +189,449 @@ static void jniThrowException(JNIEnv *env, const char *className, const char *ms
     env->DeleteLocalRef(clazz);
 }
 
-#if !defined(ENABLE_OPENSLES)
-static sink_handle_t audiotrack_wrapper_open(int samplerate, int channels, void *sink_priv)
+static void jniDetachCurrentThread(void *arg)
 {
-    OS_LOGD(TAG, "@@@ Opening AudioTrack: samplerate=%d, channels=%d", samplerate, channels);
-    JNIEnv *env;
-    JavaVMAttachArgs args = { JNI_VERSION_1_6, "LiteplayerAudioTrack", nullptr };
+    sJavaVM->DetachCurrentThread();
+}
+
+// Attach once per native thread, it's detached automatically when the thread exits
+static JNIEnv *jniAttachCurrentThread(const char *name)
+{
+    JNIEnv *env = nullptr;
+    if (sJavaVM->GetEnv((void**) &env, JNI_VERSION_1_6) == JNI_OK)
+        return env;
+    JavaVMAttachArgs args = { JNI_VERSION_1_6, name, nullptr };
     jint res = sJavaVM->AttachCurrentThread(&env, &args);
     if (res != JNI_OK) {
         OS_LOGE(TAG, "Failed to AttachCurrentThread, errcode=%d", res);
         return nullptr;
     }
+    pthread_setspecific(sThreadKey, env);
+    return env;
+}
 
-    auto priv = reinterpret_cast<struct liteplayer_priv *>(sink_priv);
-    res = env->CallStaticIntMethod(priv->mClass, priv->mOpenTrack, priv->mObject, samplerate, channels);
+#if !defined(ENABLE_OPENSLES)
+static sink_handle_t audiotrack_wrapper_open(int samplerate, int channels, void *sink_priv)
+{
+    OS_LOGD(TAG, "@@@ Opening AudioTrack: samplerate=%d, channels=%d", samplerate, channels);
+    JNIEnv *env = jniAttachCurrentThread("LiteplayerAudioTrack");
+    if (env == nullptr)
+        return nullptr;
 
-    sJavaVM->DetachCurrentThread();
-    return res == 0 ? (sink_handle_t)priv : nullptr;
+    auto priv = reinterpret_cast<struct liteplayer_priv *>(sink_priv);
+    jint res = env->CallStaticIntMethod(priv->mClass, priv->mOpenTrack, priv->mObject, samplerate, channels);
+    if (res != 0)
+        return nullptr;
+    // Playback head of the new AudioTrack starts from zero
+    priv->mTrackSamplerate = samplerate;
+    priv->mTrackFrameSize = channels * sizeof(short);
+    __atomic_store_n(&priv->mTrackWritten, 0U, __ATOMIC_RELEASE);
+    priv->mTrackHeadUs = 0;
+    return (sink_handle_t)priv;
 }
 
 static int audiotrack_wrapper_write(sink_handle_t handle, char *buffer, int size)
 {
-    OS_LOGV(TAG, "@@@ Writing AudioTrack: buffer=%p, size=%d", buffer, size);
-    JNIEnv *env;
-    JavaVMAttachArgs args = { JNI_VERSION_1_6, "LiteplayerAudioTrack", nullptr };
-    jint res = sJavaVM->AttachCurrentThread(&env, &args);
-    if (res != JNI_OK) {
-        OS_LOGE(TAG, "Failed to AttachCurrentThread, errcode=%d", res);
+    JNIEnv *env = jniAttachCurrentThread("LiteplayerAudioTrack");
+    if (env == nullptr)
         return -1;
-    }
-
-    jbyteArray sampleArray = env->NewByteArray(size);
-    if (sampleArray == nullptr) {
-        sJavaVM->DetachCurrentThread();
-        return -1;
-    }
-    jbyte *sampleByte = env->GetByteArrayElements(sampleArray, nullptr);
-    memcpy(sampleByte, buffer, size);
-    env->ReleaseByteArrayElements(sampleArray, sampleByte, 0);
 
     auto priv = reinterpret_cast<struct liteplayer_priv *>(handle);
-    res = env->CallStaticIntMethod(priv->mClass, priv->mWriteTrack, priv->mObject, sampleArray, size);
-
-    env->DeleteLocalRef(sampleArray);
-    sJavaVM->DetachCurrentThread();
+    if (priv->mTrackBuffer == nullptr || priv->mTrackBufferSize < size) {
+        jbyteArray sampleArray = env->NewByteArray(size);
+        if (sampleArray == nullptr)
+            return -1;
+        if (priv->mTrackBuffer != nullptr)
+            env->DeleteGlobalRef(priv->mTrackBuffer);
+        priv->mTrackBuffer = (jbyteArray)env->NewGlobalRef(sampleArray);
+        priv->mTrackBufferSize = size;
+        env->DeleteLocalRef(sampleArray);
+    }
+    env->SetByteArrayRegion(priv->mTrackBuffer, 0, size, (const jbyte *)buffer);
+    env->CallStaticIntMethod(priv->mClass, priv->mWriteTrack, priv->mObject, priv->mTrackBuffer, size);
+    __atomic_add_fetch(&priv->mTrackWritten, (unsigned int)(size / priv->mTrackFrameSize), __ATOMIC_RELEASE);
     return size;
 }
 
 static void audiotrack_wrapper_close(sink_handle_t handle)
 {
     OS_LOGD(TAG, "@@@ closing AudioTrack");
-    JNIEnv *env;
-    JavaVMAttachArgs args = { JNI_VERSION_1_6, "LiteplayerAudioTrack", nullptr };
-    jint res = sJavaVM->AttachCurrentThread(&env, &args);
-    if (res != JNI_OK) {
-        OS_LOGE(TAG, "Failed to AttachCurrentThread, errcode=%d", res);
+    JNIEnv *env = jniAttachCurrentThread("LiteplayerAudioTrack");
+    if (env == nullptr)
         return;
-    }
 
     auto priv = reinterpret_cast<struct liteplayer_priv *>(handle);
     env->CallStaticVoidMethod(priv->mClass, priv->mCloseTrack, priv->mObject);
+}
+#endif
 
-    sJavaVM->DetachCurrentThread();
+#if !defined(ENABLE_OPENSLES)
+// Playback head of the AudioTrack in frames, -1 if unknown
+static jint liteplayer_track_head(JNIEnv *env, struct liteplayer_priv *priv)
+{
+    jint head = env->CallStaticIntMethod(priv->mClass, priv->mTrackPosition, priv->mObject);
+    // Don't leave a pending exception to the next jni call of this thread
+    if (env->ExceptionCheck()) {
+        env->ExceptionClear();
+        return -1;
+    }
+    return head;
+}
+
+static int liteplayer_track_latency_ms(struct liteplayer_priv *priv, unsigned int head)
+{
+    unsigned int written = __atomic_load_n(&priv->mTrackWritten, __ATOMIC_ACQUIRE);
+    int queued = (int)(written - head);
+    return queued > 0 ? (int)((long long)queued * 1000 / priv->mTrackSamplerate) : 0;
 }
 #endif
 
-static int Liteplayer_native_stateCallback(enum liteplayer_state state, int errcode, void *callback_priv)
+// Handle of the sink backend, below the pcm tap if any, null if sink is closed
+static inline sink_handle_t liteplayer_sink_backend(struct liteplayer_priv *priv)
 {
-    OS_LOGD(TAG, "@@@ Liteplayer_native_stateCallback: state=%d, errcode=%d", state, errcode);
-    JNIEnv *env;
-    jint res = sJavaVM->GetEnv((void**) &env, JNI_VERSION_1_6);
-    jboolean attached = JNI_FALSE;
-    if (res != JNI_OK) {
-        JavaVMAttachArgs args = { JNI_VERSION_1_6, "LiteplayerStateCallback", nullptr };
-        res = sJavaVM->AttachCurrentThread(&env, &args);
-        if (res != JNI_OK) {
-            OS_LOGE(TAG, "Failed to AttachCurrentThread, errcode=%d", res);
-            return -1;
-        }
-        attached = true;
+    sink_handle_t handle = __atomic_load_n(&priv->mSinkHandle, __ATOMIC_ACQUIRE);
+#if defined(ENABLE_PCM_TAP)
+    return handle != nullptr ? tap_wrapper_get_downstream(handle) : nullptr;
+#else
+    return handle;
+#endif
+}
+
+// Milliseconds of pcm written to sink but not played yet, for any thread.
+// Only the position record is read, the sink belongs to the player thread
+static int liteplayer_sink_latency_ms(struct liteplayer_priv *priv)
+{
+    return (int)clock_get_latency(priv->mClock);
+}
+
+// Latency for the position clock, called before every sink write on player thread
+static int liteplayer_sink_write_latency_ms(struct liteplayer_priv *priv)
+{
+#if defined(ENABLE_MIXER)
+    return mixer_wrapper_get_latency(liteplayer_sink_backend(priv));
+#elif defined(ENABLE_OPENSLES)
+    // OpenSL buffer queue can't be queried from here, estimate from write timing
+    return (int)(stats_sink_queued_us(&priv->mStats) / 1000);
+#else
+    if (priv->mTrackSamplerate <= 0)
+        return (int)(stats_sink_queued_us(&priv->mStats) / 1000);
+    unsigned long long now = OS_MONOTONIC_USEC();
+    unsigned long long elapsed = now - priv->mTrackHeadUs;
+    if (priv->mTrackHeadUs == 0 || elapsed >= TRACK_HEAD_INTERVAL_MS * 1000ULL) {
+        JNIEnv *env = jniAttachCurrentThread("LiteplayerAudioTrack");
+        jint head = env != nullptr ? liteplayer_track_head(env, priv) : -1;
+        if (head < 0)
+            return (int)(stats_sink_queued_us(&priv->mStats) / 1000);
+        priv->mTrackHead = (unsigned int)head;
+        priv->mTrackHeadUs = now;
+        return liteplayer_track_latency_ms(priv, priv->mTrackHead);
     }
+    // Between samples the head advances at samplerate, latency stops at 0 once it passes written frames
+    unsigned int head = priv->mTrackHead + (unsigned int)(elapsed * priv->mTrackSamplerate / 1000000);
+    return liteplayer_track_latency_ms(priv, head);
+#endif
+}
 
-    auto priv = reinterpret_cast<struct liteplayer_priv *>(callback_priv);
-    env->CallStaticVoidMethod(priv->mClass, priv->mPostEvent, priv->mObject, state, errcode);
+static sink_handle_t liteplayer_sink_open(int samplerate, int channels, void *sink_priv)
+{
+    auto priv = reinterpret_cast<struct liteplayer_priv *>(sink_priv);
+    // Sink is opened on the player thread that decodes and writes pcm
+    struct os_schedattr attr;
+    OS_THREAD_MUTEX_LOCK(sSchedLock);
+    attr = priv->mSchedAttr;
+    OS_THREAD_MUTEX_UNLOCK(sSchedLock);
+    OS_SCHED_APPLY(&attr);
+    OS_TRACE_BEGIN("sink_open");
+    sink_handle_t sink_handle = priv->mSink.open(samplerate, channels, priv->mSink.sink_priv);
+    OS_TRACE_END("sink_open");
+    if (sink_handle == nullptr)
+        return nullptr;
+    __atomic_store_n(&priv->mSinkHandle, sink_handle, __ATOMIC_RELEASE);
+    priv->mSinkByterate = samplerate * channels * sizeof(short);
+#if defined(ENABLE_MIXER)
+    priv->mAppliedGainMilli = -1;
+#endif
+    // Time between two sink writes is spent on decoding the next frames
+    OS_TRACE_BEGIN("decode");
+    return (sink_handle_t)priv;
+}
 
-    if (attached)
-        sJavaVM->DetachCurrentThread();
-    return 0;
+static int liteplayer_sink_write(sink_handle_t handle, char *buffer, int size)
+{
+    auto priv = reinterpret_cast<struct liteplayer_priv *>(handle);
+    OS_TRACE_END("decode");
+    OS_TRACE_BEGIN("sink_write");
+    clock_on_sink_write(priv->mClock, size, priv->mSinkByterate, liteplayer_sink_write_latency_ms(priv));
+#if defined(ENABLE_MIXER)
+    // Only the player thread touches its mixer source, a new gain is applied here
+    int gain = __atomic_load_n(&priv->mGainMilli, __ATOMIC_RELAXED);
+    if (gain != priv->mAppliedGainMilli) {
+        mixer_set_gain(liteplayer_sink_backend(priv), gain / 1000.0f);
+        priv->mAppliedGainMilli = gain;
+    }
+#endif
+    unsigned long long begin = OS_MONOTONIC_USEC();
+    int ret = priv->mSink.write(priv->mSinkHandle, buffer, size);
+    stats_on_sink_write(&priv->mStats, size, priv->mSinkByterate, begin, OS_MONOTONIC_USEC());
+    OS_TRACE_END("sink_write");
+    OS_TRACE_BEGIN("decode");
+    return ret;
 }
 
-static jlong Liteplayer_native_create(JNIEnv* env, jobject thiz, jobject weak_this)
+static void liteplayer_sink_close(sink_handle_t handle)
 {
-    OS_LOGD(TAG, "@@@ Liteplayer_native_create");
+    auto priv = reinterpret_cast<struct liteplayer_priv *>(handle);
+    OS_TRACE_END("decode");
+    OS_TRACE_BEGIN("sink_close");
+    // Unpublish before closing so stats queries stop using the handle
+    sink_handle_t sink_handle = priv->mSinkHandle;
+    __atomic_store_n(&priv->mSinkHandle, nullptr, __ATOMIC_RELEASE);
+    priv->mSink.close(sink_handle);
+    OS_TRACE_END("sink_close");
+    stats_on_discontinuity(&priv->mStats);
+}
 
-    struct liteplayer_priv *priv = (struct liteplayer_priv *)calloc(1, sizeof(struct liteplayer_priv));
-    if (priv == nullptr) return (jlong)nullptr;
+struct liteplayer_http {
+    struct liteplayer_priv *mPriv;
+    http_handle_t mHandle;
+};
+
+static http_handle_t liteplayer_http_open(const char *url, long long content_pos, void *http_priv)
+{
+    auto http = (struct liteplayer_http *)OS_CALLOC_TAG(OS_MEMTAG_HTTP, 1, sizeof(struct liteplayer_http));
+    if (http == nullptr) return nullptr;
+    http->mPriv = reinterpret_cast<struct liteplayer_priv *>(http_priv);
+    OS_TRACE_BEGIN("http_open");
+    http->mHandle = httpclient_wrapper_open(url, content_pos, nullptr);
+    OS_TRACE_END("http_open");
+    if (http->mHandle == nullptr) {
+        OS_FREE(http);
+        return nullptr;
+    }
+    return (http_handle_t)http;
+}
+
+static int liteplayer_http_read(http_handle_t handle, char *buffer, int size)
+{
+    auto http = reinterpret_cast<struct liteplayer_http *>(handle);
+    OS_TRACE_BEGIN("http_read");
+    unsigned long long begin = OS_MONOTONIC_USEC();
+    int ret = httpclient_wrapper_read(http->mHandle, buffer, size);
+    unsigned long long cost = OS_MONOTONIC_USEC() - begin;
+    OS_TRACE_END("http_read");
+    stats_on_network_read(&http->mPriv->mStats, ret, cost);
+    // The slowest read is the gap that source buffer has to cover
+    unsigned long long stall = __atomic_load_n(&http->mPriv->mReadStallUs, __ATOMIC_RELAXED);
+    while (cost > stall &&
+           !__atomic_compare_exchange_n(&http->mPriv->mReadStallUs, &stall, cost, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    return ret;
+}
+
+static long long liteplayer_http_filesize(http_handle_t handle)
+{
+    auto http = reinterpret_cast<struct liteplayer_http *>(handle);
+    return httpclient_wrapper_filesize(http->mHandle);
+}
+
+static int liteplayer_http_seek(http_handle_t handle, long offset)
+{
+    auto http = reinterpret_cast<struct liteplayer_http *>(handle);
+    OS_TRACE_INSTANT("http_seek");
+    return httpclient_wrapper_seek(http->mHandle, offset);
+}
+
+static void liteplayer_http_close(http_handle_t handle)
+{
+    auto http = reinterpret_cast<struct liteplayer_http *>(handle);
+    httpclient_wrapper_close(http->mHandle);
+    OS_FREE(http);
+}
+
+static int liteplayer_threshold_ms(struct liteplayer_priv *priv)
+{
+    struct liteplayer_buffer_config *config = &priv->mBufferConfig;
+    if (!config->adaptive)
+        return config->thresholdMs;
+    // Cover twice the slowest read seen, and halve it for next stream
+    // so that the buffer shrinks back when network is stable
+    unsigned long long stall = __atomic_load_n(&priv->mReadStallUs, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&priv->mReadStallUs, &stall, stall / 2, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    int threshold = (int)(stall * 2 / 1000);
+    if (threshold < config->minThresholdMs)
+        threshold = config->minThresholdMs;
+    else if (threshold > config->maxThresholdMs)
+        threshold = config->maxThresholdMs;
+    OS_LOGD(TAG, "Adaptive source threshold: %dms", threshold);
+    return threshold;
+}
+
+static int Liteplayer_native_stateCallback(enum liteplayer_state state, int errcode, void *callback_priv)
+{
+    OS_LOGD(TAG, "@@@ Liteplayer_native_stateCallback: state=%d, errcode=%d", state, errcode);
+    auto priv = reinterpret_cast<struct liteplayer_priv *>(callback_priv);
+    // Counted before loading the object, native_destroy waits for us once it cleared mObject
+    __atomic_fetch_add(&priv->mCallbacks, 1, __ATOMIC_SEQ_CST);
+    jobject object = __atomic_load_n(&priv->mObject, __ATOMIC_SEQ_CST);
+    int ret = 0;
+    if (object != nullptr) { // nullptr for pooled player, no java object bound
+        OS_TRACE_INSTANT("state_callback");
+        JNIEnv *env = jniAttachCurrentThread("LiteplayerStateCallback");
+        if (env != nullptr)
+            env->CallStaticVoidMethod(priv->mClass, priv->mPostEvent, object, state, errcode);
+        else
+            ret = -1;
+    }
+    __atomic_fetch_sub(&priv->mCallbacks, 1, __ATOMIC_RELEASE);
+    return ret;
+}
+
+static void liteplayer_priv_destroy(JNIEnv *env, struct liteplayer_priv *priv)
+{
+    if (priv->mPlayer != nullptr)
+        liteplayer_destroy(priv->mPlayer);
+    priv->mPlayer = nullptr;
+#if defined(ENABLE_MIXER)
+    if (priv->mMixer != nullptr)
+        mixer_release();
+#endif
+#if defined(ENABLE_PCM_TAP)
+    tap_destroy(priv->mTap);
+    priv->mTap = nullptr;
+#endif
+#if !defined(ENABLE_OPENSLES)
+    if (priv->mTrackBuffer != nullptr)
+        env->DeleteGlobalRef(priv->mTrackBuffer);
+    priv->mTrackBuffer = nullptr;
+#endif
+    // remove global references
+    if (priv->mClass != nullptr)
+        env->DeleteGlobalRef(priv->mClass);
+    priv->mClass = nullptr;
+    // priv itself lives in the arena, so does the clock
+    os_arena_destroy(priv->mArena);
+}
+
+// Create a player with adapters registered, but not bound to any java object
+static struct liteplayer_priv *liteplayer_priv_create(JNIEnv *env)
+{
+    os_arena_t arena = os_arena_create("liteplayer", 0);
+    if (arena == nullptr) return nullptr;
+    auto priv = (struct liteplayer_priv *)os_arena_calloc(arena, 1, sizeof(struct liteplayer_priv));
+    if (priv == nullptr) {
+        os_arena_destroy(arena);
+        return nullptr;
+    }
+    priv->mArena = arena;
+    priv->mClock = (struct position_clock *)os_arena_calloc(arena, 1, sizeof(struct position_clock));
+    if (priv->mClock == nullptr) {
+        os_arena_destroy(arena);
+        return nullptr;
+    }
 
     jclass clazz;
     clazz = env->FindClass(JAVA_CLASS_NAME);
     if (clazz == nullptr) {
         OS_LOGE(TAG, "Failed to find class: %s", JAVA_CLASS_NAME);
-        free(priv);
-        return (jlong)nullptr;
+        os_arena_destroy(arena);
+        return nullptr;
     }
-    priv->mPostEvent = env->GetStaticMethodID(clazz, "postEventFromNative", "(Ljava/lang/Object;II)V");
+    // Hold onto Liteplayer class for use in calling the static method that posts events to the application thread.
+    priv->mClass = (jclass)env->NewGlobalRef(clazz);
+    env->DeleteLocalRef(clazz);
+    priv->mPostEvent = env->GetStaticMethodID(priv->mClass, "postEventFromNative", "(Ljava/lang/Object;II)V");
     if (priv->mPostEvent == nullptr) {
         OS_LOGE(TAG, "Failed to get postEventFromNative mothod");
-        free(priv);
-        return (jlong)nullptr;
+        liteplayer_priv_destroy(env, priv);
+        return nullptr;
     }
 #if !defined(ENABLE_OPENSLES)
-    priv->mOpenTrack = env->GetStaticMethodID(clazz, "openAudioTrackFromNative", "(Ljava/lang/Object;II)I");
+    priv->mOpenTrack = env->GetStaticMethodID(priv->mClass, "openAudioTrackFromNative", "(Ljava/lang/Object;II)I");
     if (priv->mOpenTrack == nullptr) {
         OS_LOGE(TAG, "Failed to get openAudioTrackFromNative mothod");
-        free(priv);
-        return (jlong)nullptr;
+        liteplayer_priv_destroy(env, priv);
+        return nullptr;
     }
-    priv->mWriteTrack = env->GetStaticMethodID(clazz, "writeAudioTrackFromNative", "(Ljava/lang/Object;[BI)I");
+    priv->mWriteTrack = env->GetStaticMethodID(priv->mClass, "writeAudioTrackFromNative", "(Ljava/lang/Object;[BI)I");
     if (priv->mWriteTrack == nullptr) {
         OS_LOGE(TAG, "Failed to get writeAudioTrackFromNative mothod");
-        free(priv);
-        return (jlong)nullptr;
+        liteplayer_priv_destroy(env, priv);
+        return nullptr;
     }
-    priv->mCloseTrack = env->GetStaticMethodID(clazz, "closeAudioTrackFromNative", "(Ljava/lang/Object;)V");
+    priv->mCloseTrack = env->GetStaticMethodID(priv->mClass, "closeAudioTrackFromNative", "(Ljava/lang/Object;)V");
     if (priv->mCloseTrack == nullptr) {
         OS_LOGE(TAG, "Failed to get closeAudioTrackFromNative mothod");
-        free(priv);
-        return (jlong)nullptr;
+        liteplayer_priv_destroy(env, priv);
+        return nullptr;
     }
-#endif
-    env->DeleteLocalRef(clazz);
-
-    // Hold onto Liteplayer class for use in calling the static method that posts events to the application thread.
-    clazz = env->GetObjectClass(thiz);
-    if (clazz == nullptr) {
-        OS_LOGE(TAG, "Failed to find class: %s", JAVA_CLASS_NAME);
-        free(priv);
-        jniThrowException(env, "java/lang/Exception", nullptr);
-        return (jlong)nullptr;
+    priv->mTrackPosition = env->GetStaticMethodID(priv->mClass, "getAudioTrackPositionFromNative", "(Ljava/lang/Object;)I");
+    if (priv->mTrackPosition == nullptr) {
+        OS_LOGE(TAG, "Failed to get getAudioTrackPositionFromNative mothod");
+        liteplayer_priv_destroy(env, priv);
+        return nullptr;
     }
-    priv->mClass = (jclass)env->NewGlobalRef(clazz);
-    // We use a weak reference so the Liteplayer object can be garbage collected.
-    // The reference is only used as a proxy for callbacks.
-    priv->mObject  = env->NewGlobalRef(weak_this);
+#endif
 
     priv->mPlayer = liteplayer_create();
     if (priv->mPlayer == nullptr) {
-        free(priv);
-        return (jlong)nullptr;
+        liteplayer_priv_destroy(env, priv);
+        return nullptr;
     }
+#if defined(ENABLE_MIXER)
+    priv->mMixer = mixer_acquire();
+    if (priv->mMixer == nullptr) {
+        OS_LOGE(TAG, "Failed to create mixer");
+        liteplayer_priv_destroy(env, priv);
+        return nullptr;
+    }
+#endif
     // Register state listener, todo: notify java objest
     liteplayer_register_state_listener(priv->mPlayer, Liteplayer_native_stateCallback, priv);
     // Register sink adapter
-    struct sink_wrapper sink_ops = {
-#if !defined(ENABLE_OPENSLES)
-            .sink_priv = priv,
-            .open = audiotrack_wrapper_open,
-            .write = audiotrack_wrapper_write,
-            .close = audiotrack_wrapper_close,
+#if defined(ENABLE_MIXER)
+    priv->mSink.sink_priv = priv->mMixer;
+    priv->mSink.open = mixer_wrapper_open;
+    priv->mSink.write = mixer_wrapper_write;
+    priv->mSink.close = mixer_wrapper_close;
+#elif !defined(ENABLE_OPENSLES)
+    priv->mSink.sink_priv = priv;
+    priv->mSink.open = audiotrack_wrapper_open;
+    priv->mSink.write = audiotrack_wrapper_write;
+    priv->mSink.close = audiotrack_wrapper_close;
 #else
-            .sink_priv = NULL,
-            .open = opensles_wrapper_open,
-            .write = opensles_wrapper_write,
-            .close = opensles_wrapper_close,
+    priv->mSink.sink_priv = nullptr;
+    priv->mSink.open = opensles_wrapper_open;
+    priv->mSink.write = opensles_wrapper_write;
+    priv->mSink.close = opensles_wrapper_close;
+#endif
+#if defined(ENABLE_PCM_TAP)
+    priv->mTap = tap_create(&priv->mSink, PCM_TAP_BUFFER_BYTES);
+    if (priv->mTap == nullptr) {
+        OS_LOGE(TAG, "Failed to create pcm tap");
+        liteplayer_priv_destroy(env, priv);
+        return nullptr;
+    }
+    priv->mTapReader = tap_add_reader(priv->mTap, true);
+    // Lossy reads never exceed the ring size, one buffer serves every read
+    priv->mTapBuffer = (char *)os_arena_alloc(priv->mArena, PCM_TAP_BUFFER_BYTES);
+    if (priv->mTapReader == nullptr || priv->mTapBuffer == nullptr) {
+        OS_LOGE(TAG, "Failed to create pcm tap reader");
+        liteplayer_priv_destroy(env, priv);
+        return nullptr;
+    }
+    priv->mSink.sink_priv = priv->mTap;
+    priv->mSink.open = tap_wrapper_open;
+    priv->mSink.write = tap_wrapper_write;
+    priv->mSink.close = tap_wrapper_close;
 #endif
+    struct sink_wrapper sink_ops = {
+            .sink_priv = priv,
+            .open = liteplayer_sink_open,
+            .write = liteplayer_sink_write,
+            .close = liteplayer_sink_close,
     };
     liteplayer_register_sink_wrapper(priv->mPlayer, &sink_ops);
     // Register http adapter
@@ -249,18 +646,102 @@ static jlong Liteplayer_native_create(JNIEnv* env, jobject thiz, jobject weak_th
     liteplayer_register_file_wrapper(priv->mPlayer, &file_ops);
     // Register file adapter
     struct http_wrapper http_ops = {
-            .http_priv = nullptr,
-            .open = httpclient_wrapper_open,
-            .read = httpclient_wrapper_read,
-            .filesize = httpclient_wrapper_filesize,
-            .seek = httpclient_wrapper_seek,
-            .close = httpclient_wrapper_close,
+            .http_priv = priv,
+            .open = liteplayer_http_open,
+            .read = liteplayer_http_read,
+            .filesize = liteplayer_http_filesize,
+            .seek = liteplayer_http_seek,
+            .close = liteplayer_http_close,
     };
     liteplayer_register_http_wrapper(priv->mPlayer, &http_ops);
+    return priv;
+}
+
+static struct liteplayer_priv *liteplayer_pool_get(JNIEnv *env)
+{
+    struct liteplayer_priv *priv = nullptr;
+    OS_THREAD_MUTEX_LOCK(sPoolLock);
+    if (sPoolCount > 0)
+        priv = sPool[--sPoolCount];
+    OS_THREAD_MUTEX_UNLOCK(sPoolLock);
+    return priv != nullptr ? priv : liteplayer_priv_create(env);
+}
+
+static bool liteplayer_pool_available()
+{
+    OS_THREAD_MUTEX_LOCK(sPoolLock);
+    bool available = sPoolCount < sPoolCapacity;
+    OS_THREAD_MUTEX_UNLOCK(sPoolLock);
+    return available;
+}
+
+static bool liteplayer_pool_put(struct liteplayer_priv *priv)
+{
+    bool pooled = false;
+    OS_THREAD_MUTEX_LOCK(sPoolLock);
+    if (sPoolCount < sPoolCapacity) {
+        sPool[sPoolCount++] = priv;
+        pooled = true;
+    }
+    OS_THREAD_MUTEX_UNLOCK(sPoolLock);
+    return pooled;
+}
 
+static jlong Liteplayer_native_create(JNIEnv* env, jobject thiz, jobject weak_this)
+{
+    OS_LOGD(TAG, "@@@ Liteplayer_native_create");
+    struct liteplayer_priv *priv = liteplayer_pool_get(env);
+    if (priv == nullptr) return (jlong)nullptr;
+
+    struct os_schedattr attr;
+    OS_SCHED_FROM_PRIO(OS_THREAD_PRIO_HIGH, &attr);
+    OS_THREAD_MUTEX_LOCK(sSchedLock);
+    priv->mSchedAttr = attr;
+    OS_THREAD_MUTEX_UNLOCK(sSchedLock);
+    priv->mBufferConfig.thresholdMs = 0;
+    priv->mBufferConfig.minThresholdMs = DEFAULT_MIN_THRESHOLD_MS;
+    priv->mBufferConfig.maxThresholdMs = DEFAULT_MAX_THRESHOLD_MS;
+    priv->mBufferConfig.adaptive = false;
+    __atomic_store_n(&priv->mReadStallUs, 0ULL, __ATOMIC_RELAXED);
+#if defined(ENABLE_MIXER)
+    __atomic_store_n(&priv->mGainMilli, 1000, __ATOMIC_RELAXED);
+#endif
+    // We use a weak reference so the Liteplayer object can be garbage collected.
+    // The reference is only used as a proxy for callbacks.
+    __atomic_store_n(&priv->mObject, env->NewGlobalRef(weak_this), __ATOMIC_RELEASE);
     return (jlong)priv;
 }
 
+static void Liteplayer_native_setPoolCapacity(JNIEnv *env, jclass clazz, jint capacity)
+{
+    OS_LOGD(TAG, "@@@ Liteplayer_native_setPoolCapacity: capacity=%d", capacity);
+    if (capacity < 0 || capacity > MAX_POOL_CAPACITY) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", "Invalid pool capacity");
+        return;
+    }
+    struct liteplayer_priv *released[MAX_POOL_CAPACITY];
+    int count = 0;
+    OS_THREAD_MUTEX_LOCK(sPoolLock);
+    sPoolCapacity = capacity;
+    while (sPoolCount > sPoolCapacity)
+        released[count++] = sPool[--sPoolCount];
+    int missing = sPoolCapacity - sPoolCount;
+    OS_THREAD_MUTEX_UNLOCK(sPoolLock);
+
+    for (int i = 0; i < count; i++)
+        liteplayer_priv_destroy(env, released[i]);
+    // Warm up the pool, so that players are handed out without creating threads and buffers
+    for (int i = 0; i < missing; i++) {
+        struct liteplayer_priv *priv = liteplayer_priv_create(env);
+        if (priv == nullptr)
+            break;
+        if (!liteplayer_pool_put(priv)) {
+            liteplayer_priv_destroy(env, priv);
+            break;
+        }
+    }
+}
+
 static jint Liteplayer_native_setDataSource(JNIEnv *env, jobject thiz, jlong handle, jstring path)
 {
     OS_LOGD(TAG, "@@@ Liteplayer_native_setDataSource");
@@ -280,7 +761,10 @@ static jint Liteplayer_native_setDataSource(JNIEnv *env, jobject thiz, jlong han
     }
     std::string url = tmp;
     env->ReleaseStringUTFChars(path, tmp);
-    return (jint) liteplayer_set_data_source(priv->mPlayer, url.c_str(), 0);
+    stats_reset(&priv->mStats);
+    clock_reset(priv->mClock, 0);
+    OS_TRACE_INSTANT("setDataSource");
+    return (jint) liteplayer_set_data_source(priv->mPlayer, url.c_str(), liteplayer_threshold_ms(priv));
 }
 
 static jint Liteplayer_native_prepareAsync(JNIEnv *env, jobject thiz, jlong handle)
@@ -291,6 +775,8 @@ static jint Liteplayer_native_prepareAsync(JNIEnv *env, jobject thiz, jlong hand
         jniThrowException(env, "java/lang/IllegalStateException", nullptr);
         return -1;
     }
+    stats_on_prepare(&priv->mStats);
+    OS_TRACE_INSTANT("prepareAsync");
     return (jint) liteplayer_prepare_async(priv->mPlayer);
 }
 
@@ -302,6 +788,7 @@ static jint Liteplayer_native_start(JNIEnv *env, jobject thiz, jlong handle)
         jniThrowException(env, "java/lang/IllegalStateException", nullptr);
         return -1;
     }
+    OS_TRACE_INSTANT("start");
     return (jint) liteplayer_start(priv->mPlayer);
 }
 
@@ -313,6 +800,9 @@ static jint Liteplayer_native_pause(JNIEnv *env, jobject thiz, jlong handle)
         jniThrowException(env, "java/lang/IllegalStateException", nullptr);
         return -1;
     }
+    stats_on_discontinuity(&priv->mStats);
+    clock_pause(priv->mClock);
+    OS_TRACE_INSTANT("pause");
     return (jint) liteplayer_pause(priv->mPlayer);
 }
 
@@ -324,6 +814,7 @@ static jint Liteplayer_native_resume(JNIEnv *env, jobject thiz, jlong handle)
         jniThrowException(env, "java/lang/IllegalStateException", nullptr);
         return -1;
     }
+    OS_TRACE_INSTANT("resume");
     return (jint) liteplayer_resume(priv->mPlayer);
 }
 
@@ -335,6 +826,9 @@ static jint Liteplayer_native_seekTo(JNIEnv *env, jobject thiz, jlong handle, ji
         jniThrowException(env, "java/lang/IllegalStateException", nullptr);
         return -1;
     }
+    stats_on_discontinuity(&priv->mStats);
+    clock_reset(priv->mClock, msec);
+    OS_TRACE_INSTANT("seekTo");
     return (jint) liteplayer_seek(priv->mPlayer, msec);
 }
 
@@ -346,6 +840,9 @@ static jint Liteplayer_native_stop(JNIEnv *env, jobject thiz, jlong handle)
         jniThrowException(env, "java/lang/IllegalStateException", nullptr);
         return -1;
     }
+    stats_on_discontinuity(&priv->mStats);
+    clock_pause(priv->mClock);
+    OS_TRACE_INSTANT("stop");
     return (jint) liteplayer_stop(priv->mPlayer);
 }
 
@@ -357,25 +854,199 @@ static jint Liteplayer_native_reset(JNIEnv *env, jobject thiz, jlong handle)
         jniThrowException(env, "java/lang/IllegalStateException", nullptr);
         return -1;
     }
+    clock_reset(priv->mClock, 0);
+    OS_TRACE_INSTANT("reset");
     return (jint) liteplayer_reset(priv->mPlayer);
 }
 
+static jint Liteplayer_native_setThreadConfig(JNIEnv *env, jobject thiz, jlong handle, jint policy, jint priority, jlong cpuMask)
+{
+    OS_LOGD(TAG, "@@@ Liteplayer_native_setThreadConfig");
+    auto priv = reinterpret_cast<struct liteplayer_priv *>(handle);
+    if (priv == nullptr || priv->mPlayer == nullptr) {
+        jniThrowException(env, "java/lang/IllegalStateException", nullptr);
+        return -1;
+    }
+    if (policy < OS_SCHED_NORMAL || policy > OS_SCHED_RR) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", "Invalid sched policy");
+        return -1;
+    }
+    OS_THREAD_MUTEX_LOCK(sSchedLock);
+    priv->mSchedAttr.policy = (enum os_schedpolicy)policy;
+    priv->mSchedAttr.priority = priority;
+    priv->mSchedAttr.cpumask = (uint64_t)cpuMask;
+    OS_THREAD_MUTEX_UNLOCK(sSchedLock);
+    return 0;
+}
+
+static jint Liteplayer_native_setBufferConfig(JNIEnv *env, jobject thiz, jlong handle,
+                                              jint thresholdMs, jint minThresholdMs, jint maxThresholdMs, jboolean adaptive)
+{
+    OS_LOGD(TAG, "@@@ Liteplayer_native_setBufferConfig");
+    auto priv = reinterpret_cast<struct liteplayer_priv *>(handle);
+    if (priv == nullptr || priv->mPlayer == nullptr) {
+        jniThrowException(env, "java/lang/IllegalStateException", nullptr);
+        return -1;
+    }
+    if (thresholdMs < 0 || minThresholdMs < 0 || maxThresholdMs < minThresholdMs) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", "Invalid buffer threshold");
+        return -1;
+    }
+    priv->mBufferConfig.thresholdMs = thresholdMs;
+    priv->mBufferConfig.minThresholdMs = minThresholdMs;
+    priv->mBufferConfig.maxThresholdMs = maxThresholdMs;
+    priv->mBufferConfig.adaptive = adaptive == JNI_TRUE;
+    return 0;
+}
+
+static jint Liteplayer_native_getAvailableSize(JNIEnv *env, jobject thiz, jlong handle)
+{
+    auto priv = reinterpret_cast<struct liteplayer_priv *>(handle);
+    if (priv == nullptr || priv->mPlayer == nullptr) {
+        jniThrowException(env, "java/lang/IllegalStateException", nullptr);
+        return 0;
+    }
+    return (jint) liteplayer_get_available_size(priv->mPlayer);
+}
+
+// Layout of getStats values, Liteplayer.java mirrors it in its STATS_* constants
+enum {
+    STATS_UNDERRUN_COUNT = 0,
+    STATS_SOURCE_BUFFERED_BYTES,
+    STATS_PCM_BUFFERED_BYTES,
+    STATS_NETWORK_BYTES,
+    STATS_NETWORK_KBPS,
+    STATS_DECODE_US_P50,
+    STATS_DECODE_US_P99,
+    STATS_SINK_BLOCK_US,
+    STATS_SINK_BLOCK_MAX_US,
+    STATS_FIRST_AUDIO_MS,
+    STATS_COUNT,
+};
+
+static jint Liteplayer_native_getStats(JNIEnv *env, jobject thiz, jlong handle, jlongArray values)
+{
+    auto priv = reinterpret_cast<struct liteplayer_priv *>(handle);
+    if (priv == nullptr || priv->mPlayer == nullptr) {
+        jniThrowException(env, "java/lang/IllegalStateException", nullptr);
+        return -1;
+    }
+    if (values == nullptr || env->GetArrayLength(values) < STATS_COUNT) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", nullptr);
+        return -1;
+    }
+
+    struct liteplayer_stats stats;
+    stats_get(&priv->mStats, &stats);
+    stats.source_buffered_bytes = liteplayer_get_available_size(priv->mPlayer);
+#if defined(ENABLE_MIXER)
+    stats.pcm_buffered_bytes = mixer_wrapper_get_filled(liteplayer_sink_backend(priv));
+#else
+    stats.pcm_buffered_bytes = -1;
+#endif
+
+    jlong tmp[STATS_COUNT];
+    tmp[STATS_UNDERRUN_COUNT] = stats.underrun_count;
+    tmp[STATS_SOURCE_BUFFERED_BYTES] = stats.source_buffered_bytes;
+    tmp[STATS_PCM_BUFFERED_BYTES] = stats.pcm_buffered_bytes;
+    tmp[STATS_NETWORK_BYTES] = stats.network_bytes;
+    tmp[STATS_NETWORK_KBPS] = stats.network_kbps;
+    tmp[STATS_DECODE_US_P50] = stats.decode_us_p50;
+    tmp[STATS_DECODE_US_P99] = stats.decode_us_p99;
+    tmp[STATS_SINK_BLOCK_US] = stats.sink_block_us;
+    tmp[STATS_SINK_BLOCK_MAX_US] = stats.sink_block_max_us;
+    tmp[STATS_FIRST_AUDIO_MS] = stats.first_audio_ms;
+    env->SetLongArrayRegion(values, 0, STATS_COUNT, tmp);
+    return 0;
+}
+
 static jint Liteplayer_native_getCurrentPosition(JNIEnv *env, jobject thiz, jlong handle)
 {
-    OS_LOGD(TAG, "@@@ Liteplayer_native_getCurrentPosition");
     auto priv = reinterpret_cast<struct liteplayer_priv *>(handle);
     if (priv == nullptr || priv->mPlayer == nullptr) {
         jniThrowException(env, "java/lang/IllegalStateException", nullptr);
         return 0;
     }
+    // Published by sink writes, no need to lock the player
+    if (__atomic_load_n(&priv->mClock->record.seq, __ATOMIC_ACQUIRE) != 0)
+        return (jint)clock_get_position(priv->mClock);
     int msec = 0;
     liteplayer_get_position(priv->mPlayer, &msec);
-    return (jint)msec;
+    // Core position counts pcm handed to sink, minus what sink hasn't played
+    msec -= liteplayer_sink_latency_ms(priv);
+    return (jint)(msec > 0 ? msec : 0);
+}
+
+static jint Liteplayer_native_getLatency(JNIEnv *env, jobject thiz, jlong handle)
+{
+    auto priv = reinterpret_cast<struct liteplayer_priv *>(handle);
+    if (priv == nullptr || priv->mPlayer == nullptr) {
+        jniThrowException(env, "java/lang/IllegalStateException", nullptr);
+        return 0;
+    }
+    return (jint)liteplayer_sink_latency_ms(priv);
+}
+
+static jint Liteplayer_native_setMixerGain(JNIEnv *env, jobject thiz, jlong handle, jfloat gain)
+{
+    auto priv = reinterpret_cast<struct liteplayer_priv *>(handle);
+    if (priv == nullptr || priv->mPlayer == nullptr) {
+        jniThrowException(env, "java/lang/IllegalStateException", nullptr);
+        return -1;
+    }
+    if (!(gain >= 0.0f && gain <= MIXER_GAIN_MAX)) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", "Invalid gain");
+        return -1;
+    }
+#if defined(ENABLE_MIXER)
+    __atomic_store_n(&priv->mGainMilli, (int)(gain * 1000 + 0.5f), __ATOMIC_RELAXED);
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+static jint Liteplayer_native_readPcm(JNIEnv *env, jobject thiz, jlong handle, jbyteArray buffer, jintArray format)
+{
+    auto priv = reinterpret_cast<struct liteplayer_priv *>(handle);
+    if (priv == nullptr || priv->mPlayer == nullptr) {
+        jniThrowException(env, "java/lang/IllegalStateException", nullptr);
+        return -1;
+    }
+    if (buffer == nullptr) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", nullptr);
+        return -1;
+    }
+#if defined(ENABLE_PCM_TAP)
+    int samplerate = 0, channels = 0;
+    tap_get_format(priv->mTap, &samplerate, &channels);
+    if (format != nullptr && env->GetArrayLength(format) >= 2) {
+        jint tmp[2] = { samplerate, channels };
+        env->SetIntArrayRegion(format, 0, 2, tmp);
+    }
+    int frameSize = channels > 0 ? channels * sizeof(short) : sizeof(short);
+    int size = env->GetArrayLength(buffer);
+    int filled = bcast_ring_bytes_filled(priv->mTapReader);
+    if (size > filled)
+        size = filled;
+    if (size > PCM_TAP_BUFFER_BYTES)
+        size = PCM_TAP_BUFFER_BYTES;
+    size -= size % frameSize;
+    if (size <= 0)
+        return 0;
+    // Never blocks on the player, a short read is returned if data was dropped.
+    // readPcm is called from one thread, so the buffer of the player is free
+    int ret = bcast_ring_read(priv->mTapReader, priv->mTapBuffer, size, 1);
+    if (ret > 0)
+        env->SetByteArrayRegion(buffer, 0, ret, (jbyte *)priv->mTapBuffer);
+    return ret > 0 ? (jint)ret : 0;
+#else
+    return -1;
+#endif
 }
 
 static jint Liteplayer_native_getDuration(JNIEnv *env, jobject thiz, jlong handle)
 {
-    OS_LOGD(TAG, "@@@ Liteplayer_native_getCurrentPosition");
     auto priv = reinterpret_cast<struct liteplayer_priv *>(handle);
     if (priv == nullptr || priv->mPlayer == nullptr) {
         jniThrowException(env, "java/lang/IllegalStateException", nullptr);
@@ -394,19 +1065,129 @@ static void Liteplayer_native_destroy(JNIEnv *env, jobject thiz, jlong handle)
         jniThrowException(env, "java/lang/IllegalStateException", nullptr);
         return;
     }
-    liteplayer_destroy(priv->mPlayer);
-    priv->mPlayer = nullptr;
-    // remove global references
-    env->DeleteGlobalRef(priv->mObject);
-    env->DeleteGlobalRef(priv->mClass);
-    priv->mObject = nullptr;
-    priv->mClass = nullptr;
-    free(priv);
+    // A pooled player reports the core position until its next data source
+    clock_unpublish(priv->mClock);
+    // Keep the player warm for next native_create if pool isn't full
+    bool reuse = liteplayer_pool_available() && liteplayer_reset(priv->mPlayer) == 0;
+    if (!reuse) {
+        // Stop player threads first, sink callbacks use mObject as well
+        liteplayer_destroy(priv->mPlayer);
+        priv->mPlayer = nullptr;
+    }
+    // State callbacks are posted asynchronously, wait for those that still hold the object
+    jobject object = __atomic_exchange_n(&priv->mObject, nullptr, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&priv->mCallbacks, __ATOMIC_ACQUIRE) != 0)
+        OS_THREAD_SLEEP_MSEC(1);
+    env->DeleteGlobalRef(object);
+    if (!reuse || !liteplayer_pool_put(priv))
+        liteplayer_priv_destroy(env, priv);
+}
+
+static jint Liteplayer_native_dumpTrace(JNIEnv *env, jclass clazz, jstring path)
+{
+    OS_LOGD(TAG, "@@@ Liteplayer_native_dumpTrace");
+    if (path == nullptr) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", nullptr);
+        return -1;
+    }
+    const char *tmp = env->GetStringUTFChars(path, nullptr);
+    if (tmp == nullptr) {
+        jniThrowException(env, "java/lang/RuntimeException", "Out of memory");
+        return -1;
+    }
+    int ret = OS_TRACE_DUMP(tmp);
+    env->ReleaseStringUTFChars(path, tmp);
+    return (jint)ret;
+}
+
+static jstring Liteplayer_native_getMemoryStats(JNIEnv *env, jclass clazz)
+{
+    OS_LOGD(TAG, "@@@ Liteplayer_native_getMemoryStats");
+#if defined(ENABLE_MEMORY_ACCOUNTING)
+    // Stacks may be sampled between sizing and filling, retry until it fits
+    int size = os_memstat_dump_json(nullptr, 0) + 1;
+    for (;;) {
+        char *json = (char *)malloc(size);
+        if (json == nullptr) {
+            jniThrowException(env, "java/lang/RuntimeException", "Out of memory");
+            return nullptr;
+        }
+        int len = os_memstat_dump_json(json, size);
+        if (len < size) {
+            jstring ret = env->NewStringUTF(json);
+            free(json);
+            return ret;
+        }
+        free(json);
+        size = len + 1;
+    }
+#else
+    return nullptr;
+#endif
+}
+
+static jint Liteplayer_native_decodeToFile(JNIEnv *env, jclass clazz, jstring url, jstring path)
+{
+    OS_LOGD(TAG, "@@@ Liteplayer_native_decodeToFile");
+    if (url == nullptr || path == nullptr) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", nullptr);
+        return -1;
+    }
+    const char *tmp = env->GetStringUTFChars(url, nullptr);
+    if (tmp == nullptr) {
+        jniThrowException(env, "java/lang/RuntimeException", "Out of memory");
+        return -1;
+    }
+    std::string source = tmp;
+    env->ReleaseStringUTFChars(url, tmp);
+    tmp = env->GetStringUTFChars(path, nullptr);
+    if (tmp == nullptr) {
+        jniThrowException(env, "java/lang/RuntimeException", "Out of memory");
+        return -1;
+    }
+    std::string target = tmp;
+    env->ReleaseStringUTFChars(path, tmp);
+
+    // Dedicated player, pooled players are paced by the realtime sink
+    liteplayer_handle_t player = liteplayer_create();
+    if (player == nullptr)
+        return -1;
+    struct file_wrapper file_ops = {
+            .file_priv = nullptr,
+            .open = fatfs_wrapper_open,
+            .read = fatfs_wrapper_read,
+            .filesize = fatfs_wrapper_filesize,
+            .seek = fatfs_wrapper_seek,
+            .close = fatfs_wrapper_close,
+    };
+    liteplayer_register_file_wrapper(player, &file_ops);
+    struct http_wrapper http_ops = {
+            .http_priv = nullptr,
+            .open = httpclient_wrapper_open,
+            .read = httpclient_wrapper_read,
+            .filesize = httpclient_wrapper_filesize,
+            .seek = httpclient_wrapper_seek,
+            .close = httpclient_wrapper_close,
+    };
+    liteplayer_register_http_wrapper(player, &http_ops);
+    struct sink_wrapper sink_ops = {
+            .sink_priv = (void *)target.c_str(),
+            .open = wavfile_wrapper_open,
+            .write = wavfile_wrapper_write,
+            .close = wavfile_wrapper_close,
+    };
+    int ret = liteplayer_decode_to(player, source.c_str(), &sink_ops);
+    liteplayer_destroy(player);
+    return (jint)ret;
 }
 
 static JNINativeMethod gMethods[] = {
         {"native_create", "(Ljava/lang/Object;)J", (void *)Liteplayer_native_create},
         {"native_destroy", "(J)V", (void *)Liteplayer_native_destroy},
+        {"native_setPoolCapacity", "(I)V", (void *)Liteplayer_native_setPoolCapacity},
+        {"native_dumpTrace", "(Ljava/lang/String;)I", (void *)Liteplayer_native_dumpTrace},
+        {"native_getMemoryStats", "()Ljava/lang/String;", (void *)Liteplayer_native_getMemoryStats},
+        {"native_decodeToFile", "(Ljava/lang/String;Ljava/lang/String;)I", (void *)Liteplayer_native_decodeToFile},
         {"native_setDataSource", "(JLjava/lang/String;)I", (void *)Liteplayer_native_setDataSource},
         {"native_prepareAsync", "(J)I", (void *)Liteplayer_native_prepareAsync},
         {"native_start", "(J)I", (void *)Liteplayer_native_start},
@@ -415,6 +1196,13 @@ static JNINativeMethod gMethods[] = {
         {"native_seekTo", "(JI)I", (void *)Liteplayer_native_seekTo},
         {"native_stop", "(J)I", (void *)Liteplayer_native_stop},
         {"native_reset", "(J)I", (void *)Liteplayer_native_reset},
+        {"native_setThreadConfig", "(JIIJ)I", (void *)Liteplayer_native_setThreadConfig},
+        {"native_setBufferConfig", "(JIIIZ)I", (void *)Liteplayer_native_setBufferConfig},
+        {"native_getAvailableSize", "(J)I", (void *)Liteplayer_native_getAvailableSize},
+        {"native_getStats", "(J[J)I", (void *)Liteplayer_native_getStats},
+        {"native_getLatency", "(J)I", (void *)Liteplayer_native_getLatency},
+        {"native_setMixerGain", "(JF)I", (void *)Liteplayer_native_setMixerGain},
+        {"native_readPcm", "(J[B[I)I", (void *)Liteplayer_native_readPcm},
         {"native_getCurrentPosition", "(J)I", (void *)Liteplayer_native_getCurrentPosition},
         {"native_getDuration", "(J)I", (void *)Liteplayer_native_getDuration},
 };
@@ -448,7 +1236,16 @@ jint JNI_OnLoad(JavaVM *vm, void *reserved)
         goto bail;
     }
 
+    if (pthread_key_create(&sThreadKey, jniDetachCurrentThread) != 0) {
+        OS_LOGE(TAG, "Failed to create thread key");
+        goto bail;
+    }
+
     sJavaVM = vm;
+#if defined(ENABLE_ASYNC_LOGGER)
+    if (os_logger_async_start() != 0)
+        OS_LOGW(TAG, "Failed to start async logger, logging synchronously");
+#endif
     /* success -- return valid version number */
     result = JNI_VERSION_1_6;
 
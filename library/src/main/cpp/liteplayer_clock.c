@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "msgutils/cutils/os_time.h"
+#include "liteplayer_clock.h"
+
+#define LOAD(x)      __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define STORE(x, v)  __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+
+// Writers are the player thread and control threads, the odd seq also
+// excludes concurrent writers
+static void record_write_begin(struct position_record *record)
+{
+    long long seq = LOAD(record->seq);
+    for (;;) {
+        if ((seq & 1) == 0 &&
+            __atomic_compare_exchange_n(&record->seq, &seq, seq + 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+        seq = LOAD(record->seq);
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void record_write_end(struct position_record *record)
+{
+    __atomic_store_n(&record->seq, LOAD(record->seq) + 1, __ATOMIC_RELEASE);
+}
+
+static long long record_position(struct position_record *record, unsigned long long now_us, long long *limit_ms)
+{
+    long long seq, position, limit;
+    do {
+        seq = __atomic_load_n(&record->seq, __ATOMIC_ACQUIRE);
+        position = LOAD(record->position_ms);
+        limit = LOAD(record->limit_ms);
+        if (LOAD(record->running)) {
+            position += ((long long)now_us - LOAD(record->timestamp_us)) / 1000;
+            if (position > limit)
+                position = limit;
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) != 0 || seq != LOAD(record->seq));
+    if (limit_ms != NULL)
+        *limit_ms = limit;
+    return position;
+}
+
+void clock_reset(struct position_clock *clock, long long origin_ms)
+{
+    struct position_record *record = &clock->record;
+    record_write_begin(record);
+    clock->origin_ms = origin_ms;
+    clock->written_us = 0;
+    STORE(record->position_ms, origin_ms);
+    STORE(record->timestamp_us, (long long)OS_MONOTONIC_USEC());
+    STORE(record->limit_ms, origin_ms);
+    STORE(record->running, 0LL);
+    record_write_end(record);
+}
+
+void clock_on_sink_write(struct position_clock *clock, int size, int bytes_per_sec, int latency_ms)
+{
+    if (bytes_per_sec <= 0)
+        return;
+    struct position_record *record = &clock->record;
+    unsigned long long now_us = OS_MONOTONIC_USEC();
+    record_write_begin(record);
+    long long position = clock->origin_ms + (long long)(clock->written_us / 1000) - latency_ms;
+    if (position < clock->origin_ms)
+        position = clock->origin_ms;
+    clock->written_us += (unsigned long long)size * 1000000 / bytes_per_sec;
+    STORE(record->position_ms, position);
+    STORE(record->timestamp_us, (long long)now_us);
+    STORE(record->limit_ms, clock->origin_ms + (long long)(clock->written_us / 1000));
+    STORE(record->running, 1LL);
+    record_write_end(record);
+}
+
+void clock_pause(struct position_clock *clock)
+{
+    struct position_record *record = &clock->record;
+    unsigned long long now_us = OS_MONOTONIC_USEC();
+    long long position = record_position(record, now_us, NULL);
+    record_write_begin(record);
+    STORE(record->position_ms, position);
+    STORE(record->timestamp_us, (long long)now_us);
+    STORE(record->running, 0LL);
+    record_write_end(record);
+}
+
+long long clock_get_position(struct position_clock *clock)
+{
+    return record_position(&clock->record, OS_MONOTONIC_USEC(), NULL);
+}
+
+long long clock_get_latency(struct position_clock *clock)
+{
+    if (__atomic_load_n(&clock->record.seq, __ATOMIC_ACQUIRE) == 0)
+        return 0;
+    long long limit;
+    long long position = record_position(&clock->record, OS_MONOTONIC_USEC(), &limit);
+    return limit > position ? limit - position : 0;
+}
+
+void clock_unpublish(struct position_clock *clock)
+{
+    struct position_record *record = &clock->record;
+    // Wait for a concurrent writer, then drop the even seq to 0
+    record_write_begin(record);
+    __atomic_store_n(&record->seq, 0LL, __ATOMIC_RELEASE);
+}
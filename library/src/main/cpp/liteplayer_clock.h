@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LITEPLAYER_CLOCK_H_
+#define _LITEPLAYER_CLOCK_H_
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Position record read by position queries without locking the player, guarded
+ * by a seqlock: writers make seq odd while updating, readers retry if seq is
+ * odd or changed while reading. seq 0 means nothing is published, readers fall
+ * back to the player.
+ *
+ * Position at monotonic time t (microseconds, as returned by OS_MONOTONIC_USEC):
+ *   running ? min(position_ms + (t - timestamp_us) / 1000, limit_ms) : position_ms
+ */
+struct position_record {
+    long long seq;
+    long long position_ms;  // presentation position at timestamp_us
+    long long timestamp_us;
+    long long limit_ms;     // position when all pcm written to sink is played
+    long long running;      // 1 if audio is flowing, position advances with time
+};
+
+struct position_clock {
+    struct position_record record;
+    long long origin_ms;            // position of the first pcm written since reset
+    unsigned long long written_us;  // pcm written since reset
+};
+
+// Call on new data source or seek, position restarts from origin_ms
+void clock_reset(struct position_clock *clock, long long origin_ms);
+
+// Call before every sink write, latency_ms is the pcm queued in sink
+void clock_on_sink_write(struct position_clock *clock, int size, int bytes_per_sec, int latency_ms);
+
+// Call on pause/stop, position is frozen until next sink write
+void clock_pause(struct position_clock *clock);
+
+long long clock_get_position(struct position_clock *clock);
+
+// Pcm written to sink but not played yet, from the record only, 0 if unpublished
+long long clock_get_latency(struct position_clock *clock);
+
+// Reset seq to 0, readers ignore the record until next clock_reset
+void clock_unpublish(struct position_clock *clock);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _LITEPLAYER_CLOCK_H_ */
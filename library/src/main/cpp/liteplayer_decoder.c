@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+
+#include "msgutils/cutils/os_thread.h"
+#include "cutils/log_gate.h"
+#include "liteplayer_decoder.h"
+
+#define TAG "liteplayer_decoder"
+
+struct decoder_priv {
+    os_mutex_t lock;
+    os_cond_t cond;
+    bool done;
+    enum liteplayer_state state;
+    int errcode;
+};
+
+static int decoder_state_noop(enum liteplayer_state state, int errcode, void *callback_priv)
+{
+    return 0;
+}
+
+static int decoder_state_callback(enum liteplayer_state state, int errcode, void *callback_priv)
+{
+    struct decoder_priv *priv = (struct decoder_priv *)callback_priv;
+    if (state != LITEPLAYER_COMPLETED && state != LITEPLAYER_STOPPED && state != LITEPLAYER_ERROR)
+        return 0;
+    OS_THREAD_MUTEX_LOCK(priv->lock);
+    if (!priv->done) {
+        priv->done = true;
+        priv->state = state;
+        priv->errcode = errcode;
+        OS_THREAD_COND_SIGNAL(priv->cond);
+    }
+    OS_THREAD_MUTEX_UNLOCK(priv->lock);
+    return 0;
+}
+
+int liteplayer_decode_to(liteplayer_handle_t handle, const char *url, struct sink_wrapper *sink)
+{
+    if (handle == NULL || url == NULL || sink == NULL)
+        return -1;
+
+    struct decoder_priv priv = {
+        .lock = OS_THREAD_MUTEX_CREATE(),
+        .cond = OS_THREAD_COND_CREATE(),
+        .done = false,
+        .state = LITEPLAYER_IDLE,
+        .errcode = 0,
+    };
+    int ret = -1;
+    if (priv.lock == NULL || priv.cond == NULL)
+        goto out;
+
+    liteplayer_register_sink_wrapper(handle, sink);
+    liteplayer_register_state_listener(handle, decoder_state_callback, &priv);
+
+    // Zero threshold, decoding starts as soon as the first frame is available
+    if (liteplayer_set_data_source(handle, url, 0) != 0) {
+        OS_LOGE(TAG, "Failed to set data source: %s", url);
+        goto reset;
+    }
+    if (liteplayer_prepare(handle) != 0) {
+        OS_LOGE(TAG, "Failed to prepare: %s", url);
+        goto reset;
+    }
+    if (liteplayer_start(handle) != 0) {
+        OS_LOGE(TAG, "Failed to start: %s", url);
+        goto reset;
+    }
+
+    OS_THREAD_MUTEX_LOCK(priv.lock);
+    while (!priv.done)
+        OS_THREAD_COND_WAIT(priv.cond, priv.lock);
+    OS_THREAD_MUTEX_UNLOCK(priv.lock);
+
+    if (priv.state == LITEPLAYER_COMPLETED)
+        ret = 0;
+    else
+        OS_LOGE(TAG, "Decoding aborted: state=%d, errcode=%d", priv.state, priv.errcode);
+
+reset:
+    // Detach the listener before priv goes out of scope
+    liteplayer_reset(handle);
+    liteplayer_register_state_listener(handle, decoder_state_noop, NULL);
+out:
+    if (priv.cond != NULL)
+        OS_THREAD_COND_DESTROY(priv.cond);
+    if (priv.lock != NULL)
+        OS_THREAD_MUTEX_DESTROY(priv.lock);
+    return ret;
+}
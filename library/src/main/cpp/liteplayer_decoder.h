@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LITEPLAYER_DECODER_H_
+#define _LITEPLAYER_DECODER_H_
+
+#include <stdbool.h>
+#include "liteplayer/liteplayer_main.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Decode url into sink as fast as the cpu allows and return when the stream
+ * is completed. Nothing is paced: the source isn't buffered up to a threshold
+ * before decoding, and sink writes are expected to return immediately, so the
+ * only limit is decoder throughput. Useful for transcoding, loudness analysis
+ * and waveform generation.
+ *
+ * The handle must be idle with file/http wrappers registered, its sink wrapper
+ * and state listener are replaced, register them again before normal playback.
+ * Calling liteplayer_stop() from another thread aborts the decoding.
+ *
+ * @return 0 if completed, -1 if failed or aborted
+ */
+int liteplayer_decode_to(liteplayer_handle_t handle, const char *url, struct sink_wrapper *sink);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _LITEPLAYER_DECODER_H_ */
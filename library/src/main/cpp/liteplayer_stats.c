@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "msgutils/cutils/os_time.h"
+#include "liteplayer_stats.h"
+
+#define LOAD(x)      __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define STORE(x, v)  __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#define ADD(x, v)    __atomic_add_fetch(&(x), (v), __ATOMIC_RELAXED)
+
+static int histogram_index(unsigned long long value)
+{
+    if (value < 8)
+        return (int)value;
+    int msb = 63 - __builtin_clzll(value);
+    int idx = (msb - 2) * 8 + (int)((value >> (msb - 3)) & 7);
+    return idx < STATS_HISTOGRAM_BUCKETS ? idx : STATS_HISTOGRAM_BUCKETS - 1;
+}
+
+static unsigned long long histogram_value(int idx)
+{
+    if (idx < 8)
+        return (unsigned long long)idx;
+    int msb = idx / 8 + 2;
+    return (unsigned long long)(8 + idx % 8) << (msb - 3);
+}
+
+int stats_histogram_percentile(struct stats_histogram *h, int percent)
+{
+    unsigned long long total = 0, sum = 0;
+    int i;
+    for (i = 0; i < STATS_HISTOGRAM_BUCKETS; i++)
+        total += LOAD(h->counts[i]);
+    if (total == 0)
+        return 0;
+    unsigned long long target = (total * percent + 99) / 100;
+    for (i = 0; i < STATS_HISTOGRAM_BUCKETS; i++) {
+        sum += LOAD(h->counts[i]);
+        if (sum >= target)
+            break;
+    }
+    return (int)histogram_value(i < STATS_HISTOGRAM_BUCKETS ? i : STATS_HISTOGRAM_BUCKETS - 1);
+}
+
+void stats_histogram_add(struct stats_histogram *h, unsigned long long value)
+{
+    ADD(h->counts[histogram_index(value)], 1);
+}
+
+void stats_init(struct stats_collector *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+void stats_reset(struct stats_collector *stats)
+{
+    STORE(stats->first_audio_us, 0ULL);
+    STORE(stats->prepare_us, 0ULL);
+    __atomic_add_fetch(&stats->reset_epoch, 1, __ATOMIC_RELEASE);
+}
+
+// Called by the sink writer, it owns the sink counters and the histogram
+static void stats_apply_sink_epochs(struct stats_collector *stats)
+{
+    unsigned int reset = __atomic_load_n(&stats->reset_epoch, __ATOMIC_ACQUIRE);
+    unsigned int discontinuity = __atomic_load_n(&stats->discontinuity_epoch, __ATOMIC_ACQUIRE);
+    if (reset != LOAD(stats->sink_reset_epoch)) {
+        int i;
+        for (i = 0; i < STATS_HISTOGRAM_BUCKETS; i++)
+            STORE(stats->decode.counts[i], 0U);
+        STORE(stats->underruns, 0U);
+        STORE(stats->sink_block_us, 0ULL);
+        STORE(stats->sink_block_max_us, 0ULL);
+        STORE(stats->last_write_us, 0ULL);
+        STORE(stats->sink_deadline_us, 0ULL);
+        __atomic_store_n(&stats->sink_reset_epoch, reset, __ATOMIC_RELEASE);
+    }
+    if (discontinuity != LOAD(stats->sink_discontinuity_epoch)) {
+        STORE(stats->last_write_us, 0ULL);
+        STORE(stats->sink_deadline_us, 0ULL);
+        __atomic_store_n(&stats->sink_discontinuity_epoch, discontinuity, __ATOMIC_RELEASE);
+    }
+}
+
+static bool stats_sink_pending(struct stats_collector *stats)
+{
+    return __atomic_load_n(&stats->sink_reset_epoch, __ATOMIC_ACQUIRE) != LOAD(stats->reset_epoch);
+}
+
+static bool stats_network_pending(struct stats_collector *stats)
+{
+    return __atomic_load_n(&stats->network_reset_epoch, __ATOMIC_ACQUIRE) != LOAD(stats->reset_epoch);
+}
+
+void stats_on_prepare(struct stats_collector *stats)
+{
+    STORE(stats->first_audio_us, 0ULL);
+    STORE(stats->prepare_us, OS_MONOTONIC_USEC());
+}
+
+void stats_on_discontinuity(struct stats_collector *stats)
+{
+    __atomic_add_fetch(&stats->discontinuity_epoch, 1, __ATOMIC_RELEASE);
+}
+
+void stats_on_sink_write(struct stats_collector *stats, int size, int bytes_per_sec,
+                         unsigned long long begin_us, unsigned long long end_us)
+{
+    stats_apply_sink_epochs(stats);
+
+    unsigned long long prepare_us = LOAD(stats->prepare_us);
+    if (prepare_us != 0) {
+        STORE(stats->first_audio_us, begin_us - prepare_us);
+        STORE(stats->prepare_us, 0ULL);
+    }
+
+    // Model the data queued in sink: if the previous chunks have been played
+    // out before this write begins, the device has starved
+    unsigned long long last_us = LOAD(stats->last_write_us);
+    unsigned long long deadline_us = LOAD(stats->sink_deadline_us);
+    if (last_us != 0) {
+        stats_histogram_add(&stats->decode, begin_us - last_us);
+        if (begin_us > deadline_us)
+            ADD(stats->underruns, 1);
+    }
+    if (deadline_us < begin_us)
+        deadline_us = begin_us;
+    if (bytes_per_sec > 0)
+        deadline_us += (unsigned long long)size * 1000000 / bytes_per_sec;
+    STORE(stats->sink_deadline_us, deadline_us);
+    STORE(stats->last_write_us, end_us);
+
+    unsigned long long block_us = end_us - begin_us;
+    ADD(stats->sink_block_us, block_us);
+    if (block_us > LOAD(stats->sink_block_max_us))
+        STORE(stats->sink_block_max_us, block_us);
+}
+
+void stats_on_network_read(struct stats_collector *stats, int size, unsigned long long cost_us)
+{
+    unsigned int reset = __atomic_load_n(&stats->reset_epoch, __ATOMIC_ACQUIRE);
+    if (reset != LOAD(stats->network_reset_epoch)) {
+        STORE(stats->network_bytes, 0ULL);
+        STORE(stats->network_us, 0ULL);
+        __atomic_store_n(&stats->network_reset_epoch, reset, __ATOMIC_RELEASE);
+    }
+    if (size > 0)
+        ADD(stats->network_bytes, (unsigned long long)size);
+    ADD(stats->network_us, cost_us);
+}
+
+unsigned long long stats_sink_queued_us(struct stats_collector *stats)
+{
+    if (LOAD(stats->last_write_us) == 0 || stats_sink_pending(stats) ||
+        LOAD(stats->sink_discontinuity_epoch) != LOAD(stats->discontinuity_epoch))
+        return 0;
+    unsigned long long deadline_us = LOAD(stats->sink_deadline_us);
+    unsigned long long now_us = OS_MONOTONIC_USEC();
+    return deadline_us > now_us ? deadline_us - now_us : 0;
+}
+
+void stats_get(struct stats_collector *stats, struct liteplayer_stats *out)
+{
+    // Counters with a reset not yet applied by their writer read as zero
+    bool network_pending = stats_network_pending(stats);
+    bool sink_pending = stats_sink_pending(stats);
+    unsigned long long network_bytes = network_pending ? 0 : LOAD(stats->network_bytes);
+    unsigned long long network_us = network_pending ? 0 : LOAD(stats->network_us);
+    unsigned long long first_audio_us = LOAD(stats->first_audio_us);
+
+    out->underrun_count = sink_pending ? 0 : (int)LOAD(stats->underruns);
+    out->network_bytes = (long long)network_bytes;
+    out->network_kbps = network_us > 0 ? (int)(network_bytes * 8 * 1000 / network_us) : 0;
+    out->decode_us_p50 = sink_pending ? 0 : stats_histogram_percentile(&stats->decode, 50);
+    out->decode_us_p99 = sink_pending ? 0 : stats_histogram_percentile(&stats->decode, 99);
+    out->sink_block_us = sink_pending ? 0 : (long long)LOAD(stats->sink_block_us);
+    out->sink_block_max_us = sink_pending ? 0 : (int)LOAD(stats->sink_block_max_us);
+    out->first_audio_ms = first_audio_us != 0 ? (int)(first_audio_us / 1000) : -1;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LITEPLAYER_STATS_H_
+#define _LITEPLAYER_STATS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STATS_HISTOGRAM_BUCKETS 160
+
+// Log-linear histogram, 8 buckets per power of two, about 12% precision
+struct stats_histogram {
+    unsigned int counts[STATS_HISTOGRAM_BUCKETS];
+};
+
+/**
+ * Counters of one player, collected from adapter callbacks. Each counter is
+ * written by one player thread and read atomically, so that querying stats
+ * never blocks the playback threads. Resets from other threads only bump an
+ * epoch, the owning thread clears its counters on its next update.
+ */
+struct stats_collector {
+    unsigned int reset_epoch;           // bumped by stats_reset
+    unsigned int discontinuity_epoch;   // bumped by stats_on_discontinuity
+    unsigned int sink_reset_epoch;      // reset_epoch applied by sink writer
+    unsigned int sink_discontinuity_epoch;
+    unsigned int network_reset_epoch;   // reset_epoch applied by network reader
+    unsigned long long prepare_us;      // time of prepare, 0 if first audio received
+    unsigned long long first_audio_us;  // from prepare to first pcm written to sink
+    unsigned long long sink_deadline_us;// time when data queued in sink runs out
+    unsigned long long last_write_us;   // time of last sink write returned
+    unsigned long long sink_block_us;   // total time blocked in sink write
+    unsigned long long sink_block_max_us;
+    unsigned long long network_bytes;
+    unsigned long long network_us;      // time spent in network reads
+    unsigned int underruns;
+    struct stats_histogram decode;      // time between sink writes, excluding sink blocking
+};
+
+struct liteplayer_stats {
+    int underrun_count;
+    int source_buffered_bytes;          // filled by caller, -1 if unknown
+    int pcm_buffered_bytes;             // filled by caller, -1 if unknown
+    long long network_bytes;
+    int network_kbps;                   // throughput while reading
+    int decode_us_p50;                  // time to produce one pcm chunk
+    int decode_us_p99;
+    long long sink_block_us;            // total time blocked in sink write
+    int sink_block_max_us;
+    int first_audio_ms;                 // from prepare to first audio, -1 if not yet
+};
+
+void stats_histogram_add(struct stats_histogram *h, unsigned long long value);
+
+// Value at percent of all samples, 0 if empty
+int stats_histogram_percentile(struct stats_histogram *h, int percent);
+
+// Only before the collector is shared with other threads
+void stats_init(struct stats_collector *stats);
+
+// Counters read as zero from now, cleared by their writers on next update
+void stats_reset(struct stats_collector *stats);
+
+void stats_on_prepare(struct stats_collector *stats);
+
+// Call on pause/seek/stop from any thread, the gap before next write isn't an underrun
+void stats_on_discontinuity(struct stats_collector *stats);
+
+// Call after every sink write, bytes_per_sec is the pcm byterate
+void stats_on_sink_write(struct stats_collector *stats, int size, int bytes_per_sec,
+                         unsigned long long begin_us, unsigned long long end_us);
+
+void stats_on_network_read(struct stats_collector *stats, int size, unsigned long long cost_us);
+
+void stats_get(struct stats_collector *stats, struct liteplayer_stats *out);
+
+// Estimated pcm still queued in sink, for sinks that can't report their latency
+unsigned long long stats_sink_queued_us(struct stats_collector *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _LITEPLAYER_STATS_H_ */
@@ -0,0 +1,416 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <limits.h>
+#include <unistd.h>
+#include <sched.h>
+#include <exception>
+
+#include "cutils/log_gate.h"
+#include "cutils/os_futex.h"
+#include "cutils/os_sched.h"
+#include "utils/ThreadPool.h"
+
+#define TAG "ThreadPool"
+
+#define DEQUE_INITIAL_CAPACITY 256
+#define STEAL_ROUNDS           4   // rounds over all victims before parking
+
+/**
+ * Chase-Lev deque, with the memory orderings of "Correct and Efficient
+ * Work-Stealing for Weak Memory Models" (Le et al, PPoPP 2013). The owner
+ * pushes and pops at bottom, thieves steal at top. Buffers replaced on
+ * growth are kept until the deque is destroyed, a thief may still be reading
+ * from one, they sum up to less than the final buffer.
+ */
+class ThreadPool::WorkDeque {
+public:
+    WorkDeque() : mTop(0), mBottom(0) {
+        mBuffer.store(new Buffer(DEQUE_INITIAL_CAPACITY), std::memory_order_relaxed);
+    }
+
+    ~WorkDeque() {
+        delete mBuffer.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < mRetired.size(); i++)
+            delete mRetired[i];
+    }
+
+    // Owner only
+    void push(Task *task) {
+        long b = mBottom.load(std::memory_order_relaxed);
+        long t = mTop.load(std::memory_order_acquire);
+        Buffer *buffer = mBuffer.load(std::memory_order_relaxed);
+        if (b - t > buffer->mask) {
+            Buffer *bigger = new Buffer((buffer->mask + 1) * 2);
+            for (long i = t; i < b; i++)
+                bigger->put(i, buffer->get(i));
+            mRetired.push_back(buffer);
+            mBuffer.store(bigger, std::memory_order_release);
+            buffer = bigger;
+        }
+        buffer->put(b, task);
+        // Release publishes the task to thieves that acquire bottom
+        mBottom.store(b + 1, std::memory_order_release);
+    }
+
+    // Owner only
+    Task *pop() {
+        long b = mBottom.load(std::memory_order_relaxed) - 1;
+        Buffer *buffer = mBuffer.load(std::memory_order_relaxed);
+        mBottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long t = mTop.load(std::memory_order_relaxed);
+        if (t > b) {
+            mBottom.store(b + 1, std::memory_order_relaxed);
+            return NULL;
+        }
+        Task *task = buffer->get(b);
+        if (t == b) {
+            // Last one, race against thieves for it
+            if (!mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                task = NULL;
+            mBottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return task;
+    }
+
+    // Any thread, NULL if empty or lost the race against another thief
+    Task *steal() {
+        long t = mTop.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long b = mBottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return NULL;
+        Buffer *buffer = mBuffer.load(std::memory_order_acquire);
+        Task *task = buffer->get(t);
+        if (!mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            return NULL;
+        return task;
+    }
+
+    bool empty() const {
+        long t = mTop.load(std::memory_order_acquire);
+        long b = mBottom.load(std::memory_order_acquire);
+        return t >= b;
+    }
+
+private:
+    struct Buffer {
+        long mask;
+        std::atomic<Task *> *slots;
+
+        explicit Buffer(long capacity) : mask(capacity - 1), slots(new std::atomic<Task *>[capacity]) {}
+        ~Buffer() { delete[] slots; }
+        Task *get(long i) { return slots[i & mask].load(std::memory_order_relaxed); }
+        void put(long i, Task *task) { slots[i & mask].store(task, std::memory_order_relaxed); }
+    };
+
+    // top and bottom are written by different threads, keep them apart
+    std::atomic<long> mTop;
+    char mPadding[64 - sizeof(std::atomic<long>)];
+    std::atomic<long> mBottom;
+    std::atomic<Buffer *> mBuffer;
+    std::vector<Buffer *> mRetired;
+};
+
+struct ThreadPool::Worker {
+    ThreadPool *pool;
+    int index;
+    enum os_threadprio priority;
+    uint64_t cpumask;
+    os_thread_t tid;
+    WorkDeque deque;
+    unsigned int seed;
+    std::atomic<unsigned long long> executed;
+    std::atomic<unsigned long long> stolen;
+    std::atomic<unsigned long long> parked;
+};
+
+thread_local ThreadPool::Worker *ThreadPool::sCurrentWorker = NULL;
+
+static uint64_t pick_cpu(uint64_t cpumask, int index)
+{
+    int count = __builtin_popcountll(cpumask);
+    int nth = index % count;
+    for (unsigned int cpu = 0; cpu < sizeof(cpumask) * 8; cpu++) {
+        if ((cpumask & (1ULL << cpu)) && nth-- == 0)
+            return 1ULL << cpu;
+    }
+    return cpumask;
+}
+
+ThreadPool::ThreadPool(const char *name, int threads, enum os_threadprio priority,
+                       uint64_t cpumask, unsigned int stacksize)
+    : mName(name != NULL ? name : "ThreadPool"),
+      mInjectCount(0),
+      mSleepers(0),
+      mWakeSeq(0),
+      mExit(false)
+{
+    if (threads <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cores > 0 ? (int)cores : 1;
+    }
+
+    for (int i = 0; i < threads; i++) {
+        Worker *worker = new Worker;
+        worker->pool = this;
+        worker->index = i;
+        worker->priority = priority;
+        worker->cpumask = cpumask != 0 ? pick_cpu(cpumask, i) : 0;
+        worker->seed = (unsigned int)i * 2654435761U + 1;
+        worker->executed.store(0, std::memory_order_relaxed);
+        worker->stolen.store(0, std::memory_order_relaxed);
+        worker->parked.store(0, std::memory_order_relaxed);
+        mWorkers.push_back(worker);
+    }
+
+    // Start workers only after the vector is complete, they scan it to steal
+    for (size_t i = 0; i < mWorkers.size(); i++) {
+        Worker *worker = mWorkers[i];
+        std::string threadName = mName + "-" + std::to_string(i);
+        struct os_threadattr attr;
+        attr.name = threadName.c_str();
+        attr.priority = priority;
+        attr.stacksize = stacksize;
+        attr.joinable = true;
+        worker->tid = OS_THREAD_CREATE(&attr, workerEntry, worker);
+        if (worker->tid == NULL) {
+            OS_LOGE(TAG, "[%s] Failed to create worker %zu", mName.c_str(), i);
+            stopWorkers();
+            return;
+        }
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    stopWorkers();
+    // Workers drain the injection queue before exiting, nothing is left here
+    // unless a task was posted from outside while destructing
+    while (!mInjectQueue.empty()) {
+        delete mInjectQueue.front();
+        mInjectQueue.pop_front();
+    }
+}
+
+// Leaves the pool without workers
+void ThreadPool::stopWorkers()
+{
+    mExit.store(true, std::memory_order_seq_cst);
+    notify(INT_MAX);
+    for (size_t i = 0; i < mWorkers.size(); i++) {
+        if (mWorkers[i]->tid != NULL)
+            OS_THREAD_JOIN(mWorkers[i]->tid, NULL);
+    }
+    for (size_t i = 0; i < mWorkers.size(); i++)
+        delete mWorkers[i];
+    mWorkers.clear();
+}
+
+void ThreadPool::post(Task task)
+{
+    if (mWorkers.empty()) {
+        OS_LOGE(TAG, "[%s] No worker, task dropped", mName.c_str());
+        return;
+    }
+    push(new Task(std::move(task)));
+}
+
+void ThreadPool::push(Task *task)
+{
+    Worker *self = sCurrentWorker;
+    if (self != NULL && self->pool == this) {
+        self->deque.push(task);
+    } else {
+        msgutils::Mutex::Autolock _l(mInjectMutex);
+        mInjectQueue.push_back(task);
+        mInjectCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    // Pairs with the fence in workerLoop: either a parking worker sees this
+    // task when scanning again, or we see it parking and wake it up
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mSleepers.load(std::memory_order_relaxed) > 0)
+        notify(1);
+}
+
+void ThreadPool::notify(int count)
+{
+    __atomic_fetch_add(&mWakeSeq, 1, __ATOMIC_SEQ_CST);
+    os_futex_wake(&mWakeSeq, count);
+}
+
+ThreadPool::Task *ThreadPool::takeInjected()
+{
+    if (mInjectCount.load(std::memory_order_relaxed) == 0)
+        return NULL;
+    msgutils::Mutex::Autolock _l(mInjectMutex);
+    if (mInjectQueue.empty())
+        return NULL;
+    Task *task = mInjectQueue.front();
+    mInjectQueue.pop_front();
+    mInjectCount.fetch_sub(1, std::memory_order_relaxed);
+    return task;
+}
+
+ThreadPool::Task *ThreadPool::findTask(Worker *self)
+{
+    Task *task = self->deque.pop();
+    if (task != NULL)
+        return task;
+    task = takeInjected();
+    if (task != NULL)
+        return task;
+
+    // Start from a random victim so thieves don't all pile on the same one
+    size_t count = mWorkers.size();
+    self->seed = self->seed * 1103515245U + 12345U;
+    size_t start = (self->seed >> 16) % count;
+    for (size_t i = 0; i < count; i++) {
+        Worker *victim = mWorkers[(start + i) % count];
+        if (victim == self)
+            continue;
+        task = victim->deque.steal();
+        if (task != NULL) {
+            self->stolen.fetch_add(1, std::memory_order_relaxed);
+            return task;
+        }
+    }
+    return NULL;
+}
+
+void ThreadPool::workerLoop(Worker *self)
+{
+    for (;;) {
+        Task *task = NULL;
+        for (int round = 0; round < STEAL_ROUNDS && task == NULL; round++) {
+            task = findTask(self);
+            if (task == NULL && round + 1 < STEAL_ROUNDS)
+                sched_yield();
+        }
+
+        if (task == NULL) {
+            int seq = __atomic_load_n(&mWakeSeq, __ATOMIC_SEQ_CST);
+            mSleepers.fetch_add(1, std::memory_order_seq_cst);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            task = findTask(self);
+            if (task == NULL) {
+                if (mExit.load(std::memory_order_seq_cst)) {
+                    mSleepers.fetch_sub(1, std::memory_order_relaxed);
+                    break;
+                }
+                self->parked.fetch_add(1, std::memory_order_relaxed);
+                os_futex_wait(&mWakeSeq, seq, 0);
+            }
+            mSleepers.fetch_sub(1, std::memory_order_relaxed);
+            if (task == NULL)
+                continue;
+        }
+
+        // More work may be queued behind this one, let another sleeper help
+        if (mSleepers.load(std::memory_order_relaxed) > 0 &&
+            (!self->deque.empty() || mInjectCount.load(std::memory_order_relaxed) > 0))
+            notify(1);
+
+        try {
+            (*task)();
+        } catch (const std::exception &e) {
+            OS_LOGE(TAG, "[%s] Task threw: %s", mName.c_str(), e.what());
+        } catch (...) {
+            OS_LOGE(TAG, "[%s] Task threw an unknown exception", mName.c_str());
+        }
+        delete task;
+        self->executed.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void *ThreadPool::workerEntry(void *arg)
+{
+    Worker *self = (Worker *)arg;
+    sCurrentWorker = self;
+    if (self->cpumask != 0) {
+        struct os_schedattr attr;
+        OS_SCHED_FROM_PRIO(self->priority, &attr);
+        attr.cpumask = self->cpumask;
+        OS_SCHED_APPLY(&attr);
+    }
+    self->pool->workerLoop(self);
+    sCurrentWorker = NULL;
+    return NULL;
+}
+
+bool ThreadPool::isWorkerThread() const
+{
+    return sCurrentWorker != NULL && sCurrentWorker->pool == this;
+}
+
+void ThreadPool::postAndReply(std::function<void *()> func, msgutils::Handler *handler, int what)
+{
+    post([func, handler, what]() {
+        // Obtained first, a result never exists without a message to release it
+        msgutils::Message *msg = msgutils::Message::obtain(what);
+        if (msg == NULL) {
+            OS_LOGE(TAG, "Failed to obtain message for what=%d", what);
+            return;
+        }
+        msg->data = func();
+        // A failed post recycles msg, which passes the result to onFree, so
+        // msg must not be touched afterwards
+        if (!handler->postMessage(msg))
+            OS_LOGE(TAG, "Failed to post result of what=%d", what);
+    });
+}
+
+void ThreadPool::postAndReply(std::function<void *()> func, looper_t looper, int what)
+{
+    post([func, looper, what]() {
+        struct message *msg = looper_obtain_message(looper, what, 0, 0, NULL);
+        if (msg == NULL) {
+            OS_LOGE(TAG, "Failed to obtain message for what=%d", what);
+            return;
+        }
+        msg->data = func();
+        if (looper_post_message(looper, msg) != 0) {
+            OS_LOGE(TAG, "Failed to post result of what=%d", what);
+            looper_message_release(looper, msg);
+        }
+    });
+}
+
+void ThreadPool::getStats(Stats *stats) const
+{
+    stats->executed = stats->stolen = stats->parked = 0;
+    for (size_t i = 0; i < mWorkers.size(); i++) {
+        stats->executed += mWorkers[i]->executed.load(std::memory_order_relaxed);
+        stats->stolen += mWorkers[i]->stolen.load(std::memory_order_relaxed);
+        stats->parked += mWorkers[i]->parked.load(std::memory_order_relaxed);
+    }
+}
+
+void ThreadPool::dump() const
+{
+    OS_LOGI(TAG, "[%s] workers=%zu, injected=%d, sleepers=%d",
+            mName.c_str(), mWorkers.size(),
+            mInjectCount.load(std::memory_order_relaxed), mSleepers.load(std::memory_order_relaxed));
+    for (size_t i = 0; i < mWorkers.size(); i++) {
+        Worker *worker = mWorkers[i];
+        OS_LOGI(TAG, "[%s] -> worker %zu: cpumask=0x%llx, executed=%llu, stolen=%llu, parked=%llu",
+                mName.c_str(), i, (unsigned long long)worker->cpumask,
+                worker->executed.load(std::memory_order_relaxed),
+                worker->stolen.load(std::memory_order_relaxed),
+                worker->parked.load(std::memory_order_relaxed));
+    }
+}
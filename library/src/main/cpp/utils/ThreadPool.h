@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2018-2020 luoyun <sysu.zqlong@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __UTILS_THREADPOOL_H__
+#define __UTILS_THREADPOOL_H__
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "msgutils/cutils/os_thread.h"
+#include "msgutils/utils/Mutex.h"
+#include "msgutils/utils/Looper.h"
+#include "cutils/looper.h"
+
+/**
+ * Work-stealing thread pool for background jobs that don't deserve a
+ * HandlerThread of their own: batch probing, waveform generation, cache
+ * maintenance and prefetch.
+ *
+ * Each worker owns a Chase-Lev deque, tasks posted from a worker are pushed to
+ * and popped from the bottom of its own deque without any lock, idle workers
+ * steal from the top of the others. Tasks posted from other threads go to a
+ * shared injection queue. Workers with nothing to do park on a futex.
+ * Exceptions escaping a posted task are caught and logged by the worker.
+ *
+ * Usage:
+ *   ThreadPool pool("probe");
+ *   std::future<int> duration = pool.submit([url]() { return probeDuration(url); });
+ *   pool.postAndReply([url]() -> void * { return buildWaveform(url); }, handler, MSG_WAVEFORM);
+ */
+class ThreadPool {
+public:
+    typedef std::function<void()> Task;
+
+    struct Stats {
+        unsigned long long executed; // tasks run by workers
+        unsigned long long stolen;   // tasks taken from the deque of another worker
+        unsigned long long parked;   // times a worker went to sleep for lack of work
+    };
+
+    /**
+     * @threads:  worker count, 0 to use one per online core
+     * @cpumask:  cores the workers may run on, 0 means no pinning. Otherwise
+     *            worker i is pinned to the (i % n)th of the n cores in mask
+     *
+     * If a worker can't be created, the pool is left without workers and
+     * isValid() returns false. Tasks posted to it are dropped, and futures of
+     * submit() get std::future_error(broken_promise).
+     */
+    ThreadPool(const char *name = 0,
+               int threads = 0,
+               enum os_threadprio priority = OS_THREAD_PRIO_NORMAL,
+               uint64_t cpumask = 0,
+               unsigned int stacksize = 64 * 1024);
+    // Tasks already posted are run before the workers exit
+    ~ThreadPool();
+
+    void post(Task task);
+
+    // Run func on the pool, its return value or exception is delivered to the future
+    template <typename F>
+    std::future<typename std::result_of<F()>::type> submit(F &&func) {
+        typedef typename std::result_of<F()>::type R;
+        std::shared_ptr<std::packaged_task<R()> > task =
+                std::make_shared<std::packaged_task<R()> >(std::forward<F>(func));
+        std::future<R> future = task->get_future();
+        post([task]() { (*task)(); });
+        return future;
+    }
+
+    /**
+     * Run func on the pool and post its result to the looper of handler as
+     * Message(what, data = result), handler owns the result from then on and
+     * should release it in onHandle, or in onFree if the message is dropped,
+     * including when the post fails. func isn't run if no message can be
+     * obtained.
+     *
+     * handler is kept as a raw pointer until the task has run. The caller
+     * must keep it and its looper alive until then, e.g. by destroying the
+     * pool, which runs the tasks already posted, before the handler.
+     */
+    void postAndReply(std::function<void *()> func, msgutils::Handler *handler, int what);
+
+    // Same as above for the C looper, looper's free_cb releases the result,
+    // also when the post fails. looper must outlive the task as handler above
+    void postAndReply(std::function<void *()> func, looper_t looper, int what);
+
+    int threadCount() const { return (int)mWorkers.size(); }
+    // False if the workers couldn't be created
+    bool isValid() const { return !mWorkers.empty(); }
+    // Whether the calling thread is one of the workers of this pool
+    bool isWorkerThread() const;
+    void getStats(Stats *stats) const;
+    void dump() const;
+
+private:
+    struct Worker;
+    class WorkDeque;
+    static thread_local Worker *sCurrentWorker;
+
+    std::string mName;
+    std::vector<Worker *> mWorkers;
+    std::deque<Task *> mInjectQueue;
+    msgutils::Mutex mInjectMutex;
+    std::atomic<int> mInjectCount;
+    std::atomic<int> mSleepers;
+    int mWakeSeq;        // futex word, bumped on every wake up
+    std::atomic<bool> mExit;
+
+    void push(Task *task);
+    Task *takeInjected();
+    Task *findTask(Worker *self);
+    void notify(int count);
+    void stopWorkers();
+    void workerLoop(Worker *self);
+    static void *workerEntry(void *arg);
+
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+};
+
+#endif /* __UTILS_THREADPOOL_H__ */
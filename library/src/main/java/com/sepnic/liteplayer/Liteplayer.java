@@ -23,11 +23,28 @@ public class Liteplayer {
     private static final int LITEPLAYER_STOPPED         = 0x09;
     private static final int LITEPLAYER_ERROR           = 0x0A;
 
+    public static final int SCHED_NORMAL = 0;
+    public static final int SCHED_FIFO   = 1;
+    public static final int SCHED_RR     = 2;
+
+    // Layout of native_getStats values, same order as the STATS_* enum in liteplayer-jni.cpp
+    private static final int STATS_UNDERRUN_COUNT        = 0;
+    private static final int STATS_SOURCE_BUFFERED_BYTES = 1;
+    private static final int STATS_PCM_BUFFERED_BYTES    = 2;
+    private static final int STATS_NETWORK_BYTES         = 3;
+    private static final int STATS_NETWORK_KBPS          = 4;
+    private static final int STATS_DECODE_US_P50         = 5;
+    private static final int STATS_DECODE_US_P99         = 6;
+    private static final int STATS_SINK_BLOCK_US         = 7;
+    private static final int STATS_SINK_BLOCK_MAX_US     = 8;
+    private static final int STATS_FIRST_AUDIO_MS        = 9;
+    private static final int STATS_COUNT                 = 10;
+
     private final static String TAG = "Litelayer";
     private long mPlayerHandle;
     private EventHandler mEventHandler;
     private HandlerThread mHandlerThread;
-    private AudioTrack mAudioTrack;
+    private AudioTrack mAudioTrack; // only used by the native player thread
     private boolean mTrackTriggered;
 
     public Liteplayer() {
@@ -182,6 +199,21 @@ public class Liteplayer {
         p.mAudioTrack = null;
     }
 
+    private static int getAudioTrackPositionFromNative(Object liteplayer_ref) {
+        Liteplayer p = (Liteplayer)((WeakReference)liteplayer_ref).get();
+        // Called from the player thread between writes, like open/write/close
+        AudioTrack track = p != null ? p.mAudioTrack : null;
+        if (track == null) {
+            return -1;
+        }
+
+        try {
+            return track.getPlaybackHeadPosition();
+        } catch (IllegalStateException e) {
+            return -1;
+        }
+    }
+
     public interface OnIdleListener {
         /**
          * Called when the player is idle.
@@ -297,6 +329,46 @@ public class Liteplayer {
         mOnErrorListener = null;
     }
 
+    /**
+     * Keep up to capacity released players warm, so that new Liteplayer instances
+     * reuse their threads and buffers instead of creating them again.
+     * The pool is filled immediately, 0 disables pooling.
+     */
+    public static void setPoolCapacity(int capacity) throws IllegalArgumentException {
+        native_setPoolCapacity(capacity);
+    }
+
+    /**
+     * Write the recorded timeline of all player threads to path as Chrome trace json,
+     * open it with chrome://tracing or ui.perfetto.dev. Returns -1 if the library is
+     * built without ENABLE_TRACE.
+     */
+    public static int dumpTrace(String path) throws IllegalArgumentException {
+        return native_dumpTrace(path);
+    }
+
+    /**
+     * Native memory held by each part of the player, e.g. ringbuf, looper, http, and the
+     * sampled call stacks still holding it, as json. Frames are module+offset, symbolize
+     * them with addr2line against the unstripped libraries. Returns null if the library
+     * is built without ENABLE_MEMORY_ACCOUNTING.
+     * Only this library's own allocations are counted. The prebuilt core allocates its
+     * decoders and ringbuf itself, so "decoder" stays near 0 and "ringbuf" covers only
+     * the mixer and tap rings.
+     */
+    public static String getMemoryStats() {
+        return native_getMemoryStats();
+    }
+
+    /**
+     * Decode url into a 16bit wav file as fast as the cpu allows, without realtime
+     * pacing. Blocks until the whole stream is decoded, don't call it on the main
+     * thread. Returns 0 on success.
+     */
+    public static int decodeToFile(String url, String wavPath) throws IllegalArgumentException {
+        return native_decodeToFile(url, wavPath);
+    }
+
     public int setDataSource(String path) throws IllegalStateException, IllegalArgumentException {
         return native_setDataSource(mPlayerHandle, path);
     }
@@ -329,6 +401,108 @@ public class Liteplayer {
         return native_reset(mPlayerHandle);
     }
 
+    /**
+     * Set scheduling of the thread that decodes and outputs audio, takes effect
+     * when the audio sink is opened. The source thread that downloads data keeps
+     * default scheduling, and thread stack sizes can't be changed, both threads
+     * are created inside the prebuilt player core.
+     *
+     * @param policy SCHED_NORMAL, SCHED_FIFO or SCHED_RR, SCHED_FIFO/SCHED_RR
+     *               fall back to the highest audio nice value if not permitted
+     * @param priority nice value (-20~19) for SCHED_NORMAL, realtime priority (1~99) otherwise
+     * @param cpuMask cores the thread is allowed to run on, bit n is core n, 0 means no pinning
+     */
+    public int setThreadConfig(int policy, int priority, long cpuMask) throws IllegalStateException, IllegalArgumentException {
+        return native_setThreadConfig(mPlayerHandle, policy, priority, cpuMask);
+    }
+
+    /**
+     * Set how much source data is cached before playback starts, takes effect
+     * on next setDataSource().
+     *
+     * @param thresholdMs cached duration if not adaptive
+     * @param minThresholdMs lower bound in adaptive mode
+     * @param maxThresholdMs upper bound in adaptive mode
+     * @param adaptive derive the threshold from network jitter of previous streams,
+     *                 it grows on a flaky link and shrinks back when stable
+     */
+    public int setBufferConfig(int thresholdMs, int minThresholdMs, int maxThresholdMs, boolean adaptive)
+            throws IllegalStateException, IllegalArgumentException {
+        return native_setBufferConfig(mPlayerHandle, thresholdMs, minThresholdMs, maxThresholdMs, adaptive);
+    }
+
+    /**
+     * Get bytes of source data cached but not yet decoded.
+     */
+    public int getAvailableSize() throws IllegalStateException {
+        return native_getAvailableSize(mPlayerHandle);
+    }
+
+    public static class Stats {
+        public int underrunCount;        // times the audio device starved
+        public int sourceBufferedBytes;  // source data cached but not yet decoded
+        public int pcmBufferedBytes;     // pcm queued before the device, -1 if unknown
+        public long networkBytes;
+        public int networkKbps;          // throughput while reading from network
+        public int decodeUsP50;          // time to produce one pcm chunk
+        public int decodeUsP99;
+        public long sinkBlockUs;         // total time blocked in writing the device
+        public int sinkBlockMaxUs;
+        public int firstAudioMs;         // from prepare to first audio, -1 if not yet
+    }
+
+    /**
+     * Get playback statistics, cheap enough to be polled periodically.
+     */
+    public Stats getStats() throws IllegalStateException {
+        long[] values = new long[STATS_COUNT];
+        if (native_getStats(mPlayerHandle, values) != 0)
+            return null;
+        Stats stats = new Stats();
+        stats.underrunCount = (int)values[STATS_UNDERRUN_COUNT];
+        stats.sourceBufferedBytes = (int)values[STATS_SOURCE_BUFFERED_BYTES];
+        stats.pcmBufferedBytes = (int)values[STATS_PCM_BUFFERED_BYTES];
+        stats.networkBytes = values[STATS_NETWORK_BYTES];
+        stats.networkKbps = (int)values[STATS_NETWORK_KBPS];
+        stats.decodeUsP50 = (int)values[STATS_DECODE_US_P50];
+        stats.decodeUsP99 = (int)values[STATS_DECODE_US_P99];
+        stats.sinkBlockUs = values[STATS_SINK_BLOCK_US];
+        stats.sinkBlockMaxUs = (int)values[STATS_SINK_BLOCK_MAX_US];
+        stats.firstAudioMs = (int)values[STATS_FIRST_AUDIO_MS];
+        return stats;
+    }
+
+    /**
+     * Milliseconds of audio written to the output but not played yet, already
+     * subtracted from getCurrentPosition().
+     */
+    public int getLatency() throws IllegalStateException {
+        return native_getLatency(mPlayerHandle);
+    }
+
+    /**
+     * Gain of this player in the shared native mixer, from 0.0 to 4.0, 1.0 is
+     * unity. Applied with the next pcm written, kept across data sources.
+     * Returns -1 if the native mixer is disabled.
+     */
+    public int setMixerGain(float gain) throws IllegalStateException, IllegalArgumentException {
+        return native_setMixerGain(mPlayerHandle, gain);
+    }
+
+    /**
+     * Copy the latest decoded pcm for visualization, 16-bit interleaved, never
+     * blocks playback and pcm not read in time is dropped. Call from one thread.
+     * format receives {samplerate, channels} if not null.
+     * Returns bytes copied, 0 if none, -1 if the native pcm tap is disabled.
+     */
+    public int readPcm(byte[] buffer, int[] format) throws IllegalStateException, IllegalArgumentException {
+        return native_readPcm(mPlayerHandle, buffer, format);
+    }
+
+    /**
+     * Position of the audio being heard. Native reads it lock-free from the
+     * record published by sink writes, the player isn't locked.
+     */
     public int getCurrentPosition() throws IllegalStateException {
         return native_getCurrentPosition(mPlayerHandle);
     }
@@ -343,6 +517,10 @@ public class Liteplayer {
      */
     private native long native_create(Object liteplayer_this);
     private native void native_destroy(long handle) throws IllegalStateException;
+    private static native void native_setPoolCapacity(int capacity) throws IllegalArgumentException;
+    private static native int native_dumpTrace(String path) throws IllegalArgumentException;
+    private static native String native_getMemoryStats();
+    private static native int native_decodeToFile(String url, String wavPath) throws IllegalArgumentException;
     private native int native_setDataSource(long handle, String path) throws IllegalStateException, IllegalArgumentException;
     private native int native_prepareAsync(long handle) throws IllegalStateException;
     private native int native_start(long handle) throws IllegalStateException;
@@ -351,6 +529,14 @@ public class Liteplayer {
     private native int native_seekTo(long handle, int msec) throws IllegalStateException;
     private native int native_stop(long handle) throws IllegalStateException;
     private native int native_reset(long handle) throws IllegalStateException;
+    private native int native_setThreadConfig(long handle, int policy, int priority, long cpuMask) throws IllegalStateException, IllegalArgumentException;
+    private native int native_setBufferConfig(long handle, int thresholdMs, int minThresholdMs, int maxThresholdMs, boolean adaptive)
+            throws IllegalStateException, IllegalArgumentException;
+    private native int native_getAvailableSize(long handle) throws IllegalStateException;
+    private native int native_getStats(long handle, long[] values) throws IllegalStateException;
+    private native int native_getLatency(long handle) throws IllegalStateException;
+    private native int native_setMixerGain(long handle, float gain) throws IllegalStateException, IllegalArgumentException;
+    private native int native_readPcm(long handle, byte[] buffer, int[] format) throws IllegalStateException, IllegalArgumentException;
     private native int native_getCurrentPosition(long handle) throws IllegalStateException;
     private native int native_getDuration(long handle) throws IllegalStateException;
 